@@ -75,10 +75,17 @@ else ifeq ($(WASM),true)
 BASE_FLAGS += -msse -msse2 -msse3 -msimd128
 else ifeq ($(CPU_ARM32),true)
 BASE_FLAGS += -mfpu=neon-vfpv4 -mfloat-abi=hard
+else ifeq ($(CPU_X86_64)$(X86_64_V3),truetrue)
+BASE_FLAGS += -march=x86-64-v3
 else ifeq ($(CPU_I386_OR_X86_64),true)
 BASE_FLAGS += -msse -msse2 -msse3
 endif
 
+# hot code paths get an extra x86-64-v3 version picked at runtime, see include/cpu-dispatch.hpp
+ifeq ($(NOCPUDISPATCH),true)
+BASE_FLAGS += -DCARDINAL_NO_CPU_DISPATCH
+endif
+
 ifeq ($(SYSDEPS),true)
 BASE_FLAGS += -DCARDINAL_SYSDEPS
 BASE_FLAGS += $(shell $(PKG_CONFIG) --cflags jansson libarchive samplerate speexdsp)
@@ -0,0 +1,2 @@
+#include "h.hpp"
+void fa(C& c, const float* i, float* o){ c.processBlock(i,o); }
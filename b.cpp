@@ -0,0 +1,2 @@
+#include "h.hpp"
+void fb(C& c, const float* i, float* o){ c.processBlock(i,o); }
@@ -0,0 +1,30 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+// Runtime CPU dispatch for hot code paths.
+//
+// Regular builds target a baseline x86-64 CPU (up to SSE3) so the same binary runs everywhere.
+// Functions marked with CARDINAL_CPU_DISPATCH get an extra x86-64-v3 version (AVX2, FMA, BMI2 and friends) through
+// function multiversioning, the dynamic linker picks the best one for the running CPU once at load time.
+//
+// Clones cannot be inlined into their callers, so this is meant for big functions called once per block or frame,
+// everything inlined into them is then compiled for the clone target as well.
+//
+// Needs GCC 11 or later and ifunc support, so glibc based Linux only. Expands to nothing elsewhere, when building
+// with NOCPUDISPATCH=true, or when the whole build already targets x86-64-v3.
+
+#if defined(__linux__)
+# include <features.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GLIBC__) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11 \
+    && !defined(__AVX2__) && !defined(__EMSCRIPTEN__) && !defined(CARDINAL_NOSIMD) && !defined(CARDINAL_NO_CPU_DISPATCH)
+# define CARDINAL_CPU_DISPATCH __attribute__((target_clones("default", "arch=x86-64-v3")))
+#else
+# define CARDINAL_CPU_DISPATCH
+#endif
@@ -1,6 +1,6 @@
 /*
  * DISTRHO Cardinal Plugin
- * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -29,6 +29,12 @@
 
 #include <pffft.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <cpu-dispatch.hpp>
 #include <dsp/common.hpp>
 
 
@@ -54,10 +60,15 @@ inline void boxcarLowpassIR(float* out, int len, float cutoff = 0.5f) {
 }
 
 
-struct RealTimeConvolver {
+/** Uniformly partitioned FFT convolution of a kernel, in blocks of `blockSize`.
+Produces one output block for each input block, without latency.
+*/
+struct UniformConvolver {
 	// `kernelBlocks` number of contiguous FFT blocks of size `blockSize`
 	// indexed by [i * blockSize*2 + j]
+	// already scaled for the inverse FFT
 	float* kernelFfts = NULL;
+	// frequency-domain delay line of past input blocks, same layout
 	float* inputFfts = NULL;
 	float* outputTail = NULL;
 	float* tmpBlock = NULL;
@@ -67,7 +78,7 @@ struct RealTimeConvolver {
 	PFFFT_Setup* pffft;
 
 	/** `blockSize` is the size of each FFT block. It should be >=32 and a power of 2. */
-	RealTimeConvolver(size_t blockSize) {
+	UniformConvolver(size_t blockSize) {
 		this->blockSize = blockSize;
 		pffft = pffft_new_setup(blockSize * 2, PFFFT_REAL);
 		outputTail = (float*) pffft_aligned_malloc(sizeof(float) * blockSize);
@@ -76,7 +87,7 @@ struct RealTimeConvolver {
 		std::memset(tmpBlock, 0, blockSize * 2 * sizeof(float));
 	}
 
-	~RealTimeConvolver() {
+	~UniformConvolver() {
 		setKernel(NULL, 0);
 		pffft_aligned_free(outputTail);
 		pffft_aligned_free(tmpBlock);
@@ -95,6 +106,7 @@ struct RealTimeConvolver {
 		}
 		kernelBlocks = 0;
 		inputPos = 0;
+		std::memset(outputTail, 0, blockSize * sizeof(float));
 
 		if (kernel && length > 0) {
 			// Round up to the nearest factor of `blockSize`
@@ -105,57 +117,368 @@ struct RealTimeConvolver {
 			inputFfts = (float*) pffft_aligned_malloc(sizeof(float) * blockSize * 2 * kernelBlocks);
 			std::memset(inputFfts, 0, sizeof(float) * blockSize * 2 * kernelBlocks);
 
+			// Scale based on FFT here, instead of on every output block
+			const float scale = 1.f / (blockSize * 2);
+
 			for (size_t i = 0; i < kernelBlocks; i++) {
 				// Pad each block with zeros
 				std::memset(tmpBlock, 0, sizeof(float) * blockSize * 2);
-				size_t len = std::min((int) blockSize, (int)(length - i * blockSize));
-				std::memcpy(tmpBlock, &kernel[i * blockSize], sizeof(float)*len);
+				size_t len = std::min(blockSize, length - i * blockSize);
+				for (size_t j = 0; j < len; j++) {
+					tmpBlock[j] = kernel[i * blockSize + j] * scale;
+				}
 				// Compute fft
 				pffft_transform(pffft, tmpBlock, &kernelFfts[blockSize * 2 * i], NULL, PFFFT_FORWARD);
 			}
 		}
 	}
 
-	/** Applies reverb to input
-	input and output must be of size `blockSize`
+	/** Convolves a block of input.
+	input and output must be of size `blockSize`.
 	*/
 	void processBlock(const float* input, float* output) {
-		if (kernelBlocks == 0) {
-			std::memset(output, 0, sizeof(float) * blockSize);
+		beginBlock(input);
+		accumulateBlock(0, kernelBlocks);
+		endBlock(output);
+	}
+
+	/** Starts convolving a block of input, for spreading the work of processBlock() over several calls.
+	Must be followed by accumulateBlock() over all kernel blocks, then endBlock().
+	*/
+	void beginBlock(const float* input) {
+		if (kernelBlocks == 0)
 			return;
-		}
+
+		const size_t stride = blockSize * 2;
 
 		// Step input position
-		inputPos = (inputPos + 1) % kernelBlocks;
+		inputPos = inputPos + 1 == kernelBlocks ? 0 : inputPos + 1;
 		// Pad block with zeros
-		std::memset(tmpBlock, 0, sizeof(float) * blockSize * 2);
 		std::memcpy(tmpBlock, input, sizeof(float) * blockSize);
+		std::memset(tmpBlock + blockSize, 0, sizeof(float) * blockSize);
 		// Compute input fft
-		pffft_transform(pffft, tmpBlock, &inputFfts[blockSize * 2 * inputPos], NULL, PFFFT_FORWARD);
+		pffft_transform(pffft, tmpBlock, &inputFfts[stride * inputPos], NULL, PFFFT_FORWARD);
+
 		// Create output fft
-		std::memset(tmpBlock, 0, sizeof(float) * blockSize * 2);
-		// convolve input fft by kernel fft
-		// Note: This is the CPU bottleneck loop
-		for (size_t i = 0; i < kernelBlocks; i++) {
-			size_t pos = (inputPos - i + kernelBlocks) % kernelBlocks;
-			pffft_zconvolve_accumulate(pffft, &kernelFfts[blockSize * 2 * i], &inputFfts[blockSize * 2 * pos], tmpBlock, 1.f);
+		std::memset(tmpBlock, 0, sizeof(float) * stride);
+	}
+
+	/** Convolves the input fft by kernel blocks `begin` to `end`. */
+	CARDINAL_CPU_DISPATCH
+	void accumulateBlock(size_t begin, size_t end) {
+		const size_t stride = blockSize * 2;
+		const size_t split = std::min(end, inputPos + 1);
+
+		// newest input block goes with the first kernel block
+		// Note: This is the CPU bottleneck loop, split in two so the delay line index never needs wrapping
+		for (size_t i = begin; i < split; i++) {
+			pffft_zconvolve_accumulate(pffft, &kernelFfts[stride * i], &inputFfts[stride * (inputPos - i)], tmpBlock, 1.f);
+		}
+		for (size_t i = std::max(begin, inputPos + 1); i < end; i++) {
+			pffft_zconvolve_accumulate(pffft, &kernelFfts[stride * i], &inputFfts[stride * (inputPos + kernelBlocks - i)], tmpBlock, 1.f);
+		}
+	}
+
+	/** Finishes the block started by beginBlock(). output must be of size `blockSize`. */
+	void endBlock(float* output) {
+		if (kernelBlocks == 0) {
+			std::memset(output, 0, sizeof(float) * blockSize);
+			return;
 		}
+
 		// Compute output
 		pffft_transform(pffft, tmpBlock, tmpBlock, NULL, PFFFT_BACKWARD);
-		// Add block tail from last output block
+		// Add block tail from last output block, and set the new tail
 		for (size_t i = 0; i < blockSize; i++) {
-			tmpBlock[i] += outputTail[i];
+			output[i] = tmpBlock[i] + outputTail[i];
+			outputTail[i] = tmpBlock[i + blockSize];
 		}
-		// Copy output block to output
-		float scale = 1.f / (blockSize * 2);
-		for (size_t i = 0; i < blockSize; i++) {
-			// Scale based on FFT
-			output[i] = tmpBlock[i] * scale;
+	}
+};
+
+
+struct RealTimeConvolver;
+
+
+/** Worker threads shared by all threaded RealTimeConvolver instances, see src/override/fir.cpp.
+They run with real-time priority, start with the first added convolver and stop once the last one is removed.
+*/
+namespace convolverworkers {
+
+/** Adds a convolver to the workers, returns false if no worker thread could be started. */
+bool add(RealTimeConvolver* convolver);
+/** Removes a convolver, returning once no worker uses it anymore. */
+void remove(RealTimeConvolver* convolver);
+/** Keeps the workers from picking up new jobs of a convolver while its stages change. */
+void suspend(RealTimeConvolver* convolver);
+void resume(RealTimeConvolver* convolver);
+/** Wakes up a worker after queueing a tail stage frame, lock-free so it can be called from the audio thread. */
+void notify();
+
+} // namespace convolverworkers
+
+
+/** Non-uniformly partitioned convolution, for long kernels like reverb impulse responses.
+
+The start of the kernel (the head) is convolved in blocks of `blockSize` on the calling thread, so there is no latency.
+The rest is split into tail stages with partitions 4 times bigger than the previous stage, each covering the kernel from twice its partition size.
+A stage gathers a partition of input, and its output is only needed one partition later.
+
+The tail stages run on the shared worker threads, which gives each job a whole partition worth of time to complete, earliest deadline first.
+A job no worker has picked up by its deadline is run on the calling thread instead, so the output never depends on thread timing.
+Without worker threads, each job is spread evenly over the blocks of the following partition.
+*/
+struct RealTimeConvolver {
+	/** Smallest partition size of tail stages, which is also their deadline, in samples. */
+	static constexpr const size_t kMinTailBlockSize = 1024;
+	/** Partition size after which tail stages stop growing. */
+	static constexpr const size_t kMaxTailBlockSize = 16384;
+
+	enum SlotState {
+		kSlotFree,
+		kSlotQueued,
+		kSlotDone
+	};
+
+	struct Slot {
+		std::atomic<int> state {kSlotFree};
+		size_t frame = 0;
+		float* input = NULL;
+		float* output = NULL;
+	};
+
+	struct Stage {
+		// frames in flight: the one being read, the next one and the one being gathered, plus some slack
+		static constexpr const size_t kNumSlots = 4;
+
+		UniformConvolver convolver;
+		Slot slots[kNumSlots];
+		// calling thread side
+		float* accum = NULL;
+		size_t framePos = 0;
+		size_t frame = 0;
+		Slot* reading = NULL;
+		// claimed by whoever runs a job, a worker or the calling thread when the job is late
+		std::atomic<bool> busy {false};
+
+		Stage(size_t blockSize, const float* kernel, size_t length) : convolver(blockSize) {
+			convolver.setKernel(kernel, length);
+			accum = (float*) pffft_aligned_malloc(sizeof(float) * blockSize);
+			for (Slot& slot : slots) {
+				slot.input = (float*) pffft_aligned_malloc(sizeof(float) * blockSize);
+				slot.output = (float*) pffft_aligned_malloc(sizeof(float) * blockSize);
+			}
 		}
-		// Set tail
-		for (size_t i = 0; i < blockSize; i++) {
-			outputTail[i] = tmpBlock[i + blockSize];
+
+		~Stage() {
+			pffft_aligned_free(accum);
+			for (Slot& slot : slots) {
+				pffft_aligned_free(slot.input);
+				pffft_aligned_free(slot.output);
+			}
+		}
+
+		/** Output is due once the next frame has been gathered. */
+		size_t getDeadline(const Slot& slot) const {
+			return (slot.frame + 2) * convolver.blockSize;
+		}
+
+		Slot* getOldestQueuedSlot() {
+			Slot* oldest = NULL;
+			for (Slot& slot : slots) {
+				if (slot.state != kSlotQueued)
+					continue;
+				if (oldest == NULL || slot.frame < oldest->frame)
+					oldest = &slot;
+			}
+			return oldest;
+		}
+
+		void run(Slot& slot) {
+			convolver.processBlock(slot.input, slot.output);
+			slot.state = kSlotDone;
+		}
+
+		/** Runs part `step` of `numSteps` of a job, so that each part costs about the same. */
+		void runStep(Slot& slot, size_t step, size_t numSteps) {
+			const size_t kernelBlocks = convolver.kernelBlocks;
+			if (step == 0)
+				convolver.beginBlock(slot.input);
+			convolver.accumulateBlock(kernelBlocks * step / numSteps, kernelBlocks * (step + 1) / numSteps);
+			if (step + 1 == numSteps) {
+				convolver.endBlock(slot.output);
+				slot.state = kSlotDone;
+			}
+		}
+	};
+
+	UniformConvolver head;
+	std::vector<Stage*> stages;
+	// replaced while a worker was still running one of their jobs, freed once it is done
+	std::vector<Stage*> retiredStages;
+	size_t blockSize;
+	/** Number of tail stage frames no worker had finished in time. */
+	uint32_t lateFrames = 0;
+
+	bool threaded;
+	// worker side
+	std::atomic<bool> suspended {false};
+	std::atomic<int> busyStages {0};
+	// samples processed since the last kernel change, so workers can tell deadlines
+	std::atomic<size_t> time {0};
+
+	/** `blockSize` is the size of each input and output block, and of the head FFT blocks. It should be >=32 and a power of 2.
+	With `threaded` false, or if no worker thread can be started, the tail stages run on the calling thread.
+	*/
+	RealTimeConvolver(size_t blockSize, bool threaded = true) : head(blockSize) {
+		this->blockSize = blockSize;
+		this->threaded = threaded && convolverworkers::add(this);
+	}
+
+	~RealTimeConvolver() {
+		if (threaded) {
+			convolverworkers::remove(this);
+			threaded = false;
+		}
+		setKernel(NULL, 0);
+	}
+
+	/** Sets a new kernel, must not be called while processBlock() is running. */
+	void setKernel(const float* kernel, size_t length) {
+		if (threaded)
+			convolverworkers::suspend(this);
+
+		// Workers only touch stages they claimed, those are kept until the worker lets go
+		retiredStages.erase(std::remove_if(retiredStages.begin(), retiredStages.end(), [](Stage* stage) {
+			if (stage->busy)
+				return false;
+			delete stage;
+			return true;
+		}), retiredStages.end());
+
+		for (Stage* stage : stages) {
+			if (stage->busy)
+				retiredStages.push_back(stage);
+			else
+				delete stage;
+		}
+		stages.clear();
+		lateFrames = 0;
+		time = 0;
+
+		size_t tailBlockSize = std::max(blockSize * 4, (size_t) kMinTailBlockSize);
+		size_t offset = std::min(length, tailBlockSize * 2);
+		head.setKernel(kernel, offset);
+
+		while (kernel && offset < length) {
+			const size_t nextBlockSize = tailBlockSize * 4;
+			const bool last = nextBlockSize > std::max((size_t) kMaxTailBlockSize, tailBlockSize);
+			const size_t end = last ? length : std::min(length, nextBlockSize * 2);
+			stages.push_back(new Stage(tailBlockSize, &kernel[offset], end - offset));
+			if (last)
+				break;
+			offset = end;
+			tailBlockSize = nextBlockSize;
+		}
+
+		if (threaded)
+			convolverworkers::resume(this);
+	}
+
+	/** Applies reverb to input
+	input and output must be of size `blockSize`
+	*/
+	void processBlock(const float* input, float* output) {
+		head.processBlock(input, output);
+
+		for (Stage* stage : stages) {
+			processStage(*stage, input, output);
+		}
+
+		time += blockSize;
+	}
+
+	void processStage(Stage& stage, const float* input, float* output) {
+		const size_t partitionSize = stage.convolver.blockSize;
+
+		// Pick up the output of the frame before the previous one, which covers the next partition
+		if (stage.framePos == 0) {
+			if (stage.reading) {
+				stage.reading->state = kSlotFree;
+				stage.reading = NULL;
+			}
+			if (stage.frame >= 2)
+				stage.reading = acquireOutput(stage, stage.frame - 2);
+		}
+		if (stage.reading) {
+			const float* stageOutput = &stage.reading->output[stage.framePos];
+			for (size_t i = 0; i < blockSize; i++) {
+				output[i] += stageOutput[i];
+			}
+		}
+
+		// Without workers, the previous frame is convolved a bit on every block of this one
+		if (!threaded && stage.frame >= 1) {
+			Slot& slot = stage.slots[(stage.frame - 1) % Stage::kNumSlots];
+			stage.runStep(slot, stage.framePos / blockSize, partitionSize / blockSize);
+		}
+
+		// Gather input, and queue it once a whole partition is ready
+		std::memcpy(&stage.accum[stage.framePos], input, sizeof(float) * blockSize);
+		stage.framePos += blockSize;
+		if (stage.framePos != partitionSize)
+			return;
+
+		// Slots are read in order and freed 3 frames later, so this one is always free by now
+		Slot& slot = stage.slots[stage.frame % Stage::kNumSlots];
+		slot.frame = stage.frame;
+		std::memcpy(slot.input, stage.accum, sizeof(float) * partitionSize);
+		slot.state = kSlotQueued;
+		if (threaded)
+			convolverworkers::notify();
+		stage.framePos = 0;
+		stage.frame++;
+	}
+
+	Slot* acquireOutput(Stage& stage, size_t frame) {
+		Slot& slot = stage.slots[frame % Stage::kNumSlots];
+		if (slot.state != kSlotDone) {
+			lateFrames++;
+			// Not picked up by any worker yet, earlier frames are all done so run it right here
+			bool idle = false;
+			if (stage.busy.compare_exchange_strong(idle, true)) {
+				if (slot.state == kSlotQueued)
+					stage.run(slot);
+				stage.busy = false;
+			}
+			// Otherwise a worker is already running it, which only leaves the rest of that one job
+			while (slot.state != kSlotDone)
+				std::this_thread::yield();
+		}
+		return &slot;
+	}
+
+	/** Finds the queued tail stage frame closest to its deadline, if that is less than `remaining` samples away.
+	Called by the workers with their mutex held.
+	*/
+	Slot* getNextJob(Stage*& stage, size_t& remaining) {
+		Slot* next = NULL;
+		const size_t now = time;
+		for (Stage* s : stages) {
+			if (s->busy)
+				continue;
+			Slot* queued = s->getOldestQueuedSlot();
+			if (queued == NULL)
+				continue;
+			const size_t deadline = s->getDeadline(*queued);
+			const size_t left = deadline > now ? deadline - now : 0;
+			if (left < remaining) {
+				stage = s;
+				next = queued;
+				remaining = left;
+			}
 		}
+		return next;
 	}
 };
 
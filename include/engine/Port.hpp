@@ -161,6 +161,9 @@ struct Port {
 		}
 	}
 
+	/** Returns `T::size` voltages starting at `firstChannel`.
+	`T` is `simd::float_4`, or `simd::float_8` to handle 16 channels in 2 steps.
+	*/
 	template <typename T>
 	T getVoltageSimd(int firstChannel) const noexcept {
 		return T::load(&voltages[firstChannel]);
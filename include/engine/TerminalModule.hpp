@@ -23,8 +23,14 @@ namespace rack {
 namespace engine {
 
 struct TerminalModule : Module {
+    /** Called once at the start of each engine block, before any frame is processed.
+        @a args.frame is the first frame of the block, @a frames its size. */
+    virtual void processTerminalBlockStart(const ProcessArgs& args, int frames) {}
     virtual void processTerminalInput(const ProcessArgs& args) = 0;
     virtual void processTerminalOutput(const ProcessArgs& args) = 0;
+    /** Called once at the end of each engine block, after all of its frames were processed.
+        @a args.frame is the first frame of the block, @a frames its size. */
+    virtual void processTerminalBlockEnd(const ProcessArgs& args, int frames) {}
 };
 
 }
@@ -10,7 +10,12 @@
 #include "rack.hpp"
 #endif
 
+#include <atomic>
+
 namespace rack {
+namespace engine {
+struct Engine;
+}
 namespace midi {
 struct Message;
 }
@@ -65,11 +70,268 @@ struct IdleCallback {
 
 using CardinalDGL::IdleCallback;
 
+// --------------------------------------------------------------------------------------------------------------------
+// Pre-decoded MIDI events of the current block, shared by all MIDI consumers
+
+struct CardinalMidiEvent {
+    uint32_t frame;
+    uint32_t size;
+    /** Raw message bytes, valid until the end of the block. */
+    const uint8_t* data;
+    /** Status without channel for channel messages, full status byte for system messages. */
+    uint8_t status;
+    uint8_t channel;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+enum CardinalMidiEventType {
+    kCardinalMidiEventNoteOff,
+    kCardinalMidiEventNoteOn,
+    kCardinalMidiEventKeyPressure,
+    kCardinalMidiEventControlChange,
+    kCardinalMidiEventProgramChange,
+    kCardinalMidiEventChannelPressure,
+    kCardinalMidiEventPitchBend,
+    kCardinalMidiEventSystem,
+    kCardinalMidiEventTypeCount
+};
+
+/**
+   Iterates over a list of events in frame order, optionally merging a second list.
+   Copying a reader is cheap, each consumer keeps its own.
+ */
+struct CardinalMidiEventReader {
+    const CardinalMidiEvent* events = nullptr;
+    const uint16_t* indices = nullptr;
+    const uint16_t* extraIndices = nullptr;
+    uint32_t left = 0;
+    uint32_t extraLeft = 0;
+
+    /** Get the next event happening at or before @a frame, or null if there is none. */
+    const CardinalMidiEvent* next(const uint32_t frame) noexcept
+    {
+        if (left != 0 && (extraLeft == 0 || *indices < *extraIndices))
+        {
+            const CardinalMidiEvent* const event = &events[*indices];
+            if (event->frame > frame)
+                return nullptr;
+            ++indices;
+            --left;
+            return event;
+        }
+
+        if (extraLeft != 0)
+        {
+            const CardinalMidiEvent* const event = &events[*extraIndices];
+            if (event->frame > frame)
+                return nullptr;
+            ++extraIndices;
+            --extraLeft;
+            return event;
+        }
+
+        return nullptr;
+    }
+};
+
+struct CardinalMidiEventBus {
+    static constexpr const uint32_t kMaxEvents = 2048;
+
+    /** Decoded events, sorted by frame. */
+    CardinalMidiEvent events[kMaxEvents];
+    uint16_t orderIndices[kMaxEvents];
+    /** Event indices grouped by channel, system events excluded. */
+    uint16_t channelIndices[kMaxEvents];
+    uint16_t channelOffsets[16 + 1] = {};
+    /** Event indices grouped by CardinalMidiEventType. */
+    uint16_t typeIndices[kMaxEvents];
+    uint16_t typeOffsets[kCardinalMidiEventTypeCount + 1] = {};
+    uint32_t eventCount = 0;
+    /** Events that could not be decoded in the current block, either invalid or over kMaxEvents. */
+    uint32_t droppedCount = 0;
+
+    /** Decode a block of host events, called once per block before running the engine. */
+    void decode(const CardinalDISTRHO::MidiEvent* midiEvents, uint32_t midiEventCount) noexcept;
+
+    /** All events. */
+    CardinalMidiEventReader readAll() const noexcept
+    {
+        CardinalMidiEventReader reader;
+        reader.events = events;
+        reader.indices = orderIndices;
+        reader.left = eventCount;
+        return reader;
+    }
+
+    /** Events of a single channel (0-15) with system events merged in, as seen by a channel-filtered input. */
+    CardinalMidiEventReader readChannel(const uint8_t channel) const noexcept
+    {
+        CardinalMidiEventReader reader;
+        reader.events = events;
+        reader.indices = channelIndices + channelOffsets[channel];
+        reader.left = channelOffsets[channel + 1] - channelOffsets[channel];
+        reader.extraIndices = typeIndices + typeOffsets[kCardinalMidiEventSystem];
+        reader.extraLeft = typeOffsets[kCardinalMidiEventSystem + 1] - typeOffsets[kCardinalMidiEventSystem];
+        return reader;
+    }
+
+    /** Events of a single type, on any channel. */
+    CardinalMidiEventReader readType(const CardinalMidiEventType type) const noexcept
+    {
+        CardinalMidiEventReader reader;
+        reader.events = events;
+        reader.indices = typeIndices + typeOffsets[type];
+        reader.left = typeOffsets[type + 1] - typeOffsets[type];
+        return reader;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// MIDI output of the current block, collected from all modules and sent to the host in frame order
+
+struct CardinalMidiOutputQueue {
+    static constexpr const uint32_t kMaxEvents = 2048;
+
+    CardinalDISTRHO::MidiEvent events[kMaxEvents];
+    uint16_t order[kMaxEvents];
+    uint16_t scratch[kMaxEvents];
+    /**
+       Per event opt-in, drop a CC, pitch-bend or aftertouch value when the next event on the same frame replaces it.
+       Both events must be coalescable and directly adjacent, so ordering against other messages is kept as-is.
+       Data entry and (N)RPN controllers are never merged.
+     */
+    bool coalescable[kMaxEvents];
+    uint32_t eventCount = 0;
+    /** Events dropped since start, either because the queue or the host buffer was full. */
+    std::atomic<uint32_t> droppedCount { 0 };
+    /** Events removed by coalescing since start. */
+    std::atomic<uint32_t> coalescedCount { 0 };
+
+    void push(const CardinalDISTRHO::MidiEvent& event, const bool coalesce) noexcept
+    {
+        if (eventCount == kMaxEvents)
+        {
+            ++droppedCount;
+            return;
+        }
+
+        order[eventCount] = eventCount;
+        coalescable[eventCount] = coalesce;
+        events[eventCount++] = event;
+    }
+
+    /** Sort, coalesce opted-in events and send all of them to the host, called once per block after running the engine. */
+    void flush(CardinalDISTRHO::Plugin* plugin) noexcept;
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Hook at the end of each engine block
+
+/**
+   Set with `Engine_setBlockCallback`.
+   Called by the engine at the end of each block from the audio thread, while the engine is still locked.
+   Modules cannot be added or removed during the call, so module pointers known to be current can be used safely.
+   @a moduleListVersion changes every time a module is added or removed.
+ */
+struct CardinalEngineBlockCallback {
+    virtual ~CardinalEngineBlockCallback() {}
+    virtual void engineBlockProcessed(rack::engine::Engine* engine, uint32_t frames, uint32_t moduleListVersion) = 0;
+};
+
 // --------------------------------------------------------------------------------------------------------------------
 // Cardinal specific context
 
 static constexpr const uint32_t kModuleParameterCount = 24;
 
+// --------------------------------------------------------------------------------------------------------------------
+// Per-block host parameter automation ramps
+
+/**
+   Linear ramps from the parameter values of the previous block to the current ones.
+   DPF delivers parameter changes before each run, so a ramp spans exactly one engine block.
+   Unchanged parameters are flagged in a bitmask, letting consumers skip them without comparing values.
+   The first update takes the current values as-is, and finish() clears the mask once the block has run.
+ */
+struct CardinalParameterRamps {
+    static constexpr const uint32_t kMaskWords = (kModuleParameterCount + 31) / 32;
+
+    /** Value at the start of the block. */
+    float start[kModuleParameterCount];
+    /** Value at the end of the block. */
+    float end[kModuleParameterCount];
+    /** Bitmask of parameters changing within the block. */
+    uint32_t changed[kMaskWords];
+    uint32_t frames;
+    float invFrames;
+    bool seeded;
+
+    CardinalParameterRamps() noexcept
+        : start(),
+          end(),
+          changed(),
+          frames(1),
+          invFrames(1.f),
+          seeded(false) {}
+
+    void update(const float* const parameters, const uint32_t newFrames) noexcept
+    {
+        frames = newFrames != 0 ? newFrames : 1;
+        invFrames = 1.f / frames;
+
+        for (uint32_t w = 0; w < kMaskWords; ++w)
+            changed[w] = 0;
+
+        // nothing to ramp from yet, start from the restored values instead of 0
+        if (! seeded)
+        {
+            seeded = true;
+            for (uint32_t i = 0; i < kModuleParameterCount; ++i)
+                end[i] = parameters[i];
+        }
+
+        for (uint32_t i = 0; i < kModuleParameterCount; ++i)
+        {
+            start[i] = end[i];
+
+            if (end[i] != parameters[i])
+            {
+                end[i] = parameters[i];
+                changed[i / 32] |= 1u << (i % 32);
+            }
+        }
+    }
+
+    /** Called after running the engine block, all ramps have reached their end value. */
+    void finish() noexcept
+    {
+        for (uint32_t w = 0; w < kMaskWords; ++w)
+            changed[w] = 0;
+
+        for (uint32_t i = 0; i < kModuleParameterCount; ++i)
+            start[i] = end[i];
+    }
+
+    bool isChanging(const uint32_t index) const noexcept
+    {
+        return changed[index / 32] & (1u << (index % 32));
+    }
+
+    /** Changed bits of the 4 parameters starting at @a first, which must be a multiple of 4. */
+    uint32_t getChangedMask4(const uint32_t first) const noexcept
+    {
+        return (changed[first / 32] >> (first % 32)) & 0xf;
+    }
+
+    bool isAnyChanging() const noexcept
+    {
+        for (uint32_t w = 0; w < kMaskWords; ++w)
+            if (changed[w] != 0)
+                return true;
+        return false;
+    }
+};
+
 enum CardinalVariant {
     kCardinalVariantMain,
     kCardinalVariantMini,
@@ -82,6 +344,7 @@ struct CardinalPluginContext : rack::Context {
     uint32_t bufferSize, processCounter;
     double sampleRate;
     float parameters[kModuleParameterCount];
+    CardinalParameterRamps parameterRamps;
     CardinalVariant variant;
     bool bypassed, playing, reset, bbtValid;
     int32_t bar, beat, beatsPerBar, beatType;
@@ -93,11 +356,13 @@ struct CardinalPluginContext : rack::Context {
     float** dataOuts;
     const CardinalDISTRHO::MidiEvent* midiEvents;
     uint32_t midiEventCount;
+    CardinalMidiEventBus midiBus;
+    CardinalMidiOutputQueue midiOutQueue;
     CardinalDISTRHO::Plugin* const plugin;
     CardinalDGL::NanoTopLevelWidget* tlw;
     CardinalDISTRHO::UI* ui;
     CardinalPluginContext(CardinalDISTRHO::Plugin* const p);
-    void writeMidiMessage(const rack::midi::Message& message, uint8_t channel);
+    void writeMidiMessage(const rack::midi::Message& message, uint8_t channel, bool coalesce = false);
     bool addIdleCallback(IdleCallback* cb) const;
     void removeIdleCallback(IdleCallback* cb) const;
 };
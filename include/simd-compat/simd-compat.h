@@ -19,14 +19,41 @@
 # define SIMDE_X86_SSE3_NO_NATIVE
 #endif
 
+// newer instruction sets are native only when the build targets them, like with X86_64_V3=true,
+// regular builds get these through runtime dispatch instead, see cpu-dispatch.hpp
+#if defined(SIMDE_X86_SSE3_NATIVE) && defined(__SSSE3__)
+# define SIMDE_X86_SSSE3_NATIVE
+#else
+# define SIMDE_X86_SSSE3_NO_NATIVE
+#endif
+#if defined(SIMDE_X86_SSSE3_NATIVE) && defined(__SSE4_1__)
+# define SIMDE_X86_SSE4_1_NATIVE
+#else
+# define SIMDE_X86_SSE4_1_NO_NATIVE
+#endif
+#if defined(SIMDE_X86_SSE4_1_NATIVE) && defined(__SSE4_2__)
+# define SIMDE_X86_SSE4_2_NATIVE
+#else
+# define SIMDE_X86_SSE4_2_NO_NATIVE
+#endif
+#if defined(SIMDE_X86_SSE4_2_NATIVE) && defined(__AVX__)
+# define SIMDE_X86_AVX_NATIVE
+#else
+# define SIMDE_X86_AVX_NO_NATIVE
+#endif
+#if defined(SIMDE_X86_AVX_NATIVE) && defined(__AVX2__)
+# define SIMDE_X86_AVX2_NATIVE
+#else
+# define SIMDE_X86_AVX2_NO_NATIVE
+#endif
+#if defined(SIMDE_X86_AVX_NATIVE) && defined(__FMA__)
+# define SIMDE_X86_FMA_NATIVE
+#else
+# define SIMDE_X86_FMA_NO_NATIVE
+#endif
+
 // everything else is emulated
-#define SIMDE_X86_SSSE3_NO_NATIVE
-#define SIMDE_X86_SSE4_1_NO_NATIVE
-#define SIMDE_X86_SSE4_2_NO_NATIVE
 #define SIMDE_X86_XOP_NO_NATIVE
-#define SIMDE_X86_AVX_NO_NATIVE
-#define SIMDE_X86_AVX2_NO_NATIVE
-#define SIMDE_X86_FMA_NO_NATIVE
 #define SIMDE_X86_AVX512F_NO_NATIVE
 #define SIMDE_X86_AVX512BF16_NO_NATIVE
 #define SIMDE_X86_AVX512BW_NO_NATIVE
@@ -1,6 +1,6 @@
 /*
  * DISTRHO Cardinal Plugin
- * Copyright (C) 2021-2023 Filipe Coelho <falktx@falktx.com>
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -29,6 +29,9 @@
 
 #include <cstring>
 #include <pmmintrin.h>
+#ifdef SIMDE_X86_AVX2_NATIVE
+#include <immintrin.h>
+#endif
 
 /** NOTE alignas is required in some systems in order to allow SSE usage. */
 #define SIMD_ALIGN alignas(16)
@@ -364,11 +367,428 @@ inline Vector<int32_t, 4> operator>>(const Vector<int32_t, 4>& a, const int& b)
 }
 
 
+/* 8-wide vectors, for processing 16 polyphonic channels in 2 steps instead of 4.
+
+These wrap `__m256` and `__m256i` when the build targets AVX2, like with X86_64_V3=true.
+Otherwise they are emulated as a pair of 4-wide vectors, so code written for them works everywhere and costs about the same as using 4-wide vectors twice.
+*/
+#ifdef SIMDE_X86_AVX2_NATIVE
+#define SIMD_VECTOR_8_NATIVE
+/** NOTE 32 byte alignment is required for AVX loads and stores of whole vectors. */
+#define SIMD_ALIGN_8 alignas(32)
+#else
+#define SIMD_ALIGN_8 SIMD_ALIGN
+#endif
+
+
+template <>
+struct Vector<float, 8> {
+	using type = float;
+	constexpr static int size = 8;
+
+	union SIMD_ALIGN_8 {
+#ifdef SIMD_VECTOR_8_NATIVE
+		__m256 v;
+#else
+		Vector<float, 4> v[2];
+#endif
+		/** Accessing this array of scalars is slow and defeats the purpose of vectorizing.
+		*/
+		float s[8];
+	};
+
+	Vector() = default;
+#ifdef SIMD_VECTOR_8_NATIVE
+	Vector(__m256 v) : v(v) {}
+	Vector(float x) {
+		v = _mm256_set1_ps(x);
+	}
+	Vector(float x1, float x2, float x3, float x4, float x5, float x6, float x7, float x8) {
+		v = _mm256_setr_ps(x1, x2, x3, x4, x5, x6, x7, x8);
+	}
+	/** Constructs a vector from its lower (elements 0 to 3) and upper (elements 4 to 7) halves. */
+	Vector(Vector<float, 4> low, Vector<float, 4> high) {
+		v = _mm256_insertf128_ps(_mm256_castps128_ps256(low.v), high.v, 1);
+	}
+	static Vector zero() {
+		return Vector(_mm256_setzero_ps());
+	}
+	static Vector mask() {
+		return Vector(_mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+	}
+	static Vector load(const float* x) {
+		return Vector(_mm256_loadu_ps(x));
+	}
+	void store(float* x) {
+		_mm256_storeu_ps(x, v);
+	}
+	Vector<float, 4> low() const {
+		return Vector<float, 4>(_mm256_castps256_ps128(v));
+	}
+	Vector<float, 4> high() const {
+		return Vector<float, 4>(_mm256_extractf128_ps(v, 1));
+	}
+#else
+	Vector(float x) {
+		v[0] = v[1] = Vector<float, 4>(x);
+	}
+	Vector(float x1, float x2, float x3, float x4, float x5, float x6, float x7, float x8) {
+		v[0] = Vector<float, 4>(x1, x2, x3, x4);
+		v[1] = Vector<float, 4>(x5, x6, x7, x8);
+	}
+	Vector(Vector<float, 4> low, Vector<float, 4> high) {
+		v[0] = low;
+		v[1] = high;
+	}
+	static Vector zero() {
+		return Vector(Vector<float, 4>::zero(), Vector<float, 4>::zero());
+	}
+	static Vector mask() {
+		return Vector(Vector<float, 4>::mask(), Vector<float, 4>::mask());
+	}
+	static Vector load(const float* x) {
+		return Vector(Vector<float, 4>::load(x), Vector<float, 4>::load(x + 4));
+	}
+	void store(float* x) {
+		v[0].store(x);
+		v[1].store(x + 4);
+	}
+	Vector<float, 4> low() const {
+		return v[0];
+	}
+	Vector<float, 4> high() const {
+		return v[1];
+	}
+#endif
+	float& operator[](int i) {
+		return s[i];
+	}
+	const float& operator[](int i) const {
+		return s[i];
+	}
+	Vector(Vector<int32_t, 8> a);
+	static Vector cast(Vector<int32_t, 8> a);
+};
+
+
+template <>
+struct Vector<int32_t, 8> {
+	using type = int32_t;
+	constexpr static int size = 8;
+
+	union SIMD_ALIGN_8 {
+#ifdef SIMD_VECTOR_8_NATIVE
+		__m256i v;
+#else
+		Vector<int32_t, 4> v[2];
+#endif
+		int32_t s[8];
+	};
+
+	Vector() = default;
+#ifdef SIMD_VECTOR_8_NATIVE
+	Vector(__m256i v) : v(v) {}
+	Vector(int32_t x) {
+		v = _mm256_set1_epi32(x);
+	}
+	Vector(int32_t x1, int32_t x2, int32_t x3, int32_t x4, int32_t x5, int32_t x6, int32_t x7, int32_t x8) {
+		v = _mm256_setr_epi32(x1, x2, x3, x4, x5, x6, x7, x8);
+	}
+	Vector(Vector<int32_t, 4> low, Vector<int32_t, 4> high) {
+		v = _mm256_inserti128_si256(_mm256_castsi128_si256(low.v), high.v, 1);
+	}
+	static Vector zero() {
+		return Vector(_mm256_setzero_si256());
+	}
+	static Vector mask() {
+		return Vector(_mm256_set1_epi32(-1));
+	}
+	static Vector load(const int32_t* x) {
+		return Vector(_mm256_loadu_si256((const __m256i*) x));
+	}
+	void store(int32_t* x) {
+		_mm256_storeu_si256((__m256i*) x, v);
+	}
+	Vector<int32_t, 4> low() const {
+		return Vector<int32_t, 4>(_mm256_castsi256_si128(v));
+	}
+	Vector<int32_t, 4> high() const {
+		return Vector<int32_t, 4>(_mm256_extracti128_si256(v, 1));
+	}
+#else
+	Vector(int32_t x) {
+		v[0] = v[1] = Vector<int32_t, 4>(x);
+	}
+	Vector(int32_t x1, int32_t x2, int32_t x3, int32_t x4, int32_t x5, int32_t x6, int32_t x7, int32_t x8) {
+		v[0] = Vector<int32_t, 4>(x1, x2, x3, x4);
+		v[1] = Vector<int32_t, 4>(x5, x6, x7, x8);
+	}
+	Vector(Vector<int32_t, 4> low, Vector<int32_t, 4> high) {
+		v[0] = low;
+		v[1] = high;
+	}
+	static Vector zero() {
+		return Vector(Vector<int32_t, 4>::zero(), Vector<int32_t, 4>::zero());
+	}
+	static Vector mask() {
+		return Vector(Vector<int32_t, 4>::mask(), Vector<int32_t, 4>::mask());
+	}
+	static Vector load(const int32_t* x) {
+		return Vector(Vector<int32_t, 4>::load(x), Vector<int32_t, 4>::load(x + 4));
+	}
+	void store(int32_t* x) {
+		v[0].store(x);
+		v[1].store(x + 4);
+	}
+	Vector<int32_t, 4> low() const {
+		return v[0];
+	}
+	Vector<int32_t, 4> high() const {
+		return v[1];
+	}
+#endif
+	int32_t& operator[](int i) {
+		return s[i];
+	}
+	const int32_t& operator[](int i) const {
+		return s[i];
+	}
+	Vector(Vector<float, 8> a);
+	static Vector cast(Vector<float, 8> a);
+};
+
+
+// Conversions and casts, operator overloads
+
+
+#ifdef SIMD_VECTOR_8_NATIVE
+inline Vector<float, 8>::Vector(Vector<int32_t, 8> a) {
+	v = _mm256_cvtepi32_ps(a.v);
+}
+
+inline Vector<int32_t, 8>::Vector(Vector<float, 8> a) {
+	v = _mm256_cvttps_epi32(a.v);
+}
+
+inline Vector<float, 8> Vector<float, 8>::cast(Vector<int32_t, 8> a) {
+	return Vector(_mm256_castsi256_ps(a.v));
+}
+
+inline Vector<int32_t, 8> Vector<int32_t, 8>::cast(Vector<float, 8> a) {
+	return Vector(_mm256_castps_si256(a.v));
+}
+
+/** `a @ b` with an AVX comparison predicate */
+#define DECLARE_VECTOR_OPERATOR_COMPARE(operator, predicate) \
+	inline Vector<float, 8> operator(const Vector<float, 8>& a, const Vector<float, 8>& b) { \
+		return Vector<float, 8>(_mm256_cmp_ps(a.v, b.v, predicate)); \
+	}
+
+DECLARE_VECTOR_OPERATOR_INFIX(float, 8, operator+, _mm256_add_ps)
+DECLARE_VECTOR_OPERATOR_INFIX(int32_t, 8, operator+, _mm256_add_epi32)
+
+DECLARE_VECTOR_OPERATOR_INFIX(float, 8, operator-, _mm256_sub_ps)
+DECLARE_VECTOR_OPERATOR_INFIX(int32_t, 8, operator-, _mm256_sub_epi32)
+
+DECLARE_VECTOR_OPERATOR_INFIX(float, 8, operator*, _mm256_mul_ps)
+DECLARE_VECTOR_OPERATOR_INFIX(float, 8, operator/, _mm256_div_ps)
+
+DECLARE_VECTOR_OPERATOR_INFIX(float, 8, operator^, _mm256_xor_ps)
+DECLARE_VECTOR_OPERATOR_INFIX(int32_t, 8, operator^, _mm256_xor_si256)
+
+DECLARE_VECTOR_OPERATOR_INFIX(float, 8, operator&, _mm256_and_ps)
+DECLARE_VECTOR_OPERATOR_INFIX(int32_t, 8, operator&, _mm256_and_si256)
+
+DECLARE_VECTOR_OPERATOR_INFIX(float, 8, operator|, _mm256_or_ps)
+DECLARE_VECTOR_OPERATOR_INFIX(int32_t, 8, operator|, _mm256_or_si256)
+
+DECLARE_VECTOR_OPERATOR_COMPARE(operator==, _CMP_EQ_OQ)
+DECLARE_VECTOR_OPERATOR_COMPARE(operator>=, _CMP_GE_OQ)
+DECLARE_VECTOR_OPERATOR_COMPARE(operator>, _CMP_GT_OQ)
+DECLARE_VECTOR_OPERATOR_COMPARE(operator<=, _CMP_LE_OQ)
+DECLARE_VECTOR_OPERATOR_COMPARE(operator<, _CMP_LT_OQ)
+DECLARE_VECTOR_OPERATOR_COMPARE(operator!=, _CMP_NEQ_UQ)
+
+DECLARE_VECTOR_OPERATOR_INFIX(int32_t, 8, operator==, _mm256_cmpeq_epi32)
+DECLARE_VECTOR_OPERATOR_INFIX(int32_t, 8, operator>, _mm256_cmpgt_epi32)
+
+/** `a << b` */
+inline Vector<int32_t, 8> operator<<(const Vector<int32_t, 8>& a, const int& b) {
+	return Vector<int32_t, 8>(_mm256_sll_epi32(a.v, _mm_cvtsi32_si128(b)));
+}
+
+/** `a >> b` */
+inline Vector<int32_t, 8> operator>>(const Vector<int32_t, 8>& a, const int& b) {
+	return Vector<int32_t, 8>(_mm256_srl_epi32(a.v, _mm_cvtsi32_si128(b)));
+}
+#else
+inline Vector<float, 8>::Vector(Vector<int32_t, 8> a) {
+	v[0] = Vector<float, 4>(a.v[0]);
+	v[1] = Vector<float, 4>(a.v[1]);
+}
+
+inline Vector<int32_t, 8>::Vector(Vector<float, 8> a) {
+	v[0] = Vector<int32_t, 4>(a.v[0]);
+	v[1] = Vector<int32_t, 4>(a.v[1]);
+}
+
+inline Vector<float, 8> Vector<float, 8>::cast(Vector<int32_t, 8> a) {
+	return Vector(Vector<float, 4>::cast(a.v[0]), Vector<float, 4>::cast(a.v[1]));
+}
+
+inline Vector<int32_t, 8> Vector<int32_t, 8>::cast(Vector<float, 8> a) {
+	return Vector(Vector<int32_t, 4>::cast(a.v[0]), Vector<int32_t, 4>::cast(a.v[1]));
+}
+
+/** `a @ b`, applied to each half */
+#define DECLARE_VECTOR_OPERATOR_INFIX_HALVES(t, operator) \
+	inline Vector<t, 8> operator(const Vector<t, 8>& a, const Vector<t, 8>& b) { \
+		return Vector<t, 8>(operator(a.v[0], b.v[0]), operator(a.v[1], b.v[1])); \
+	}
+
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator+)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(int32_t, operator+)
+
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator-)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(int32_t, operator-)
+
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator*)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator/)
+
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator^)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(int32_t, operator^)
+
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator&)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(int32_t, operator&)
+
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator|)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(int32_t, operator|)
+
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator==)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator>=)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator>)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator<=)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator<)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(float, operator!=)
+
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(int32_t, operator==)
+DECLARE_VECTOR_OPERATOR_INFIX_HALVES(int32_t, operator>)
+
+/** `a << b` */
+inline Vector<int32_t, 8> operator<<(const Vector<int32_t, 8>& a, const int& b) {
+	return Vector<int32_t, 8>(a.v[0] << b, a.v[1] << b);
+}
+
+/** `a >> b` */
+inline Vector<int32_t, 8> operator>>(const Vector<int32_t, 8>& a, const int& b) {
+	return Vector<int32_t, 8>(a.v[0] >> b, a.v[1] >> b);
+}
+#endif
+
+// the remaining integer comparisons only rely on `==` and `>`, which SSE and AVX2 both have
+inline Vector<int32_t, 8> operator>=(const Vector<int32_t, 8>& a, const Vector<int32_t, 8>& b) {
+	return (b > a) ^ Vector<int32_t, 8>::mask();
+}
+inline Vector<int32_t, 8> operator<(const Vector<int32_t, 8>& a, const Vector<int32_t, 8>& b) {
+	return b > a;
+}
+inline Vector<int32_t, 8> operator<=(const Vector<int32_t, 8>& a, const Vector<int32_t, 8>& b) {
+	return (a > b) ^ Vector<int32_t, 8>::mask();
+}
+inline Vector<int32_t, 8> operator!=(const Vector<int32_t, 8>& a, const Vector<int32_t, 8>& b) {
+	return (a == b) ^ Vector<int32_t, 8>::mask();
+}
+
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator+=, operator+)
+DECLARE_VECTOR_OPERATOR_INCREMENT(int32_t, 8, operator+=, operator+)
+
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator-=, operator-)
+DECLARE_VECTOR_OPERATOR_INCREMENT(int32_t, 8, operator-=, operator-)
+
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator*=, operator*)
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator/=, operator/)
+
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator^=, operator^)
+DECLARE_VECTOR_OPERATOR_INCREMENT(int32_t, 8, operator^=, operator^)
+
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator&=, operator&)
+DECLARE_VECTOR_OPERATOR_INCREMENT(int32_t, 8, operator&=, operator&)
+
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator|=, operator|)
+DECLARE_VECTOR_OPERATOR_INCREMENT(int32_t, 8, operator|=, operator|)
+
+/** `+a` */
+inline Vector<float, 8> operator+(const Vector<float, 8>& a) {
+	return a;
+}
+inline Vector<int32_t, 8> operator+(const Vector<int32_t, 8>& a) {
+	return a;
+}
+
+/** `-a` */
+inline Vector<float, 8> operator-(const Vector<float, 8>& a) {
+	return 0.f - a;
+}
+inline Vector<int32_t, 8> operator-(const Vector<int32_t, 8>& a) {
+	return 0 - a;
+}
+
+/** `++a` */
+inline Vector<float, 8>& operator++(Vector<float, 8>& a) {
+	return a += 1.f;
+}
+inline Vector<int32_t, 8>& operator++(Vector<int32_t, 8>& a) {
+	return a += 1;
+}
+
+/** `--a` */
+inline Vector<float, 8>& operator--(Vector<float, 8>& a) {
+	return a -= 1.f;
+}
+inline Vector<int32_t, 8>& operator--(Vector<int32_t, 8>& a) {
+	return a -= 1;
+}
+
+/** `a++` */
+inline Vector<float, 8> operator++(Vector<float, 8>& a, int) {
+	Vector<float, 8> b = a;
+	++a;
+	return b;
+}
+inline Vector<int32_t, 8> operator++(Vector<int32_t, 8>& a, int) {
+	Vector<int32_t, 8> b = a;
+	++a;
+	return b;
+}
+
+/** `a--` */
+inline Vector<float, 8> operator--(Vector<float, 8>& a, int) {
+	Vector<float, 8> b = a;
+	--a;
+	return b;
+}
+inline Vector<int32_t, 8> operator--(Vector<int32_t, 8>& a, int) {
+	Vector<int32_t, 8> b = a;
+	--a;
+	return b;
+}
+
+/** `~a` */
+inline Vector<float, 8> operator~(const Vector<float, 8>& a) {
+	return a ^ Vector<float, 8>::mask();
+}
+inline Vector<int32_t, 8> operator~(const Vector<int32_t, 8>& a) {
+	return a ^ Vector<int32_t, 8>::mask();
+}
+
+
 // Typedefs
 
 
 using float_4 = Vector<float, 4>;
 using int32_4 = Vector<int32_t, 4>;
+using float_8 = Vector<float, 8>;
+using int32_8 = Vector<int32_t, 8>;
 
 
 } // namespace simd
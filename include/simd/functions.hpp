@@ -8,5 +8,79 @@
 
 #include "simd/common.hpp"
 #include_next "simd/functions.hpp"
+
+namespace rack {
+namespace simd {
+
+// -----------------------------------------------------------------------------------------------------------
+// 8-wide versions of the functions above, see `float_8` in Vector.hpp.
+// Functions without a direct AVX instruction run their 4-wide version on each half.
+
+#ifdef SIMD_VECTOR_8_NATIVE
+inline float_8 fmax(float_8 x, float_8 b) { return float_8(_mm256_max_ps(x.v, b.v)); }
+inline float_8 fmin(float_8 x, float_8 b) { return float_8(_mm256_min_ps(x.v, b.v)); }
+inline float_8 sqrt(float_8 x) { return float_8(_mm256_sqrt_ps(x.v)); }
+inline float_8 rsqrt(float_8 x) { return float_8(_mm256_rsqrt_ps(x.v)); }
+inline float_8 rcp(float_8 x) { return float_8(_mm256_rcp_ps(x.v)); }
+inline float_8 trunc(float_8 a) { return float_8(_mm256_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)); }
+inline float_8 floor(float_8 a) { return float_8(_mm256_round_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)); }
+inline float_8 ceil(float_8 a) { return float_8(_mm256_round_ps(a.v, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC)); }
+inline float_8 fabs(float_8 a) { return float_8::cast(int32_8(0x7fffffff)) & a; }
+inline int movemask(float_8 a) { return _mm256_movemask_ps(a.v); }
+inline int movemask(int32_8 a) { return _mm256_movemask_ps(_mm256_castsi256_ps(a.v)); }
+
+/** Same method as the 4-wide version, halfway cases are rounded towards zero. */
+inline float_8 round(float_8 a) {
+    const float_8 t = trunc(a);
+    return t + trunc((a - t) * 1.99999988f);
+}
+#else
+inline float_8 fmax(float_8 x, float_8 b) { return float_8(fmax(x.v[0], b.v[0]), fmax(x.v[1], b.v[1])); }
+inline float_8 fmin(float_8 x, float_8 b) { return float_8(fmin(x.v[0], b.v[0]), fmin(x.v[1], b.v[1])); }
+inline float_8 sqrt(float_8 x) { return float_8(sqrt(x.v[0]), sqrt(x.v[1])); }
+inline float_8 rsqrt(float_8 x) { return float_8(rsqrt(x.v[0]), rsqrt(x.v[1])); }
+inline float_8 rcp(float_8 x) { return float_8(rcp(x.v[0]), rcp(x.v[1])); }
+inline float_8 trunc(float_8 a) { return float_8(trunc(a.v[0]), trunc(a.v[1])); }
+inline float_8 floor(float_8 a) { return float_8(floor(a.v[0]), floor(a.v[1])); }
+inline float_8 ceil(float_8 a) { return float_8(ceil(a.v[0]), ceil(a.v[1])); }
+inline float_8 round(float_8 a) { return float_8(round(a.v[0]), round(a.v[1])); }
+inline float_8 fabs(float_8 a) { return float_8(fabs(a.v[0]), fabs(a.v[1])); }
+inline int movemask(float_8 a) { return movemask(a.v[0]) | movemask(a.v[1]) << 4; }
+inline int movemask(int32_8 a) { return movemask(a.v[0]) | movemask(a.v[1]) << 4; }
+#endif
+
+inline float_8 log(float_8 x) { return float_8(log(x.low()), log(x.high())); }
+inline float_8 exp(float_8 x) { return float_8(exp(x.low()), exp(x.high())); }
+inline float_8 sin(float_8 x) { return float_8(sin(x.low()), sin(x.high())); }
+inline float_8 cos(float_8 x) { return float_8(cos(x.low()), cos(x.high())); }
+
+inline float_8 ifelse(float_8 mask, float_8 a, float_8 b) { return (a & mask) | (b & ~mask); }
+inline int32_8 ifelse(int32_8 mask, int32_8 a, int32_8 b) { return (a & mask) | (b & ~mask); }
+
+inline float_8 fmod(float_8 a, float_8 b) { return a - floor(a / b) * b; }
+inline float_8 pow(float_8 a, float_8 b) { return exp(b * log(a)); }
+inline float_8 pow(float a, float_8 b) { return exp(b * std::log(a)); }
+
+inline float_8 clamp(float_8 x, float_8 a = 0.f, float_8 b = 1.f) { return fmin(fmax(x, a), b); }
+
+inline float_8 rescale(float_8 x, float_8 xMin, float_8 xMax, float_8 yMin, float_8 yMax)
+{
+    return yMin + (x - xMin) / (xMax - xMin) * (yMax - yMin);
+}
+
+inline float_8 crossfade(float_8 a, float_8 b, float_8 p) { return a + (b - a) * p; }
+
+inline float_8 sgn(float_8 x)
+{
+    const float_8 signbit = x & -0.f;
+    const float_8 nonzero = (x != 0.f);
+    return signbit | (nonzero & 1.f);
+}
+
+// -----------------------------------------------------------------------------------------------------------
+
+} // namespace simd
+} // namespace rack
+
 // #undef SIMDE_MM_FROUND_NO_EXC
 // #undef _MM_FROUND_NO_EXC
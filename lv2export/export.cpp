@@ -21,6 +21,39 @@
 
 // -----------------------------------------------------------------------
 
+static void printPort(const PortSpec& spec, const bool input, const int number, const std::string& name,
+                      const int channel, const int index)
+{
+    d_stdout("    lv2:port [");
+    if (spec.type != Audio)
+    {
+        d_stdout("        a lv2:%s, lv2:CVPort, mod:CVPort ;", input ? "InputPort" : "OutputPort");
+        d_stdout("        lv2:symbol \"lv2_cv_%s_%d\" ;", input ? "in" : "out", number);
+        if (spec.type == Bi)
+        {
+            d_stdout("        lv2:minimum -5.0 ;");
+            d_stdout("        lv2:maximum 5.0 ;");
+        }
+        else
+        {
+            d_stdout("        lv2:minimum 0.0 ;");
+            d_stdout("        lv2:maximum 10.0 ;");
+        }
+    }
+    else
+    {
+        d_stdout("        a lv2:%s, lv2:AudioPort ;", input ? "InputPort" : "OutputPort");
+        d_stdout("        lv2:symbol \"lv2_audio_%s_%d\" ;", input ? "in" : "out", number);
+    }
+    if (spec.channels > 1)
+        d_stdout("        lv2:name \"%s %d\" ;", name.c_str(), channel + 1);
+    else
+        d_stdout("        lv2:name \"%s\" ;", name.c_str());
+    d_stdout("        lv2:index %d ;", index);
+    d_stdout("    ] ;");
+    d_stdout("");
+}
+
 DISTRHO_PLUGIN_EXPORT
 void lv2_generate_ttl()
 {
@@ -47,60 +80,20 @@ void lv2_generate_ttl()
 
     for (int i=0, numAudio=0, numCV=0; i<module->getNumInputs(); ++i)
     {
-        d_stdout("    lv2:port [");
-        if (kCvInputs[i])
-        {
-            d_stdout("        a lv2:InputPort, lv2:CVPort, mod:CVPort ;");
-            d_stdout("        lv2:symbol \"lv2_cv_in_%d\" ;", ++numCV);
-            if (kCvOutputs[i] == Bi)
-            {
-                d_stdout("        lv2:minimum -5.0 ;");
-                d_stdout("        lv2:maximum 5.0 ;");
-            }
-            else
-            {
-                d_stdout("        lv2:minimum 0.0 ;");
-                d_stdout("        lv2:maximum 10.0 ;");
-            }
-        }
-        else
-        {
-            d_stdout("        a lv2:InputPort, lv2:AudioPort ;");
-            d_stdout("        lv2:symbol \"lv2_audio_in_%d\" ;", ++numAudio);
-        }
-        d_stdout("        lv2:name \"%s\" ;", module->getInputInfo(i)->getFullName().c_str());
-        d_stdout("        lv2:index %d ;", index++);
-        d_stdout("    ] ;");
-        d_stdout("");
+        const PortSpec spec = getInputSpec(i);
+        const std::string name = module->getInputInfo(i)->getFullName();
+
+        for (int c=0; c<spec.channels; ++c)
+            printPort(spec, true, spec.type == Audio ? ++numAudio : ++numCV, name, c, index++);
     }
 
     for (int i=0, numAudio=0, numCV=0; i<module->getNumOutputs(); ++i)
     {
-        d_stdout("    lv2:port [");
-        if (kCvOutputs[i])
-        {
-            d_stdout("        a lv2:OutputPort, lv2:CVPort, mod:CVPort ;");
-            d_stdout("        lv2:symbol \"lv2_cv_out_%d\" ;", ++numCV);
-            if (kCvOutputs[i] == Bi)
-            {
-                d_stdout("        lv2:minimum -5.0 ;");
-                d_stdout("        lv2:maximum 5.0 ;");
-            }
-            else
-            {
-                d_stdout("        lv2:minimum 0.0 ;");
-                d_stdout("        lv2:maximum 10.0 ;");
-            }
-        }
-        else
-        {
-            d_stdout("        a lv2:OutputPort, lv2:AudioPort ;");
-            d_stdout("        lv2:symbol \"lv2_audio_out_%d\" ;", ++numAudio);
-        }
-        d_stdout("        lv2:name \"%s\" ;", module->getOutputInfo(i)->getFullName().c_str());
-        d_stdout("        lv2:index %d ;", index++);
-        d_stdout("    ] ;");
-        d_stdout("");
+        const PortSpec spec = getOutputSpec(i);
+        const std::string name = module->getOutputInfo(i)->getFullName();
+
+        for (int c=0; c<spec.channels; ++c)
+            printPort(spec, false, spec.type == Audio ? ++numAudio : ++numCV, name, c, index++);
     }
 
     for (int i=0; i<module->getNumParams(); ++i)
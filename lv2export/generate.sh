@@ -0,0 +1,142 @@
+#!/bin/bash
+# Generate a single-module LV2 wrapper for any Cardinal module, see usage below.
+# The wrapper goes into plugins/, the regular build then produces the binary and its TTL.
+
+set -e
+
+cd $(dirname $0)
+
+function usage() {
+    echo "usage: $0 [options] <plugin-dir> <module-slug>"
+    echo ""
+    echo "  <plugin-dir>   name of the plugin directory inside ../plugins, like Fundamental"
+    echo "  <module-slug>  slug of the module, as used in plugin.json"
+    echo ""
+    echo "options:"
+    echo "  -s <file>      extra source file to include, relative to ../plugins (can be repeated)"
+    echo "  -i <list>      port types of the module inputs, like '{Audio,Bi,Poly(Bi,4)}'"
+    echo "  -o <list>      port types of the module outputs"
+    echo "  -c <category>  LV2 category, guessed from the module tags by default"
+    echo ""
+    echo "Inputs and outputs not listed are exported as mono bipolar CV."
+    exit 1
+}
+
+extra_sources=()
+cv_inputs=""
+cv_outputs=""
+category=""
+
+while getopts "s:i:o:c:h" opt; do
+    case ${opt} in
+        s) extra_sources+=("${OPTARG}") ;;
+        i) cv_inputs="${OPTARG}" ;;
+        o) cv_outputs="${OPTARG}" ;;
+        c) category="${OPTARG}" ;;
+        *) usage ;;
+    esac
+done
+
+shift $((OPTIND - 1))
+
+if [ $# -ne 2 ]; then
+    usage
+fi
+
+plugin_dir="${1}"
+slug="${2}"
+plugin_json="../plugins/${plugin_dir}/plugin.json"
+
+if [ ! -f "${plugin_json}" ]; then
+    echo "error: ${plugin_json} does not exist"
+    exit 1
+fi
+
+brand=$(jq -crM '.brand // .name' "${plugin_json}")
+label=$(jq -crM --arg slug "${slug}" '.modules[] | select(.slug == $slug) | .name' "${plugin_json}")
+
+if [ -z "${label}" ]; then
+    echo "error: module '${slug}' not found in ${plugin_json}"
+    exit 1
+fi
+
+# find the source file that registers the model, and the model variable name
+source_file=$(grep -rlE "createModel<.*>\(\s*\"${slug}\"\s*\)" "../plugins/${plugin_dir}/src" | head -n 1)
+
+if [ -z "${source_file}" ]; then
+    echo "error: could not find where module '${slug}' is registered, check ../plugins/${plugin_dir}/src"
+    exit 1
+fi
+
+model=$(grep -hoE "Model\s*\*\s*\w+\s*=\s*createModel<.*>\(\s*\"${slug}\"" "${source_file}" | sed -E 's/Model\s*\*\s*(\w+)\s*=.*/\1/')
+
+if [ -z "${model}" ]; then
+    echo "error: could not find the model variable of module '${slug}' in ${source_file}"
+    exit 1
+fi
+
+if [ -z "${category}" ]; then
+    tags=$(jq -crM --arg slug "${slug}" '.modules[] | select(.slug == $slug) | .tags // [] | join(" ")' "${plugin_json}")
+    case " ${tags,,} " in
+        *" reverb "*)                     category="lv2:ReverbPlugin" ;;
+        *" delay "*)                      category="lv2:DelayPlugin" ;;
+        *" filter "*)                     category="lv2:FilterPlugin" ;;
+        *" distortion "*)                 category="lv2:DistortionPlugin" ;;
+        *" compressor "*|*" dynamics "*)  category="lv2:DynamicsPlugin" ;;
+        *" equalizer "*)                  category="lv2:EQPlugin" ;;
+        *" chorus "*|*" flanger "*)       category="lv2:ChorusPlugin" ;;
+        *" phaser "*)                     category="lv2:PhaserPlugin" ;;
+        *" oscillator "*)                 category="lv2:OscillatorPlugin" ;;
+        *" mixer "*)                      category="lv2:MixerPlugin" ;;
+        *" sequencer "*|*" clock "*|*" quantizer "*|*" random "*|*" envelope generator "*|*" lfo "*)
+                                          category="mod:CVPlugin" ;;
+        *)                                category="lv2:UtilityPlugin" ;;
+    esac
+fi
+
+output="plugins/${plugin_dir,,}-${slug,,}.cpp"
+
+{
+    cat <<EOF
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// generated by generate.sh
+
+EOF
+
+    for s in "${extra_sources[@]}"; do
+        echo "#include \"${s}\""
+    done
+    echo "#include \"${source_file#../plugins/}\""
+    echo ""
+    echo "#define PLUGIN_BRAND \"${brand//\"/\\\"}\""
+    echo "#define PLUGIN_LABEL \"${label//\"/\\\"}\""
+    echo "#define PLUGIN_MODEL ${model}"
+    if [ -n "${cv_inputs}" ]; then
+        echo "#define PLUGIN_CV_INPUTS ${cv_inputs}"
+    fi
+    if [ -n "${cv_outputs}" ]; then
+        echo "#define PLUGIN_CV_OUTPUTS ${cv_outputs}"
+    fi
+    echo "#define PLUGIN_LV2_CATEGORY \"${category}\""
+    echo ""
+    echo "#include \"lv2plugin.cpp\""
+    echo "#include \"export.cpp\""
+} > "${output}"
+
+echo "Generated ${output}"
@@ -52,12 +52,31 @@ Xoroshiro128Plus& local() {
 
 }
 
+static_assert(kPortMaxChannels == PORT_MAX_CHANNELS, "LV2 port channel limit must match Rack ports");
+
 struct PluginLv2 {
+    // one per LV2 audio or CV port, resolved once so running is a plain copy loop without per-port branches
+    struct InputMap {
+        const float* buffer;
+        float* voltage;
+        float gain;
+    };
+    struct OutputMap {
+        float* buffer;
+        const float* voltage;
+        float gain;
+    };
+
     Context context;
     engine::Module* module;
     int frameCount = 0;
     int numInputs, numOutputs, numParams, numLights;
-    void** ports;
+    uint32_t numInputPorts = 0, numOutputPorts = 0;
+    std::vector<InputMap> inputMaps;
+    std::vector<OutputMap> outputMaps;
+    std::vector<const float*> paramPorts;
+    std::vector<float*> lightPorts;
+    std::vector<float> lastParamValues;
 
     PluginLv2(double sr)
     {
@@ -84,37 +103,71 @@ struct PluginLv2 {
         numOutputs = module->getNumOutputs();
         numParams = module->getNumParams();
         numLights = module->getNumLights();
-        ports = new void*[numInputs+numOutputs+numParams+numLights];
 
         Module::SampleRateChangeEvent e = { context._engine.sampleRate, 1.0f / context._engine.sampleRate };
         module->onSampleRateChange(e);
 
         // FIXME for CV ports we need to detect if something is connected
-        for (int i=numInputs; --i >=0;)
+        for (int i=0; i<numInputs; ++i)
         {
-            // if (!kCvInputs[i])
-            module->inputs[i].channels = 1;
+            const PortSpec spec = getInputSpec(i);
+            module->inputs[i].channels = spec.channels;
+
+            for (int c=0; c<spec.channels; ++c)
+                inputMaps.push_back({ nullptr, &module->inputs[i].voltages[c], spec.getInputGain() });
         }
-        for (int i=numOutputs; --i >=0;)
+        for (int i=0; i<numOutputs; ++i)
         {
-            // if (!kCvOutputs[i])
-            module->outputs[i].channels = 1;
+            const PortSpec spec = getOutputSpec(i);
+            module->outputs[i].channels = spec.channels;
+
+            for (int c=0; c<spec.channels; ++c)
+                outputMaps.push_back({ nullptr, &module->outputs[i].voltages[c], spec.getOutputGain() });
         }
 
+        numInputPorts = inputMaps.size();
+        numOutputPorts = outputMaps.size();
+        paramPorts.resize(numParams, nullptr);
+        lightPorts.resize(numLights, nullptr);
+
+        // NaN never compares equal, so all params are set on the first run
+        lastParamValues.resize(numParams, NAN);
+
         d_stdout("Loaded " SLUG " :: %i inputs, %i outputs, %i params and %i lights",
                  numInputs, numOutputs, numParams, numLights);
     }
 
-    PluginLv2()
+    ~PluginLv2()
     {
         contextSet(&context);
-        delete[] ports;
         delete module;
     }
 
-    void lv2_connect_port(const uint32_t port, void* const dataLocation)
+    void lv2_connect_port(uint32_t port, void* const dataLocation)
     {
-        ports[port] = dataLocation;
+        if (port < numInputPorts)
+        {
+            inputMaps[port].buffer = static_cast<const float*>(dataLocation);
+            return;
+        }
+        port -= numInputPorts;
+
+        if (port < numOutputPorts)
+        {
+            outputMaps[port].buffer = static_cast<float*>(dataLocation);
+            return;
+        }
+        port -= numOutputPorts;
+
+        if (port < static_cast<uint32_t>(numParams))
+        {
+            paramPorts[port] = static_cast<const float*>(dataLocation);
+            return;
+        }
+        port -= numParams;
+
+        if (port < static_cast<uint32_t>(numLights))
+            lightPorts[port] = static_cast<float*>(dataLocation);
     }
 
     void lv2_run(const uint32_t sampleCount)
@@ -126,34 +179,38 @@ struct PluginLv2 {
 
         Module::ProcessArgs args = { context._engine.sampleRate, 1.0f / context._engine.sampleRate, frameCount };
 
-        for (int i=numParams; --i >=0;)
-            module->params[i].setValue(*static_cast<const float*>(ports[numInputs+numOutputs+i]));
-
-        for (uint32_t s=0; s<sampleCount; ++s)
+        // params are only touched when changed, once per block
+        for (int i=0; i<numParams; ++i)
         {
-            for (int i=numInputs; --i >=0;)
+            const float value = *paramPorts[i];
+
+            if (value != lastParamValues[i])
             {
-                if (kCvInputs[i])
-                    module->inputs[i].setVoltage(static_cast<const float*>(ports[i])[s]);
-                else
-                    module->inputs[i].setVoltage(static_cast<const float*>(ports[i])[s] * 10.0f);
+                lastParamValues[i] = value;
+                module->params[i].setValue(value);
             }
+        }
+
+        const InputMap* const inputs = inputMaps.data();
+        const OutputMap* const outputs = outputMaps.data();
+        const uint32_t inputCount = numInputPorts;
+        const uint32_t outputCount = numOutputPorts;
+
+        for (uint32_t s=0; s<sampleCount; ++s)
+        {
+            for (uint32_t i=0; i<inputCount; ++i)
+                *inputs[i].voltage = inputs[i].buffer[s] * inputs[i].gain;
 
             module->doProcess(args);
 
-            for (int i=numOutputs; --i >=0;)
-            {
-                if (kCvOutputs[i])
-                    static_cast<float*>(ports[numInputs+i])[s] = module->outputs[i].getVoltage();
-                else
-                    static_cast<float*>(ports[numInputs+i])[s] = module->outputs[i].getVoltage() * 0.1f;
-            }
+            for (uint32_t i=0; i<outputCount; ++i)
+                outputs[i].buffer[s] = *outputs[i].voltage * outputs[i].gain;
 
             ++args.frame;
         }
 
-        for (int i=numLights; --i >=0;)
-            *static_cast<float*>(ports[numInputs+numOutputs+numParams+i]) = module->lights[i].getBrightness();
+        for (int i=0; i<numLights; ++i)
+            *lightPorts[i] = module->lights[i].getBrightness();
 
         frameCount += sampleCount;
     }
@@ -29,12 +29,8 @@
 # error PLUGIN_MODEL undefined
 #endif
 
-#ifndef PLUGIN_CV_INPUTS
-# error PLUGIN_CV_INPUTS undefined
-#endif
-
-#ifndef PLUGIN_CV_OUTPUTS
-# error PLUGIN_CV_OUTPUTS undefined
+#ifndef PLUGIN_LV2_CATEGORY
+# define PLUGIN_LV2_CATEGORY "lv2:UtilityPlugin"
 #endif
 
 enum PortType {
@@ -43,5 +39,59 @@ enum PortType {
     Uni = 2,
 };
 
-static constexpr const PortType kCvInputs[] = PLUGIN_CV_INPUTS;
-static constexpr const PortType kCvOutputs[] = PLUGIN_CV_OUTPUTS;
+/** Maximum channels of a polyphonic port, the size of a Rack port voltage array. */
+static constexpr const int kPortMaxChannels = 16;
+
+/**
+   How a module port is exposed to LV2.
+   Audio ports are scaled from/to 10V peak, CV ports are passed as-is.
+   A port with more than 1 channel is polyphonic and exposed as that many consecutive LV2 ports.
+   The channel count is clamped to 1..kPortMaxChannels.
+ */
+struct PortSpec {
+    PortType type;
+    int channels;
+
+    constexpr PortSpec(const PortType t = Bi, const int c = 1)
+        : type(t),
+          channels(c < 1 ? 1 : c > kPortMaxChannels ? kPortMaxChannels : c) {}
+
+    constexpr float getInputGain() const
+    {
+        return type == Audio ? 10.0f : 1.0f;
+    }
+
+    constexpr float getOutputGain() const
+    {
+        return type == Audio ? 0.1f : 1.0f;
+    }
+};
+
+/** Polyphonic port for use in PLUGIN_CV_INPUTS and PLUGIN_CV_OUTPUTS, like `Poly(Bi, 4)`. */
+static constexpr PortSpec Poly(const PortType type, const int channels)
+{
+    return PortSpec(type, channels);
+}
+
+// PLUGIN_CV_INPUTS and PLUGIN_CV_OUTPUTS describe the module ports in order, missing ones are treated as mono
+// bipolar CV. Leaving them undefined exports every port that way, which works for any module.
+
+static inline PortSpec getInputSpec(const int index)
+{
+   #ifdef PLUGIN_CV_INPUTS
+    static constexpr const PortSpec specs[] = PLUGIN_CV_INPUTS;
+    if (index < static_cast<int>(sizeof(specs) / sizeof(specs[0])))
+        return specs[index];
+   #endif
+    return PortSpec();
+}
+
+static inline PortSpec getOutputSpec(const int index)
+{
+   #ifdef PLUGIN_CV_OUTPUTS
+    static constexpr const PortSpec specs[] = PLUGIN_CV_OUTPUTS;
+    if (index < static_cast<int>(sizeof(specs) / sizeof(specs[0])))
+        return specs[index];
+   #endif
+    return PortSpec();
+}
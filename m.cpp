@@ -0,0 +1,4 @@
+#include "h.hpp"
+#include <cstdio>
+void fa(C&, const float*, float*); void fb(C&, const float*, float*);
+int main(){ C c; for(int i=0;i<64;++i)c.t[i]=i; float in[64],o[64]={0}; for(int i=0;i<64;++i)in[i]=1; fa(c,in,o); fb(c,in,o); printf("%f\n",o[63]); }
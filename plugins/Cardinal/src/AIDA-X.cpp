@@ -7,6 +7,7 @@
 
 #include "plugin.hpp"
 #include "ModuleWidgets.hpp"
+#include "cpu-dispatch.hpp"
 
 #ifndef HEADLESS
 # include "ImGuiWidget.hpp"
@@ -16,9 +17,12 @@
 // #define QUICK_BUILD_TESTING
 
 #ifndef QUICK_BUILD_TESTING
+# include "extra/Mutex.hpp"
 # include "extra/Sleep.hpp"
-# include "AIDA-X/Biquad.cpp"
+# include "extra/Thread.hpp"
 # include "AIDA-X/model_variant.hpp"
+# include "AIDA-X/BatchedModel.hpp"
+# include "BiquadCascade.hpp"
 
 template class RTNeural::Model<float>;
 template class RTNeural::Layer<float>;
@@ -43,6 +47,157 @@ static constexpr const float PRESENCE_FREQ = 900.f;
 static constexpr const float INLPF_MAX_CO = 0.99f * 0.5f; /* coeff * ((samplerate / 2) / samplerate) */
 static constexpr const float INLPF_MIN_CO = 0.25f * 0.5f; /* coeff * ((samplerate / 2) / samplerate) */
 
+/* Model and filters run on sub-blocks of this size, which adds as much latency */
+static constexpr const uint32_t SUB_BLOCK_SIZE = 32;
+
+/* Sample rate assumed for models without one in their metadata */
+static constexpr const int DEFAULT_MODEL_SAMPLE_RATE = 48000;
+
+// --------------------------------------------------------------------------------------------------------------------
+// Converts sub-blocks from the engine rate to the rate a model was trained at and back.
+// Models give wrong results at other rates than their training one, and running at the model rate also keeps the
+// CPU cost independent of the engine rate.
+// Frames are stored channel-interleaved with a stride of PORT_MAX_CHANNELS, same as the module sub-block buffers.
+
+struct ModelResampler {
+    // enough room for models running at up to 8x the engine rate
+    static constexpr const uint32_t kMaxModelFrames = SUB_BLOCK_SIZE * 8;
+    static constexpr const uint32_t kMaxHostFrames = SUB_BLOCK_SIZE * 2;
+    // the upsampler output varies by a few frames on each sub-block, keep some in reserve to always fill one
+    static constexpr const uint32_t kReserveFrames = 4;
+    static constexpr const uint32_t kFifoSize = SUB_BLOCK_SIZE * 4;
+
+    dsp::SampleRateConverter<PORT_MAX_CHANNELS> down;
+    dsp::SampleRateConverter<PORT_MAX_CHANNELS> up;
+    bool active = false;
+    int hostRate = 0;
+    int modelRate = 0;
+    int channels = PORT_MAX_CHANNELS; /* converters hold state for all channels, only these are processed */
+    uint32_t latency = 0; /* in engine frames, not counting the sub-block */
+
+    alignas(16) float modelBuffer[kMaxModelFrames][PORT_MAX_CHANNELS] = {};
+    alignas(16) float hostBuffer[kMaxHostFrames][PORT_MAX_CHANNELS] = {};
+    float fifo[kFifoSize][PORT_MAX_CHANNELS] = {};
+    uint32_t fifoRead = 0;
+    uint32_t fifoCount = 0;
+
+    /* Allocates, must not be called while processing */
+    void configure(const int newHostRate, const int newModelRate)
+    {
+        hostRate = newHostRate;
+        modelRate = newModelRate;
+        active = newModelRate != newHostRate && newModelRate <= newHostRate * 8;
+
+        if (! active)
+        {
+            latency = 0;
+            return;
+        }
+
+        down.setChannels(PORT_MAX_CHANNELS);
+        up.setChannels(PORT_MAX_CHANNELS);
+        down.setQuality(SPEEX_RESAMPLER_QUALITY_DESKTOP);
+        up.setQuality(SPEEX_RESAMPLER_QUALITY_DESKTOP);
+        down.setRates(newHostRate, newModelRate);
+        up.setRates(newModelRate, newHostRate);
+        speex_resampler_set_input_stride(down.st, PORT_MAX_CHANNELS);
+        speex_resampler_set_output_stride(down.st, PORT_MAX_CHANNELS);
+        speex_resampler_set_input_stride(up.st, PORT_MAX_CHANNELS);
+        speex_resampler_set_output_stride(up.st, PORT_MAX_CHANNELS);
+        reset();
+
+        // both in engine frames, input side of the downsampler and output side of the upsampler
+        latency = speex_resampler_get_input_latency(down.st)
+                + speex_resampler_get_output_latency(up.st)
+                + kReserveFrames;
+    }
+
+    void reset()
+    {
+        if (down.st != nullptr)
+            speex_resampler_reset_mem(down.st);
+        if (up.st != nullptr)
+            speex_resampler_reset_mem(up.st);
+
+        std::memset(fifo, 0, sizeof(fifo));
+        fifoRead = 0;
+        fifoCount = kReserveFrames;
+    }
+
+    /* Only changes how many channels get processed, the converters were set up for all of them in `configure` */
+    void setChannels(const int newChannels)
+    {
+        if (channels == newChannels)
+            return;
+
+        channels = newChannels;
+        reset();
+    }
+
+    /* Convert one sub-block to the model rate into modelBuffer, returns the number of model frames */
+    uint32_t downsample(const float in[SUB_BLOCK_SIZE][PORT_MAX_CHANNELS])
+    {
+        spx_uint32_t outFrames = 0;
+
+        for (int c = 0; c < channels; ++c)
+        {
+            spx_uint32_t inLen = SUB_BLOCK_SIZE;
+            outFrames = kMaxModelFrames;
+            speex_resampler_process_float(down.st, c, in[0] + c, &inLen, modelBuffer[0] + c, &outFrames);
+        }
+
+        return outFrames;
+    }
+
+    /* Convert modelBuffer back to the engine rate, filling exactly one sub-block */
+    void upsample(const uint32_t modelFrames, float out[SUB_BLOCK_SIZE][PORT_MAX_CHANNELS])
+    {
+        spx_uint32_t outFrames = 0;
+
+        for (int c = 0; c < channels; ++c)
+        {
+            spx_uint32_t inLen = modelFrames;
+            outFrames = kMaxHostFrames;
+            speex_resampler_process_float(up.st, c, modelBuffer[0] + c, &inLen, hostBuffer[0] + c, &outFrames);
+        }
+
+        const size_t frameSize = sizeof(float) * channels;
+
+        for (uint32_t i = 0; i < outFrames && fifoCount < kFifoSize; ++i, ++fifoCount)
+            std::memcpy(fifo[(fifoRead + fifoCount) % kFifoSize], hostBuffer[i], frameSize);
+
+        for (uint32_t i = 0; i < SUB_BLOCK_SIZE; ++i)
+        {
+            // only happens if the reserve runs out, output silence rather than stale data
+            if (fifoCount == 0)
+            {
+                std::memset(out[i], 0, frameSize);
+                continue;
+            }
+
+            std::memcpy(out[i], fifo[fifoRead], frameSize);
+            fifoRead = (fifoRead + 1) % kFifoSize;
+            --fifoCount;
+        }
+    }
+};
+
+/* Training sample rate from the model metadata, if present */
+static inline
+int getModelSampleRate(const nlohmann::json& model_json)
+{
+    for (const char* const key : { "samplerate", "sample_rate" })
+    {
+        if (model_json.contains(key) && model_json[key].is_number())
+            return model_json[key].get<int>();
+
+        if (model_json.contains("metadata") && model_json["metadata"].contains(key) && model_json["metadata"][key].is_number())
+            return model_json["metadata"][key].get<int>();
+    }
+
+    return DEFAULT_MODEL_SAMPLE_RATE;
+}
+
 // --------------------------------------------------------------------------------------------------------------------
 
 struct DynamicModel {
@@ -50,159 +205,101 @@ struct DynamicModel {
     bool input_skip; /* Means the model has been trained with first input element skipped to the output */
     float input_gain;
     float output_gain;
+    int sample_rate; /* Rate the model was trained at */
+    ModelResampler resampler;
+    /* Same model for polyphonic use, weights shared between all voices, state per group of 4 voices */
+    BatchedModelWeights<simd::float_4> batched_weights;
+    BatchedModelState<simd::float_4> batched_states[PORT_MAX_CHANNELS / 4];
+};
+
+/* Filters for a group of 4 channels, coefficients are the same for all channels */
+struct ToneStack {
+    enum EqSections {
+        kEqDepth,
+        kEqBass,
+        kEqMid,
+        kEqTreble,
+        kEqPresence,
+        kEqSectionCount
+    };
+
+    BiquadCascade<1> dc_blocker;
+    BiquadCascade<1> in_lpf;
+    BiquadCascade<kEqSectionCount> eq;
 };
 
 // --------------------------------------------------------------------------------------------------------------------
-// This function carries model calculations
+// This function carries model calculations, the model variant is dispatched once for the whole block.
+// Samples are read and written with @a stride, so interleaved buffers can be processed in place.
 
 static inline
-void applyModelOffline(DynamicModel* model, float* const out, uint32_t numSamples)
+void applyModelBlock(DynamicModel* model, float* const out, const uint32_t stride, const uint32_t numSamples,
+                     const float param1, const float param2)
 {
     const bool input_skip = model->input_skip;
     const float input_gain = model->input_gain;
     const float output_gain = model->output_gain;
 
     std::visit(
-        [&out, numSamples, input_skip, input_gain, output_gain] (auto&& custom_model)
+        [out, stride, numSamples, input_skip, input_gain, output_gain, param1, param2] (auto&& custom_model)
         {
             using ModelType = std::decay_t<decltype (custom_model)>;
 
-            if (d_isNotEqual(input_gain, 1.f))
-            {
-                for (uint32_t i=0; i<numSamples; ++i)
-                    out[i] *= input_gain;
-            }
-
-            if constexpr (ModelType::input_size == 1)
-            {
-                if (input_skip)
-                {
-                    for (uint32_t i=0; i<numSamples; ++i)
-                        out[i] += custom_model.forward(out + i);
-                }
-                else
-                {
-                    for (uint32_t i=0; i<numSamples; ++i)
-                        out[i] = custom_model.forward(out + i) * output_gain;
-                }
-            }
-            else if constexpr (ModelType::input_size == 2)
-            {
-                float inArray1 alignas(RTNEURAL_DEFAULT_ALIGNMENT)[2];
-
-                if (input_skip)
-                {
-                    for (uint32_t i=0; i<numSamples; ++i)
-                    {
-                        inArray1[0] = out[i];
-                        inArray1[1] = 0.f;
-                        out[i] += custom_model.forward(inArray1);
-                    }
-                }
-                else
-                {
-                    for (uint32_t i=0; i<numSamples; ++i)
-                    {
-                        inArray1[0] = out[i];
-                        inArray1[1] = 0.f;
-                        out[i] = custom_model.forward(inArray1) * output_gain;
-                    }
-                }
-            }
-            else if constexpr (ModelType::input_size == 3)
+            if constexpr (ModelType::input_size >= 1 && ModelType::input_size <= MAX_INPUT_SIZE)
             {
-                float inArray2 alignas(RTNEURAL_DEFAULT_ALIGNMENT)[3];
+                float inArray alignas(RTNEURAL_DEFAULT_ALIGNMENT)[MAX_INPUT_SIZE] = { 0.f, param1, param2 };
 
                 if (input_skip)
                 {
                     for (uint32_t i=0; i<numSamples; ++i)
                     {
-                        inArray2[0] = out[i];
-                        inArray2[1] = 0.f;
-                        inArray2[2] = 0.f;
-                        out[i] += custom_model.forward(inArray2);
+                        float& sample(out[i * stride]);
+                        inArray[0] = sample * input_gain;
+                        sample = (inArray[0] + custom_model.forward(inArray)) * output_gain;
                     }
                 }
                 else
                 {
                     for (uint32_t i=0; i<numSamples; ++i)
                     {
-                        inArray2[0] = out[i];
-                        inArray2[1] = 0.f;
-                        inArray2[2] = 0.f;
-                        out[i] = custom_model.forward(inArray2) * output_gain;
+                        float& sample(out[i * stride]);
+                        inArray[0] = sample * input_gain;
+                        sample = custom_model.forward(inArray) * output_gain;
                     }
                 }
             }
-
-            if (input_skip && d_isNotEqual(output_gain, 1.f))
-            {
-                for (uint32_t i=0; i<numSamples; ++i)
-                    out[i] *= output_gain;
-            }
         },
         model->variant
     );
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// Polyphonic variant, runs 4 channels at once using the batched model
+
 static inline
-float applyModel(DynamicModel* model, float sample, const float param1, const float param2)
+void applyModelBatched(DynamicModel* model, float* const samples, const int channels, const float param1, const float param2)
 {
+    const BatchedModelWeights<simd::float_4>& weights(model->batched_weights);
     const bool input_skip = model->input_skip;
-    const float input_gain = model->input_gain;
-    const float output_gain = model->output_gain;
+    const simd::float_4 input_gain = model->input_gain;
+    const simd::float_4 output_gain = model->output_gain;
 
-    sample *= input_gain;
+    // extra inputs are only read by models that need them
+    simd::float_4 in[MAX_INPUT_SIZE] = { 0.f, param1, param2 };
 
-    std::visit(
-        [&sample, input_skip, output_gain, param1, param2] (auto&& custom_model)
-        {
-            using ModelType = std::decay_t<decltype (custom_model)>;
+    for (int c = 0; c < channels; c += 4)
+    {
+        const simd::float_4 sample = simd::float_4::load(samples + c) * input_gain;
+        in[0] = sample;
 
-            if constexpr (ModelType::input_size == 1)
-            {
-                float* out = &sample;
-                if (input_skip)
-                {
-                    sample += custom_model.forward(out);
-                    sample *= output_gain;
-                }
-                else
-                {
-                    sample = custom_model.forward(out) * output_gain;
-                }
-            }
-            else if constexpr (ModelType::input_size == 2)
-            {
-                float inArray1 alignas(RTNEURAL_DEFAULT_ALIGNMENT)[2] = {sample, param1};
-                if (input_skip)
-                {
-                    sample += custom_model.forward(inArray1);
-                    sample *= output_gain;
-                }
-                else
-                {
-                    sample = custom_model.forward(inArray1) * output_gain;
-                }
-            }
-            else if constexpr (ModelType::input_size == 3)
-            {
-                float inArray2 alignas(RTNEURAL_DEFAULT_ALIGNMENT)[3] = {sample, param1, param2};
-                if (input_skip)
-                {
-                    sample += custom_model.forward(inArray2);
-                    sample *= output_gain;
-                }
-                else
-                {
-                    sample = custom_model.forward(inArray2) * output_gain;
-                }
-            }
-        },
-        model->variant
-    );
-    
-    return sample;
+        simd::float_4 out = batchedModelForward(weights, model->batched_states[c / 4], in);
+
+        if (input_skip)
+            out += sample;
+
+        out *= output_gain;
+        out.store(samples + c);
+    }
 }
 #endif
 
@@ -254,20 +351,127 @@ struct AidaPluginModule : Module {
     std::string currentFile;
 
 #ifndef QUICK_BUILD_TESTING
-    Biquad dc_blocker { bq_type_highpass, 0.5f, COMMON_Q, 0.0f };
-    Biquad in_lpf { bq_type_lowpass, 0.5f, COMMON_Q, 0.0f };
-    Biquad bass { bq_type_lowshelf, 0.5f, COMMON_Q, 0.0f };
-    Biquad mid { bq_type_peak, 0.5f, COMMON_Q, 0.0f };
-    Biquad treble { bq_type_highshelf, 0.5f, COMMON_Q, 0.0f };
-    Biquad depth { bq_type_peak, 0.5f, COMMON_Q, 0.0f };
-    Biquad presence { bq_type_highshelf, 0.5f, COMMON_Q, 0.0f };
+    // model and filters run on sub-blocks, which adds this much latency
+    static constexpr const uint32_t kBlockSize = SUB_BLOCK_SIZE;
+
+    // frame major, so 4 consecutive channels can be loaded as a single SIMD vector
+    alignas(16) float blockInput[kBlockSize][PORT_MAX_CHANNELS] = {};
+    alignas(16) float blockOutput[kBlockSize][PORT_MAX_CHANNELS] = {};
+    uint32_t blockPos = 0;
+
+    ToneStack toneStacks[PORT_MAX_CHANNELS / 4];
 
     float cachedParams[NUM_PARAMS] = {};
 
     dsp::ExponentialFilter inlevel;
     dsp::ExponentialFilter outlevel;
+
+    // length of the equal-power crossfade between old and new model, multiple of kBlockSize
+    static constexpr const uint32_t kFadeLength = 1024;
+    static_assert(kFadeLength % kBlockSize == 0, "fade length must be a multiple of the block size");
+
+    // owned by the audio thread
     DynamicModel* model = nullptr;
-    std::atomic<bool> activeModel { false };
+    DynamicModel* fadingModel = nullptr;
+    uint32_t fadePos = 0;
+    alignas(16) float fadeBuffer[kBlockSize][PORT_MAX_CHANNELS] = {};
+
+    // handoff between loader and audio thread, no locks involved
+    std::atomic<DynamicModel*> pendingModel { nullptr };
+    std::atomic<DynamicModel*> retiredModel { nullptr };
+
+    // engine rate new models get their resampler configured for, updated on sample rate changes.
+    // rateMutex is held while publishing a pending model and while changing the rate, so a pending model always
+    // matches the engine rate by the time the audio thread picks it up.
+    std::atomic<int> hostSampleRate { 48000 };
+    DISTRHO_NAMESPACE::Mutex rateMutex;
+
+    // error message to show in the UI, set by the loader thread
+    DISTRHO_NAMESPACE::Mutex errorMutex;
+    std::string loadError;
+
+    // parses and prepares models away from the UI and audio threads
+    struct ModelLoader : DISTRHO_NAMESPACE::Thread {
+        AidaPluginModule* const module;
+        DISTRHO_NAMESPACE::Mutex mutex;
+        DISTRHO_NAMESPACE::Signal signal;
+        std::string filename;
+        bool showError = false;
+        bool hasRequest = false;
+
+        ModelLoader(AidaPluginModule* const m)
+            : Thread("AIDA-X model loader"),
+              module(m) {}
+
+        void request(const char* const newFilename, const bool newShowError)
+        {
+            {
+                const DISTRHO_NAMESPACE::MutexLocker cml(mutex);
+                filename = newFilename;
+                showError = newShowError;
+                hasRequest = true;
+            }
+
+            if (! isThreadRunning())
+                startThread();
+
+            signal.signal();
+        }
+
+        void stop()
+        {
+            signalThreadShouldExit();
+            signal.signal();
+            stopThread(-1);
+        }
+
+        void run() override
+        {
+            using DISTRHO_NAMESPACE::MutexLocker;
+            using DISTRHO_NAMESPACE::d_msleep;
+
+            while (! shouldThreadExit())
+            {
+                signal.wait();
+
+                for (;;)
+                {
+                    std::string requestFilename;
+                    bool requestShowError;
+
+                    {
+                        const MutexLocker cml(mutex);
+
+                        if (! hasRequest)
+                            break;
+
+                        requestFilename.swap(filename);
+                        requestShowError = showError;
+                        hasRequest = false;
+                    }
+
+                    module->reclaimModels();
+                    module->loadModelFromFileNow(requestFilename.c_str(), requestShowError);
+
+                    // wait for the audio thread to pick up the model, cleaning up old ones meanwhile.
+                    // newer requests replace a model not yet picked up, so stop waiting if one arrives.
+                    while (! shouldThreadExit() && (module->pendingModel.load() != nullptr ||
+                                                    module->retiredModel.load() != nullptr))
+                    {
+                        module->reclaimModels();
+
+                        {
+                            const MutexLocker cml(mutex);
+                            if (hasRequest)
+                                break;
+                        }
+
+                        d_msleep(10);
+                    }
+                }
+            }
+        }
+    } loader { this };
 #endif
 
     AidaPluginModule()
@@ -307,7 +511,16 @@ struct AidaPluginModule : Module {
         cachedParams[kParameterDEPTH] = 0.f;
         cachedParams[kParameterPRESENCE] = 0.f;
 
-        in_lpf.setFc(MAP(66.216f, 0.0f, 100.0f, INLPF_MAX_CO, INLPF_MIN_CO));
+        const BiquadCoefficients in_lpf = BiquadCoefficients::design(kBiquadLowpass,
+                                                                     MAP(66.216f, 0.0f, 100.0f, INLPF_MAX_CO, INLPF_MIN_CO),
+                                                                     COMMON_Q,
+                                                                     0.0f);
+        for (ToneStack& ts : toneStacks)
+        {
+            ts.in_lpf.setSection(0, in_lpf);
+            ts.in_lpf.snap();
+        }
+
         inlevel.setTau(1 / 30.f);
         outlevel.setTau(1 / 30.f);
 #endif
@@ -316,6 +529,10 @@ struct AidaPluginModule : Module {
     ~AidaPluginModule() override
     {
 #ifndef QUICK_BUILD_TESTING
+        loader.stop();
+        reclaimModels();
+        delete pendingModel.exchange(nullptr);
+        delete fadingModel;
         delete model;
 #endif
     }
@@ -354,20 +571,67 @@ struct AidaPluginModule : Module {
         }
     }
 
+    /* Request loading a model file, the actual loading happens in the background */
     void loadModelFromFile(const char* const filename, const bool showError)
     {
+#ifndef QUICK_BUILD_TESTING
+        loader.request(filename, showError);
+#endif
+    }
+
+#ifndef QUICK_BUILD_TESTING
+    /* Called from the loader thread */
+    void loadModelFromFileNow(const char* const filename, const bool showError)
+    {
+        const double startTime = system::getTime();
+
         try {
             std::ifstream jsonStream(filename, std::ifstream::binary);
             loadModelFromStream(jsonStream);
+
+            d_stdout("AIDA-X: loaded model '%s' in %.1f ms", filename, (system::getTime() - startTime) * 1000.0);
         }
         catch (const std::exception& e) {
             d_stderr2("Unable to load aida-x file: %s\nError: %s", filename, e.what());
 
             if (showError)
-                async_dialog_message((std::string("Unable to load aida-x file: ") + e.what()).c_str());
+            {
+                const DISTRHO_NAMESPACE::MutexLocker cml(errorMutex);
+                loadError = std::string("Unable to load aida-x file: ") + e.what();
+            }
         };
     }
 
+    /* Total latency added by the module, sub-block plus resampling */
+    static void printModelLatency(const DynamicModel* const dynmodel)
+    {
+        d_stdout("AIDA-X: model trained at %d Hz, %s, latency %u frames",
+                 dynmodel->sample_rate,
+                 dynmodel->resampler.active ? "resampling" : "running at engine rate",
+                 kBlockSize + dynmodel->resampler.latency);
+    }
+
+    /* Delete models no longer used by the audio thread, must not be called from it */
+    void reclaimModels()
+    {
+        delete retiredModel.exchange(nullptr);
+    }
+
+    /* Show errors from the loader thread, called from the UI thread */
+    void showLoadError()
+    {
+        std::string error;
+
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(errorMutex);
+            error.swap(loadError);
+        }
+
+        if (! error.empty())
+            async_dialog_message(error.c_str());
+    }
+#endif
+
     void loadModelFromStream(std::istream& jsonStream)
     {
 #ifndef QUICK_BUILD_TESTING
@@ -429,21 +693,45 @@ struct AidaPluginModule : Module {
         newmodel->input_skip = input_skip != 0;
         newmodel->input_gain = input_gain;
         newmodel->output_gain = output_gain;
+        newmodel->sample_rate = getModelSampleRate(model_json);
+
+        // run at the rate the model was trained at
+        newmodel->resampler.configure(hostSampleRate.load(), newmodel->sample_rate);
+
+        printModelLatency(newmodel.get());
+
+        // same weights for polyphonic use
+        newmodel->batched_weights.parseJson(model_json);
 
         // Pre-buffer to avoid "clicks" during initialization
         float out[2048] = {};
-        applyModelOffline(newmodel.get(), out, ARRAY_SIZE(out));
+        applyModelBlock(newmodel.get(), out, 1, ARRAY_SIZE(out), 0.f, 0.f);
+
+        {
+            BatchedModelState<simd::float_4>& state(newmodel->batched_states[0]);
+            state.init(newmodel->batched_weights);
 
-        // swap active model
-        DynamicModel* const oldmodel = model;
-        model = newmodel.release();
+            const simd::float_4 in[MAX_INPUT_SIZE] = {};
+            for (int i = 0; i < 2048; ++i)
+                batchedModelForward(newmodel->batched_weights, state, in);
+
+            for (int g = 1; g < PORT_MAX_CHANNELS / 4; ++g)
+                newmodel->batched_states[g] = state;
+        }
 
-        // if processing, wait for process cycle to complete
-        using DISTRHO_NAMESPACE::d_msleep;
-        while (oldmodel != nullptr && activeModel.load())
-            d_msleep(1);
+        // hand over to the audio thread, a previous model not yet picked up can be deleted right away
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(rateMutex);
+
+            // the engine rate changed while the model was loading
+            if (newmodel->resampler.hostRate != hostSampleRate.load())
+            {
+                newmodel->resampler.configure(hostSampleRate.load(), newmodel->sample_rate);
+                printModelLatency(newmodel.get());
+            }
 
-        delete oldmodel;
+            delete pendingModel.exchange(newmodel.release());
+        }
 #endif
     }
 
@@ -453,167 +741,294 @@ struct AidaPluginModule : Module {
         return cachedParams[kParameterMTYPE] > 0.5f ? kMidEqBandpass : kMidEqPeak;
     }
 
-    float applyToneControls(float sample)
+    /* Recalculate the equalizer from the cached params, new coefficients are smoothed over the next sub-block */
+    void updateToneControls(const float sampleRate)
     {
-        return getMidType() == kMidEqBandpass
-            ? mid.process(sample)
-            : presence.process(
-                treble.process(
-                    mid.process(
-                        bass.process(
-                            depth.process(sample)))));
+        BiquadCoefficients coeffs[ToneStack::kEqSectionCount];
+
+        if (getMidType() == kMidEqBandpass)
+        {
+            // only the mid section is used, the others stay as pass-through
+            coeffs[ToneStack::kEqMid] = BiquadCoefficients::design(kBiquadBandpass,
+                                                                   cachedParams[kParameterMIDFREQ] / sampleRate,
+                                                                   cachedParams[kParameterMIDQ],
+                                                                   cachedParams[kParameterMIDGAIN]);
+        }
+        else
+        {
+            coeffs[ToneStack::kEqDepth] = BiquadCoefficients::design(kBiquadPeak,
+                                                                     DEPTH_FREQ / sampleRate,
+                                                                     COMMON_Q,
+                                                                     cachedParams[kParameterDEPTH]);
+
+            coeffs[ToneStack::kEqBass] = BiquadCoefficients::design(kBiquadLowshelf,
+                                                                    cachedParams[kParameterBASSFREQ] / sampleRate,
+                                                                    COMMON_Q,
+                                                                    cachedParams[kParameterBASSGAIN]);
+
+            coeffs[ToneStack::kEqMid] = BiquadCoefficients::design(kBiquadPeak,
+                                                                   cachedParams[kParameterMIDFREQ] / sampleRate,
+                                                                   cachedParams[kParameterMIDQ],
+                                                                   cachedParams[kParameterMIDGAIN]);
+
+            coeffs[ToneStack::kEqTreble] = BiquadCoefficients::design(kBiquadHighshelf,
+                                                                      cachedParams[kParameterTREBLEFREQ] / sampleRate,
+                                                                      COMMON_Q,
+                                                                      cachedParams[kParameterTREBLEGAIN]);
+
+            coeffs[ToneStack::kEqPresence] = BiquadCoefficients::design(kBiquadHighshelf,
+                                                                        PRESENCE_FREQ / sampleRate,
+                                                                        COMMON_Q,
+                                                                        cachedParams[kParameterPRESENCE]);
+        }
+
+        for (ToneStack& ts : toneStacks)
+        {
+            for (int s = 0; s < ToneStack::kEqSectionCount; ++s)
+                ts.eq.setSection(s, coeffs[s]);
+        }
     }
 #endif
 
     void process(const ProcessArgs& args) override
     {
 #ifndef QUICK_BUILD_TESTING
-        const float stime = args.sampleTime;
-        const float inlevelv = DB_CO(params[kParameterINLEVEL].getValue());
-        const float outlevelv = DB_CO(params[kParameterOUTLEVEL].getValue());
+        const int channels = std::max(1, inputs[AUDIO_INPUT].getChannels());
+        outputs[AUDIO_OUTPUT].setChannels(channels);
 
-        const bool net_bypass = params[kParameterNETBYPASS].getValue() > 0.5f;
-        const bool eq_bypass = params[kParameterEQBYPASS].getValue() > 0.5f;
-        const EqPos eq_pos = params[kParameterEQPOS].getValue() > 0.5f ? kEqPre : kEqPost;
-
-        // update tone controls
-        bool changed = false;
-        float value;
+        // exchange one frame with the sub-block buffers, output is delayed by one sub-block
+        float* const in = blockInput[blockPos];
+        const float* const out = blockOutput[blockPos];
 
-        value = params[kParameterINLPF].getValue();
-        if (d_isNotEqual(cachedParams[kParameterINLPF], value))
+        for (int c = 0; c < channels; ++c)
         {
-            cachedParams[kParameterINLPF] = value;
-            in_lpf.setFc(MAP(value, 0.0f, 100.0f, INLPF_MAX_CO, INLPF_MIN_CO));
+            in[c] = inputs[AUDIO_INPUT].getVoltage(c);
+            outputs[AUDIO_OUTPUT].setVoltage(out[c], c);
         }
 
-        value = params[kParameterBASSGAIN].getValue();
-        if (d_isNotEqual(cachedParams[kParameterBASSGAIN], value))
+        if (++blockPos == kBlockSize)
         {
-            cachedParams[kParameterBASSGAIN] = value;
-            changed = true;
+            blockPos = 0;
+            processBlock(args, channels);
         }
+#endif
+    }
 
-        value = params[kParameterBASSFREQ].getValue();
-        if (d_isNotEqual(cachedParams[kParameterBASSFREQ], value))
+#ifndef QUICK_BUILD_TESTING
+    // the models are inlined here, so they get FMA and wider vectors on CPUs that have them
+    CARDINAL_CPU_DISPATCH
+    static void runModelFrames(DynamicModel* const dynmodel, float buffer[][PORT_MAX_CHANNELS], const uint32_t frames,
+                               const int channels, const float param1, const float param2)
+    {
+        if (channels == 1)
         {
-            cachedParams[kParameterBASSFREQ] = value;
-            changed = true;
+            applyModelBlock(dynmodel, buffer[0], PORT_MAX_CHANNELS, frames, param1, param2);
         }
-
-        if (changed)
+        else
         {
-            changed = false;
-            bass.setBiquad(bq_type_lowshelf,
-                           cachedParams[kParameterBASSFREQ] / args.sampleRate,
-                           COMMON_Q,
-                           cachedParams[kParameterBASSGAIN]);
+            for (uint32_t i = 0; i < frames; ++i)
+                applyModelBatched(dynmodel, buffer[i], channels, param1, param2);
         }
+    }
 
-        value = params[kParameterMIDGAIN].getValue();
-        if (d_isNotEqual(cachedParams[kParameterMIDGAIN], value))
-        {
-            cachedParams[kParameterMIDGAIN] = value;
-            changed = true;
-        }
+    void runModel(DynamicModel* const dynmodel, float buffer[kBlockSize][PORT_MAX_CHANNELS],
+                  const int channels, const float param1, const float param2)
+    {
+        ModelResampler& resampler(dynmodel->resampler);
 
-        value = params[kParameterMIDFREQ].getValue();
-        if (d_isNotEqual(cachedParams[kParameterMIDFREQ], value))
+        if (! resampler.active)
         {
-            cachedParams[kParameterMIDFREQ] = value;
-            changed = true;
+            runModelFrames(dynmodel, buffer, kBlockSize, channels, param1, param2);
+            return;
         }
 
-        value = params[kParameterMIDQ].getValue();
-        if (d_isNotEqual(cachedParams[kParameterMIDQ], value))
-        {
-            cachedParams[kParameterMIDQ] = value;
-            changed = true;
-        }
+        resampler.setChannels(channels);
 
-        value = params[kParameterMTYPE].getValue();
-        if (d_isNotEqual(cachedParams[kParameterMTYPE], value))
+        const uint32_t modelFrames = resampler.downsample(buffer);
+
+        // converters only write used channels, clear the rest of the last group of 4
+        for (uint32_t i = 0; i < modelFrames; ++i)
         {
-            cachedParams[kParameterMTYPE] = value;
-            changed = true;
+            for (int c = channels; c < PORT_MAX_CHANNELS && (c % 4) != 0; ++c)
+                resampler.modelBuffer[i][c] = 0.f;
         }
 
-        if (changed)
+        runModelFrames(dynmodel, resampler.modelBuffer, modelFrames, channels, param1, param2);
+
+        resampler.upsample(modelFrames, buffer);
+    }
+
+    // process a full sub-block, params and tone controls are only checked here at control rate
+    void processBlock(const ProcessArgs& args, const int channels)
+    {
+        const float blockTime = args.sampleTime * kBlockSize;
+        const float inlevelv = DB_CO(params[kParameterINLEVEL].getValue());
+        const float outlevelv = DB_CO(params[kParameterOUTLEVEL].getValue());
+
+        const bool net_bypass = params[kParameterNETBYPASS].getValue() > 0.5f;
+        const bool eq_bypass = params[kParameterEQBYPASS].getValue() > 0.5f;
+        const EqPos eq_pos = params[kParameterEQPOS].getValue() > 0.5f ? kEqPre : kEqPost;
+
+        // update filters, coefficients are calculated at most once per sub-block
+        float value = params[kParameterINLPF].getValue();
+        if (d_isNotEqual(cachedParams[kParameterINLPF], value))
         {
-            changed = false;
-            mid.setBiquad(getMidType() == kMidEqBandpass ? bq_type_bandpass : bq_type_peak,
-                          cachedParams[kParameterMIDFREQ] / args.sampleRate,
-                          cachedParams[kParameterMIDQ],
-                          cachedParams[kParameterMIDGAIN]);
+            cachedParams[kParameterINLPF] = value;
+
+            const BiquadCoefficients in_lpf = BiquadCoefficients::design(kBiquadLowpass,
+                                                                         MAP(value, 0.0f, 100.0f, INLPF_MAX_CO, INLPF_MIN_CO),
+                                                                         COMMON_Q,
+                                                                         0.0f);
+            for (ToneStack& ts : toneStacks)
+                ts.in_lpf.setSection(0, in_lpf);
         }
 
-        value = params[kParameterTREBLEGAIN].getValue();
-        if (d_isNotEqual(cachedParams[kParameterTREBLEGAIN], value))
+        bool eqChanged = false;
+
+        for (const int param : { kParameterBASSGAIN, kParameterBASSFREQ,
+                                 kParameterMIDGAIN, kParameterMIDFREQ, kParameterMIDQ, kParameterMTYPE,
+                                 kParameterTREBLEGAIN, kParameterTREBLEFREQ,
+                                 kParameterDEPTH, kParameterPRESENCE })
         {
-            cachedParams[kParameterTREBLEGAIN] = value;
-            changed = true;
+            value = params[param].getValue();
+            if (d_isNotEqual(cachedParams[param], value))
+            {
+                cachedParams[param] = value;
+                eqChanged = true;
+            }
         }
 
-        value = params[kParameterTREBLEFREQ].getValue();
-        if (d_isNotEqual(cachedParams[kParameterTREBLEFREQ], value))
+        if (eqChanged)
+            updateToneControls(args.sampleRate);
+
+        // levels are smoothed at control rate and interpolated linearly within the block
+        const float inlevelStart = inlevel.out;
+        const float inlevelStep = (inlevel.process(blockTime, inlevelv) - inlevelStart) / kBlockSize;
+        const float outlevelStart = outlevel.out * 10.f;
+        const float outlevelStep = (outlevel.process(blockTime, outlevelv) * 10.f - outlevelStart) / kBlockSize;
+
+        const int groups = (channels + 3) / 4;
+        const bool eq_pre = !eq_bypass && eq_pos == kEqPre;
+        const bool eq_post = !eq_bypass && eq_pos == kEqPost;
+
+        // blockOutput is used as work buffer from here on
+        for (int g = 0; g < groups; ++g)
         {
-            cachedParams[kParameterTREBLEFREQ] = value;
-            changed = true;
+            ToneStack& ts(toneStacks[g]);
+            float level = inlevelStart;
+
+            ts.in_lpf.beginBlock(kBlockSize);
+            if (eq_pre)
+                ts.eq.beginBlock(kBlockSize);
+
+            for (uint32_t i = 0; i < kBlockSize; ++i)
+            {
+                level += inlevelStep;
+
+                // High frequencies roll-off (lowpass)
+                simd::float_4 sample = ts.in_lpf.process(simd::float_4::load(blockInput[i] + g * 4) * 0.1f) * level;
+
+                // Equalizer section
+                if (eq_pre)
+                    sample = ts.eq.process(sample);
+
+                sample.store(blockOutput[i] + g * 4);
+            }
         }
 
-        if (changed)
+        // unused lanes of the last group of 4 channels must stay at zero
+        for (uint32_t i = 0; i < kBlockSize; ++i)
         {
-            changed = false;
-            treble.setBiquad(bq_type_highshelf,
-                             cachedParams[kParameterTREBLEFREQ] / args.sampleRate,
-                             COMMON_Q,
-                             cachedParams[kParameterTREBLEGAIN]);
+            for (int c = channels; c < PORT_MAX_CHANNELS && (c % 4) != 0; ++c)
+                blockOutput[i][c] = 0.f;
         }
 
-        value = params[kParameterDEPTH].getValue();
-        if (d_isNotEqual(cachedParams[kParameterDEPTH], value))
+        // pick up a newly loaded model, the old one gets faded out and retired.
+        // only one model can be retired at a time, so wait while a previous one is still around.
+        if (fadingModel == nullptr && retiredModel.load() == nullptr)
         {
-            cachedParams[kParameterDEPTH] = value;
-            depth.setPeakGain(value);
+            if (DynamicModel* const newmodel = pendingModel.exchange(nullptr))
+            {
+                if (model != nullptr)
+                {
+                    fadingModel = model;
+                    fadePos = 0;
+                }
+
+                model = newmodel;
+            }
         }
 
-        value = params[kParameterPRESENCE].getValue();
-        if (d_isNotEqual(cachedParams[kParameterPRESENCE], value))
+        // no need to fade while the network is bypassed
+        if (fadingModel != nullptr && net_bypass)
         {
-            cachedParams[kParameterPRESENCE] = value;
-            presence.setPeakGain(value);
+            retiredModel.store(fadingModel);
+            fadingModel = nullptr;
         }
 
-        // High frequencies roll-off (lowpass)
-        float sample = in_lpf.process(inputs[AUDIO_INPUT].getVoltage() * 0.1f) * inlevel.process(stime, inlevelv);
-
-        // Equalizer section
-        if (!eq_bypass && eq_pos == kEqPre)
-            sample = applyToneControls(sample);
-
         // run model
         if (!net_bypass && model != nullptr)
         {
-            activeModel.store(true);
-            sample = applyModel(model, sample,
-                                params[kParameterPARAM1].getValue(),
-                                params[kParameterPARAM2].getValue());
-            activeModel.store(false);
+            const float param1 = params[kParameterPARAM1].getValue();
+            const float param2 = params[kParameterPARAM2].getValue();
+
+            if (fadingModel != nullptr)
+            {
+                std::memcpy(fadeBuffer, blockOutput, sizeof(fadeBuffer));
+                runModel(fadingModel, fadeBuffer, channels, param1, param2);
+            }
+
+            runModel(model, blockOutput, channels, param1, param2);
+
+            if (fadingModel != nullptr)
+            {
+                for (uint32_t i = 0; i < kBlockSize; ++i)
+                {
+                    const float phase = static_cast<float>(fadePos + i + 1) / kFadeLength * static_cast<float>(M_PI_2);
+                    const float gainNew = std::sin(phase);
+                    const float gainOld = std::cos(phase);
+
+                    for (int c = 0; c < channels; ++c)
+                        blockOutput[i][c] = blockOutput[i][c] * gainNew + fadeBuffer[i][c] * gainOld;
+                }
+
+                fadePos += kBlockSize;
+
+                if (fadePos >= kFadeLength)
+                {
+                    retiredModel.store(fadingModel);
+                    fadingModel = nullptr;
+                }
+            }
         }
 
-        // DC blocker filter (highpass)
-        sample = dc_blocker.process(sample);
+        for (int g = 0; g < groups; ++g)
+        {
+            ToneStack& ts(toneStacks[g]);
+            float level = outlevelStart;
 
-        // Equalizer section
-        if (!eq_bypass && eq_pos == kEqPost)
-            sample = applyToneControls(sample);
+            ts.dc_blocker.beginBlock(kBlockSize);
+            if (eq_post)
+                ts.eq.beginBlock(kBlockSize);
 
-        // Output volume
-        outputs[AUDIO_OUTPUT].setVoltage(sample * outlevel.process(stime, outlevelv) * 10.f);
-#endif
+            for (uint32_t i = 0; i < kBlockSize; ++i)
+            {
+                level += outlevelStep;
+
+                // DC blocker filter (highpass)
+                simd::float_4 sample = ts.dc_blocker.process(simd::float_4::load(blockOutput[i] + g * 4));
+
+                // Equalizer section
+                if (eq_post)
+                    sample = ts.eq.process(sample);
+
+                // Output volume
+                sample *= level;
+                sample.store(blockOutput[i] + g * 4);
+            }
+        }
     }
 
-#ifndef QUICK_BUILD_TESTING
     void onSampleRateChange(const SampleRateChangeEvent& e) override
     {
         cachedParams[kParameterBASSGAIN] = params[kParameterBASSGAIN].getValue();
@@ -627,32 +1042,40 @@ struct AidaPluginModule : Module {
         cachedParams[kParameterDEPTH] = params[kParameterDEPTH].getValue();
         cachedParams[kParameterPRESENCE] = params[kParameterPRESENCE].getValue();
 
-        dc_blocker.setFc(35.0f / e.sampleRate);
+        // the engine is not processing during sample rate changes, so resamplers can be reallocated.
+        // a model waiting to be picked up is taken out briefly, only the loader can publish one meanwhile.
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(rateMutex);
+
+            hostSampleRate.store(static_cast<int>(e.sampleRate));
 
-        bass.setBiquad(bq_type_lowshelf,
-                       cachedParams[kParameterBASSFREQ] / e.sampleRate,
-                       COMMON_Q,
-                       cachedParams[kParameterBASSGAIN]);
+            DynamicModel* const pending = pendingModel.exchange(nullptr);
 
-        mid.setBiquad(getMidType() == kMidEqBandpass ? bq_type_bandpass : bq_type_peak,
-                      cachedParams[kParameterMIDFREQ] / e.sampleRate,
-                      cachedParams[kParameterMIDQ],
-                      cachedParams[kParameterMIDGAIN]);
+            for (DynamicModel* const dynmodel : { model, fadingModel, pending })
+            {
+                if (dynmodel == nullptr)
+                    continue;
 
-        treble.setBiquad(bq_type_highshelf,
-                         cachedParams[kParameterTREBLEFREQ] / e.sampleRate,
-                         COMMON_Q,
-                         cachedParams[kParameterTREBLEGAIN]);
+                dynmodel->resampler.configure(static_cast<int>(e.sampleRate), dynmodel->sample_rate);
+                printModelLatency(dynmodel);
+            }
 
-        depth.setBiquad(bq_type_peak,
-                        DEPTH_FREQ / e.sampleRate,
-                        COMMON_Q,
-                        cachedParams[kParameterDEPTH]);
+            pendingModel.store(pending);
+        }
 
-        presence.setBiquad(bq_type_highshelf,
-                           PRESENCE_FREQ / e.sampleRate,
-                           COMMON_Q,
-                           cachedParams[kParameterPRESENCE]);
+        const BiquadCoefficients dc_blocker = BiquadCoefficients::design(kBiquadHighpass,
+                                                                         35.0f / e.sampleRate,
+                                                                         COMMON_Q,
+                                                                         0.0f);
+        updateToneControls(e.sampleRate);
+
+        // no smoothing from coefficients of the old rate
+        for (ToneStack& ts : toneStacks)
+        {
+            ts.dc_blocker.setSection(0, dc_blocker);
+            ts.dc_blocker.snap();
+            ts.eq.snap();
+        }
     }
 #endif
 };
@@ -744,6 +1167,10 @@ struct AidaModelListWidget : ImGuiWidget {
         if (module->fileChanged)
             reloadDir();
 
+#ifndef QUICK_BUILD_TESTING
+        module->showLoadError();
+#endif
+
         ImGuiWidget::step();
     }
 
@@ -0,0 +1,279 @@
+/*
+ * AIDA-X Cardinal plugin
+ * Copyright (C) 2024 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Recurrent model evaluated for several voices at once, used for polyphonic processing.
+//
+// Weights are parsed once from the same json file RTNeural uses and shared by all voices, while each group of
+// voices keeps its own recurrent state. The math is written for a generic sample type, so `T = simd::float_4`
+// runs 4 voices in parallel lanes and `T = float` runs a single one. Weights are stored already broadcast to `T`,
+// trading memory for not having to splat every weight on each multiply.
+//
+// Supports the architectures listed in model_variant.hpp: one LSTM or GRU layer followed by a dense layer with
+// a single output. Weights follow the Keras layout, gates being i, f, c, o for LSTM and z, r, h for GRU.
+
+template <typename T>
+struct BatchedModelWeights {
+    enum Type {
+        kTypeLSTM,
+        kTypeGRU
+    };
+
+    Type type = kTypeLSTM;
+    int inputSize = 0;
+    int hiddenSize = 0;
+    int numGates = 0;
+
+    // one row per gate unit, so the inner loops read contiguous memory
+    std::vector<T> kernel;         // [numGates * hiddenSize][inputSize]
+    std::vector<T> recurrent;      // [numGates * hiddenSize][hiddenSize]
+    std::vector<T> bias;           // [numGates * hiddenSize]
+    std::vector<T> recurrentBias;  // [numGates * hiddenSize], GRU only
+    std::vector<T> dense;          // [hiddenSize]
+    T denseBias = 0.f;
+
+    bool isValid() const noexcept
+    {
+        return hiddenSize != 0;
+    }
+
+    /** Parse weights from an AIDA-X json model, throws on unexpected data like RTNeural does. */
+    void parseJson(const nlohmann::json& model_json)
+    {
+        const nlohmann::json& layers = model_json.at("layers");
+        const nlohmann::json& rnnLayer = layers.at(0);
+        const nlohmann::json& denseLayer = layers.at(1);
+
+        const std::string rnnType = rnnLayer.at("type").get<std::string>();
+
+        if (rnnType == "lstm")
+        {
+            type = kTypeLSTM;
+            numGates = 4;
+        }
+        else if (rnnType == "gru")
+        {
+            type = kTypeGRU;
+            numGates = 3;
+        }
+        else
+        {
+            throw std::invalid_argument("Unsupported recurrent layer type");
+        }
+
+        inputSize = model_json.at("in_shape").back().get<int>();
+        hiddenSize = rnnLayer.at("shape").back().get<int>();
+
+        // the recurrent product is unrolled by 4, all supported sizes are a multiple of it
+        if (hiddenSize <= 0 || hiddenSize % 4 != 0)
+            throw std::invalid_argument("Unsupported hidden size");
+
+        const int numUnits = numGates * hiddenSize;
+        const nlohmann::json& rnnWeights = rnnLayer.at("weights");
+
+        const std::vector<std::vector<float>> kernelJ = rnnWeights.at(0).get<std::vector<std::vector<float>>>();
+        const std::vector<std::vector<float>> recurrentJ = rnnWeights.at(1).get<std::vector<std::vector<float>>>();
+
+        if (static_cast<int>(kernelJ.size()) != inputSize || static_cast<int>(recurrentJ.size()) != hiddenSize)
+            throw std::invalid_argument("Unexpected recurrent layer weights shape");
+
+        kernel.resize(numUnits * inputSize);
+        recurrent.resize(numUnits * hiddenSize);
+        bias.assign(numUnits, T(0.f));
+        recurrentBias.assign(numUnits, T(0.f));
+
+        for (int u = 0; u < numUnits; ++u)
+        {
+            for (int i = 0; i < inputSize; ++i)
+                kernel[u * inputSize + i] = T(kernelJ.at(i).at(u));
+
+            for (int h = 0; h < hiddenSize; ++h)
+                recurrent[u * hiddenSize + h] = T(recurrentJ.at(h).at(u));
+        }
+
+        if (type == kTypeGRU)
+        {
+            // reset_after layout, input bias followed by recurrent bias
+            const std::vector<std::vector<float>> biasJ = rnnWeights.at(2).get<std::vector<std::vector<float>>>();
+
+            for (int u = 0; u < numUnits; ++u)
+            {
+                bias[u] = T(biasJ.at(0).at(u));
+                recurrentBias[u] = T(biasJ.at(1).at(u));
+            }
+        }
+        else
+        {
+            const std::vector<float> biasJ = rnnWeights.at(2).get<std::vector<float>>();
+
+            for (int u = 0; u < numUnits; ++u)
+                bias[u] = T(biasJ.at(u));
+        }
+
+        const nlohmann::json& denseWeights = denseLayer.at("weights");
+        const std::vector<std::vector<float>> denseJ = denseWeights.at(0).get<std::vector<std::vector<float>>>();
+
+        if (static_cast<int>(denseJ.size()) != hiddenSize)
+            throw std::invalid_argument("Unexpected dense layer weights shape");
+
+        dense.resize(hiddenSize);
+
+        for (int h = 0; h < hiddenSize; ++h)
+            dense[h] = T(denseJ[h].at(0));
+
+        denseBias = T(denseWeights.at(1).at(0).get<float>());
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+/**
+   Rational approximation of tanh, clamped to [-5, 5].
+   The error is below 1.1e-6 within [-3, 3] and peaks at about 9.6e-5 near the clamp points.
+   Only uses basic arithmetic so it runs the same on scalars and SIMD vectors.
+ */
+template <typename T>
+static inline
+T batchedTanh(T x) noexcept
+{
+    using std::fmin;
+    using std::fmax;
+
+    x = fmin(fmax(x, T(-5.f)), T(5.f));
+
+    const T x2 = x * x;
+    const T num = x * (T(135135.f) + x2 * (T(17325.f) + x2 * (T(378.f) + x2)));
+    const T den = T(135135.f) + x2 * (T(62370.f) + x2 * (T(3150.f) + x2 * T(28.f)));
+
+    return fmin(fmax(num / den, T(-1.f)), T(1.f));
+}
+
+template <typename T>
+static inline
+T batchedSigmoid(const T x) noexcept
+{
+    return T(0.5f) + T(0.5f) * batchedTanh(x * T(0.5f));
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+/**
+   Recurrent state of one group of voices.
+   Memory is allocated in `init`, processing does not allocate.
+ */
+template <typename T>
+struct BatchedModelState {
+    std::vector<T> hidden;
+    std::vector<T> cell;
+    std::vector<T> inputGates;
+    std::vector<T> recurrentGates;
+
+    void init(const BatchedModelWeights<T>& weights)
+    {
+        const int numUnits = weights.numGates * weights.hiddenSize;
+
+        hidden.resize(weights.hiddenSize);
+        cell.resize(weights.hiddenSize);
+        inputGates.resize(numUnits);
+        recurrentGates.resize(numUnits);
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        std::fill(hidden.begin(), hidden.end(), T(0.f));
+        std::fill(cell.begin(), cell.end(), T(0.f));
+    }
+};
+
+/**
+   Run one step of the model for a group of voices.
+   @a input must hold `weights.inputSize` values, the audio sample first followed by the conditioning params.
+ */
+template <typename T>
+static inline
+T batchedModelForward(const BatchedModelWeights<T>& weights, BatchedModelState<T>& state, const T* const input) noexcept
+{
+    const int inputSize = weights.inputSize;
+    const int hiddenSize = weights.hiddenSize;
+    const int numUnits = weights.numGates * hiddenSize;
+
+    const T* const kernel = weights.kernel.data();
+    const T* const recurrent = weights.recurrent.data();
+    T* const hidden = state.hidden.data();
+    T* const inputGates = state.inputGates.data();
+    T* const recurrentGates = state.recurrentGates.data();
+
+    // matrix products, kept apart for GRU since the reset gate only applies to the recurrent part
+    for (int u = 0; u < numUnits; ++u)
+    {
+        const T* const krow = kernel + u * inputSize;
+        const T* const rrow = recurrent + u * hiddenSize;
+
+        T xsum = weights.bias[u];
+        for (int i = 0; i < inputSize; ++i)
+            xsum += krow[i] * input[i];
+
+        // 4 independent accumulators to hide the add latency
+        T hsum0 = weights.recurrentBias[u];
+        T hsum1 = 0.f;
+        T hsum2 = 0.f;
+        T hsum3 = 0.f;
+        for (int h = 0; h < hiddenSize; h += 4)
+        {
+            hsum0 += rrow[h] * hidden[h];
+            hsum1 += rrow[h + 1] * hidden[h + 1];
+            hsum2 += rrow[h + 2] * hidden[h + 2];
+            hsum3 += rrow[h + 3] * hidden[h + 3];
+        }
+
+        inputGates[u] = xsum;
+        recurrentGates[u] = (hsum0 + hsum1) + (hsum2 + hsum3);
+    }
+
+    if (weights.type == BatchedModelWeights<T>::kTypeLSTM)
+    {
+        T* const cell = state.cell.data();
+
+        for (int h = 0; h < hiddenSize; ++h)
+        {
+            const T i = batchedSigmoid(inputGates[h] + recurrentGates[h]);
+            const T f = batchedSigmoid(inputGates[hiddenSize + h] + recurrentGates[hiddenSize + h]);
+            const T c = batchedTanh(inputGates[2 * hiddenSize + h] + recurrentGates[2 * hiddenSize + h]);
+            const T o = batchedSigmoid(inputGates[3 * hiddenSize + h] + recurrentGates[3 * hiddenSize + h]);
+
+            cell[h] = f * cell[h] + i * c;
+            hidden[h] = o * batchedTanh(cell[h]);
+        }
+    }
+    else
+    {
+        for (int h = 0; h < hiddenSize; ++h)
+        {
+            const T z = batchedSigmoid(inputGates[h] + recurrentGates[h]);
+            const T r = batchedSigmoid(inputGates[hiddenSize + h] + recurrentGates[hiddenSize + h]);
+            const T c = batchedTanh(inputGates[2 * hiddenSize + h] + r * recurrentGates[2 * hiddenSize + h]);
+
+            hidden[h] = z * hidden[h] + (T(1.f) - z) * c;
+        }
+    }
+
+    T out = weights.denseBias;
+    for (int h = 0; h < hiddenSize; ++h)
+        out += weights.dense[h] * hidden[h];
+
+    return out;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
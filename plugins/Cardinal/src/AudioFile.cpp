@@ -18,10 +18,9 @@
 #include "plugin.hpp"
 #include "plugincontext.hpp"
 #include "ModuleWidgets.hpp"
+#include "SampleCache.hpp"
 #include "extra/Runner.hpp"
 
-#include "CarlaNativePlugin.h"
-
 #ifndef HEADLESS
 # include "ImGuiWidget.hpp"
 # include "ghc/filesystem.hpp"
@@ -29,38 +28,11 @@
 
 #define BUFFER_SIZE 128
 
-// generates a warning if this is defined as anything else
-#define CARLA_API
-
-// --------------------------------------------------------------------------------------------------------------------
-
-std::size_t carla_getNativePluginCount() noexcept;
-const NativePluginDescriptor* carla_getNativePluginDescriptor(const std::size_t index) noexcept;
-
-// --------------------------------------------------------------------------------------------------------------------
-
-using namespace CARLA_BACKEND_NAMESPACE;
 using namespace DISTRHO_NAMESPACE;
 
-static uint32_t host_get_buffer_size(NativeHostHandle);
-static double host_get_sample_rate(NativeHostHandle);
-static bool host_is_offline(NativeHostHandle);
-static const NativeTimeInfo* host_get_time_info(NativeHostHandle handle);
-static bool host_write_midi_event(NativeHostHandle handle, const NativeMidiEvent* event);
-static void host_ui_midi_program_changed(NativeHostHandle handle, uint8_t channel, uint32_t bank, uint32_t program);
-static void host_ui_custom_data_changed(NativeHostHandle handle, const char* key, const char* value);
-static intptr_t host_dispatcher(NativeHostHandle handle, NativeHostDispatcherOpcode opcode, int32_t index, intptr_t value, void* ptr, float opt);
-
-static void host_ui_parameter_changed(NativeHostHandle, uint32_t, float) {}
-static void host_ui_midi_program_changed(NativeHostHandle, uint8_t, uint32_t, uint32_t) {}
-static void host_ui_custom_data_changed(NativeHostHandle, const char*, const char*) {}
-static const char* host_ui_open_file(NativeHostHandle, bool, const char*, const char*) { return nullptr; }
-static const char* host_ui_save_file(NativeHostHandle, bool, const char*, const char*) { return nullptr; }
-static void host_ui_closed(NativeHostHandle) {}
-
 // --------------------------------------------------------------------------------------------------------------------
 
-struct CarlaInternalPluginModule : Module, Runner {
+struct AudioFileModule : Module, Runner {
     enum ParamIds {
         NUM_PARAMS
     };
@@ -76,38 +48,36 @@ struct CarlaInternalPluginModule : Module, Runner {
         NUM_LIGHTS
     };
 
-    enum Parameters {
-        kParameterLooping,
-        kParameterHostSync,
-        kParameterVolume,
-        kParameterEnabled,
-        kParameterQuadChannels,
-        kParameterInfoChannels,
-        kParameterInfoBitRate,
-        kParameterInfoBitDepth,
-        kParameterInfoSampleRate,
-        kParameterInfoLength,
-        kParameterInfoPosition,
-        kParameterInfoPoolFill,
-        kParameterCount
-    };
-
     CardinalPluginContext* const pcontext;
 
-    const NativePluginDescriptor* fCarlaPluginDescriptor = nullptr;
-    NativePluginHandle fCarlaPluginHandle = nullptr;
-    NativeHostDescriptor fCarlaHostDescriptor = {};
-    NativeTimeInfo fCarlaTimeInfo;
-
-    float dataOut[NUM_OUTPUTS+1][BUFFER_SIZE];
-    float* dataOutPtr[NUM_OUTPUTS+1];
+    // sources are opened on the main thread, picked up by the audio thread at the next block,
+    // and closed back on the main thread once replaced
+    Mutex sourceMutex;
+    SampleSource* source = nullptr;
+    SampleSource* pendingSource = nullptr;
+    SampleSource* retiredSource = nullptr;
+    std::atomic<bool> pendingSourceChanged { false };
+
+    bool looping = true;
+    bool hostSync = false;
+
+    // playback position in file frames, keeps counting up across loops
+    int64_t playFrame = 0;
+    dsp::SampleRateConverter<2> resampler;
+    dsp::Frame<2> fileBuffer[BUFFER_SIZE];
+    uint fileBufferPos = 0;
+    uint fileBufferCount = 0;
+
+    dsp::Frame<2> dataOut[BUFFER_SIZE];
     unsigned audioDataFill = 0;
     uint32_t lastProcessCounter = 0;
     bool fileChanged = false;
     std::string currentFile;
 
+    // file shown in the waveform preview, only used on the main thread
+    std::shared_ptr<SampleFile> previewFile;
+
     struct {
-        float preview[108];
         uint channels;
         uint bitDepth;
         uint sampleRate;
@@ -115,7 +85,7 @@ struct CarlaInternalPluginModule : Module, Runner {
         float position;
     } audioInfo;
 
-    CarlaInternalPluginModule()
+    AudioFileModule()
         : pcontext(static_cast<CardinalPluginContext*>(APP))
     {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -123,109 +93,58 @@ struct CarlaInternalPluginModule : Module, Runner {
         configOutput(0, "Audio Left");
         configOutput(1, "Audio Right");
 
-        dataOutPtr[0] = dataOut[0];
-        dataOutPtr[1] = dataOut[1];
-        dataOutPtr[2] = dataOut[2];
-
         std::memset(dataOut, 0, sizeof(dataOut));
         std::memset(&audioInfo, 0, sizeof(audioInfo));
 
-        for (std::size_t i=0, count=carla_getNativePluginCount(); i<count; ++i)
-        {
-            const NativePluginDescriptor* const desc = carla_getNativePluginDescriptor(i);
-
-            if (std::strcmp(desc->label, "audiofile") != 0)
-                continue;
-
-            fCarlaPluginDescriptor = desc;
-            break;
-        }
-
-        DISTRHO_SAFE_ASSERT_RETURN(fCarlaPluginDescriptor != nullptr,);
-
-        memset(&fCarlaHostDescriptor, 0, sizeof(fCarlaHostDescriptor));
-        memset(&fCarlaTimeInfo, 0, sizeof(fCarlaTimeInfo));
-
-        fCarlaHostDescriptor.handle = this;
-        fCarlaHostDescriptor.resourceDir = "";
-        fCarlaHostDescriptor.uiName = "Cardinal";
-
-        fCarlaHostDescriptor.get_buffer_size = host_get_buffer_size;
-        fCarlaHostDescriptor.get_sample_rate = host_get_sample_rate;
-        fCarlaHostDescriptor.is_offline = host_is_offline;
-
-        fCarlaHostDescriptor.get_time_info = host_get_time_info;
-        fCarlaHostDescriptor.write_midi_event = host_write_midi_event;
-        fCarlaHostDescriptor.ui_parameter_changed = host_ui_parameter_changed;
-        fCarlaHostDescriptor.ui_midi_program_changed = host_ui_midi_program_changed;
-        fCarlaHostDescriptor.ui_custom_data_changed = host_ui_custom_data_changed;
-        fCarlaHostDescriptor.ui_closed = host_ui_closed;
-        fCarlaHostDescriptor.ui_open_file = host_ui_open_file;
-        fCarlaHostDescriptor.ui_save_file = host_ui_save_file;
-        fCarlaHostDescriptor.dispatcher = host_dispatcher;
-
-        fCarlaPluginHandle = fCarlaPluginDescriptor->instantiate(&fCarlaHostDescriptor);
-        DISTRHO_SAFE_ASSERT_RETURN(fCarlaPluginHandle != nullptr,);
-
-        fCarlaPluginDescriptor->activate(fCarlaPluginHandle);
-
-        // host-sync disabled by default
-        fCarlaPluginDescriptor->set_parameter_value(fCarlaPluginHandle, kParameterHostSync, 0.0f);
-
         startRunner(500);
     }
 
-    ~CarlaInternalPluginModule() override
+    ~AudioFileModule() override
     {
-        if (fCarlaPluginHandle == nullptr)
-            return;
-
         stopRunner();
-        fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
-        fCarlaPluginDescriptor->cleanup(fCarlaPluginHandle);
+
+        SampleCache& cache(SampleCache::getInstance());
+        cache.close(source);
+        cache.close(pendingSource);
+        cache.close(retiredSource);
     }
 
+    // close the source replaced by the audio thread, if any
     bool run() override
     {
-        fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_IDLE, 0, 0, nullptr, 0.0f);
+        SampleSource* retired;
+
+        {
+            const MutexLocker cml(sourceMutex);
+            retired = retiredSource;
+            retiredSource = nullptr;
+        }
+
+        SampleCache::getInstance().close(retired);
         return true;
     }
 
-    const NativeTimeInfo* hostGetTimeInfo() const noexcept
+    /** Change the file being played, an empty path unloads it. Not for the audio thread. */
+    void setFile(const char* const path)
     {
-        return &fCarlaTimeInfo;
-    }
+        SampleCache& cache(SampleCache::getInstance());
+        SampleSource* const newSource = path[0] != '\0' ? cache.open(path) : nullptr;
+        SampleSource* oldPending;
+        SampleSource* oldRetired;
+
+        previewFile = newSource != nullptr ? newSource->file : nullptr;
 
-    intptr_t hostDispatcher(const NativeHostDispatcherOpcode opcode,
-                            const int32_t index, const intptr_t value, void* const ptr, const float opt)
-    {
-        switch (opcode)
         {
-        // cannnot be supported
-        case NATIVE_HOST_OPCODE_HOST_IDLE:
-            break;
-        // other stuff
-        case NATIVE_HOST_OPCODE_NULL:
-        case NATIVE_HOST_OPCODE_UPDATE_PARAMETER:
-        case NATIVE_HOST_OPCODE_UPDATE_MIDI_PROGRAM:
-        case NATIVE_HOST_OPCODE_RELOAD_PARAMETERS:
-        case NATIVE_HOST_OPCODE_RELOAD_MIDI_PROGRAMS:
-        case NATIVE_HOST_OPCODE_RELOAD_ALL:
-        case NATIVE_HOST_OPCODE_UI_UNAVAILABLE:
-        case NATIVE_HOST_OPCODE_INTERNAL_PLUGIN:
-        case NATIVE_HOST_OPCODE_QUEUE_INLINE_DISPLAY:
-        case NATIVE_HOST_OPCODE_UI_TOUCH_PARAMETER:
-        case NATIVE_HOST_OPCODE_UI_RESIZE:
-            break;
-        case NATIVE_HOST_OPCODE_PREVIEW_BUFFER_DATA:
-            std::memcpy(audioInfo.preview, ptr, sizeof(audioInfo.preview));
-            break;
-        case NATIVE_HOST_OPCODE_GET_FILE_PATH:
-        case NATIVE_HOST_OPCODE_REQUEST_IDLE:
-            break;
+            const MutexLocker cml(sourceMutex);
+            oldPending = pendingSource;
+            oldRetired = retiredSource;
+            pendingSource = newSource;
+            retiredSource = nullptr;
+            pendingSourceChanged = true;
         }
 
-        return 0;
+        cache.close(oldPending);
+        cache.close(oldRetired);
     }
 
     json_t* dataToJson() override
@@ -234,17 +153,8 @@ struct CarlaInternalPluginModule : Module, Runner {
         DISTRHO_SAFE_ASSERT_RETURN(rootJ != nullptr, nullptr);
 
         json_object_set_new(rootJ, "filepath", json_string(currentFile.c_str()));
-
-        if (fCarlaPluginHandle != nullptr)
-        {
-            const bool looping = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle,
-                                                                             kParameterLooping) > 0.5f;
-            const bool hostSync = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle,
-                                                                              kParameterHostSync) > 0.5f;
-
-            json_object_set_new(rootJ, "looping", json_boolean(looping));
-            json_object_set_new(rootJ, "hostSync", json_boolean(hostSync));
-        }
+        json_object_set_new(rootJ, "looping", json_boolean(looping));
+        json_object_set_new(rootJ, "hostSync", json_boolean(hostSync));
 
         return rootJ;
     }
@@ -261,9 +171,7 @@ struct CarlaInternalPluginModule : Module, Runner {
             {
                 currentFile = filepath;
                 fileChanged = true;
-
-                if (fCarlaPluginHandle != nullptr)
-                    fCarlaPluginDescriptor->set_custom_data(fCarlaPluginHandle, "file", filepath);
+                setFile(filepath);
             }
         }
 
@@ -271,114 +179,118 @@ struct CarlaInternalPluginModule : Module, Runner {
         {
             currentFile.clear();
             fileChanged = true;
+            setFile("");
         }
 
-        if (fCarlaPluginHandle == nullptr)
-            return;
-
         if (json_t* const loopingJ = json_object_get(rootJ, "looping"))
-        {
-            const float value = json_boolean_value(loopingJ) ? 1.0f : 0.0f;
-            fCarlaPluginDescriptor->set_parameter_value(fCarlaPluginHandle, kParameterLooping, value);
-        }
+            looping = json_boolean_value(loopingJ);
 
         if (json_t* const hostSyncJ = json_object_get(rootJ, "hostSync"))
+            hostSync = json_boolean_value(hostSyncJ);
+    }
+
+    void process(const ProcessArgs& args) override
+    {
+        const unsigned k = audioDataFill++;
+
+        outputs[0].setVoltage(dataOut[k].samples[0] * 10.0f);
+        outputs[1].setVoltage(dataOut[k].samples[1] * 10.0f);
+
+        if (audioDataFill == BUFFER_SIZE)
         {
-            const float value = json_boolean_value(hostSyncJ) ? 1.0f : 0.0f;
-            fCarlaPluginDescriptor->set_parameter_value(fCarlaPluginHandle, kParameterHostSync, value);
+            audioDataFill = 0;
+            processBlock(args.sampleRate);
         }
     }
 
-    void process(const ProcessArgs&) override
+    void processBlock(const float sampleRate)
     {
-        if (fCarlaPluginHandle == nullptr)
+        // pick up a new source, unless the previous one was not closed yet
+        if (pendingSourceChanged && sourceMutex.tryLock())
+        {
+            if (retiredSource == nullptr)
+            {
+                retiredSource = source;
+                source = pendingSource;
+                pendingSource = nullptr;
+                pendingSourceChanged = false;
+
+                playFrame = 0;
+                fileBufferPos = fileBufferCount = 0;
+                std::memset(&audioInfo, 0, sizeof(audioInfo));
+            }
+
+            sourceMutex.unlock();
+        }
+
+        const uint32_t processCounter = pcontext->processCounter;
+        const bool newHostBlock = lastProcessCounter != processCounter;
+        lastProcessCounter = processCounter;
+
+        if (source == nullptr || ! source->isReady())
+        {
+            std::memset(dataOut, 0, sizeof(dataOut));
             return;
+        }
 
-        const unsigned k = audioDataFill++;
+        const SampleFile& file(*source->file);
 
-        outputs[0].setVoltage(dataOut[0][k] * 10.0f);
-        outputs[1].setVoltage(dataOut[1][k] * 10.0f);
+        audioInfo.channels = file.channels;
+        audioInfo.bitDepth = file.bitDepth;
+        audioInfo.sampleRate = file.sampleRate;
+        audioInfo.length = file.frames / std::max(1u, file.sampleRate);
 
-        if (audioDataFill == BUFFER_SIZE)
+        if (hostSync)
         {
-            const uint32_t processCounter = pcontext->processCounter;
+            if (! pcontext->playing)
+            {
+                std::memset(dataOut, 0, sizeof(dataOut));
+                return;
+            }
 
-            // Update time position if running a new audio block
-            if (lastProcessCounter != processCounter)
+            // follow the transport, ignoring the small drift that comes from resampling in blocks
+            if (newHostBlock)
             {
-                lastProcessCounter = processCounter;
-                fCarlaTimeInfo.playing = pcontext->playing;
-                fCarlaTimeInfo.frame = pcontext->frame;
+                const int64_t target = static_cast<int64_t>(pcontext->frame * file.sampleRate / sampleRate);
+
+                if (std::abs(target - playFrame) > BUFFER_SIZE * 4)
+                {
+                    playFrame = target;
+                    fileBufferPos = fileBufferCount = 0;
+                }
             }
-            // or advance time by BUFFER_SIZE frames if still under the same audio block
-            else if (fCarlaTimeInfo.playing)
+        }
+
+        resampler.setRates(file.sampleRate, sampleRate);
+
+        for (int outDone = 0; outDone < BUFFER_SIZE;)
+        {
+            if (fileBufferPos == fileBufferCount)
             {
-                fCarlaTimeInfo.frame += BUFFER_SIZE;
+                source->read(playFrame, BUFFER_SIZE, reinterpret_cast<float(*)[2]>(fileBuffer), looping);
+                playFrame += BUFFER_SIZE;
+                fileBufferPos = 0;
+                fileBufferCount = BUFFER_SIZE;
             }
 
-            audioDataFill = 0;
-            fCarlaPluginDescriptor->process(fCarlaPluginHandle, nullptr, dataOutPtr, BUFFER_SIZE, nullptr, 0);
+            int inFrames = fileBufferCount - fileBufferPos;
+            int outFrames = BUFFER_SIZE - outDone;
+            resampler.process(fileBuffer + fileBufferPos, &inFrames, dataOut + outDone, &outFrames);
 
-            audioInfo.channels = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoChannels);
-            audioInfo.bitDepth = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoBitDepth);
-            audioInfo.sampleRate = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoSampleRate);
-            audioInfo.length = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle,  kParameterInfoLength);
-            audioInfo.position = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoPosition);
+            fileBufferPos += inFrames;
+            outDone += outFrames;
         }
-    }
 
-    void onSampleRateChange(const SampleRateChangeEvent& e) override
-    {
-        if (fCarlaPluginHandle == nullptr)
-            return;
-
-        fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
-        fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_SAMPLE_RATE_CHANGED,
-                                           0, 0, nullptr, e.sampleRate);
-        fCarlaPluginDescriptor->activate(fCarlaPluginHandle);
+        const int64_t position = looping ? playFrame % file.frames : std::min(playFrame, file.frames);
+        audioInfo.position = static_cast<float>(position) * 100.f / file.frames;
     }
 };
 
-// -----------------------------------------------------------------------------------------------------------
-
-static uint32_t host_get_buffer_size(NativeHostHandle)
-{
-    return BUFFER_SIZE;
-}
-
-static double host_get_sample_rate(const NativeHostHandle handle)
-{
-    CardinalPluginContext* const pcontext = static_cast<CarlaInternalPluginModule*>(handle)->pcontext;
-    DISTRHO_SAFE_ASSERT_RETURN(pcontext != nullptr, 48000.0);
-    return pcontext->sampleRate;
-}
-
-static bool host_is_offline(NativeHostHandle)
-{
-    return false;
-}
-
-static const NativeTimeInfo* host_get_time_info(const NativeHostHandle handle)
-{
-    return static_cast<CarlaInternalPluginModule*>(handle)->hostGetTimeInfo();
-}
-
-static bool host_write_midi_event(NativeHostHandle, const NativeMidiEvent*)
-{
-    return false;
-}
-
-static intptr_t host_dispatcher(const NativeHostHandle handle, const NativeHostDispatcherOpcode opcode,
-                                const int32_t index, const intptr_t value, void* const ptr, const float opt)
-{
-    return static_cast<CarlaInternalPluginModule*>(handle)->hostDispatcher(opcode, index, value, ptr, opt);
-}
-
 // --------------------------------------------------------------------------------------------------------------------
 
 #ifndef HEADLESS
 struct AudioFileListWidget : ImGuiWidget {
-    CarlaInternalPluginModule* const module;
+    AudioFileModule* const module;
 
     bool showError = false;
     String errorMessage;
@@ -391,7 +303,7 @@ struct AudioFileListWidget : ImGuiWidget {
     std::vector<ghcFile> currentFiles;
     size_t selectedFile = (size_t)-1;
 
-    AudioFileListWidget(CarlaInternalPluginModule* const m)
+    AudioFileListWidget(AudioFileModule* const m)
         : ImGuiWidget(),
           module(m)
     {
@@ -446,7 +358,7 @@ struct AudioFileListWidget : ImGuiWidget {
                     {
                         selectedFile = i;
                         module->currentFile = currentFiles[i].full;
-                        module->fCarlaPluginDescriptor->set_custom_data(module->fCarlaPluginHandle, "file", currentFiles[i].full.c_str());
+                        module->setFile(currentFiles[i].full.c_str());
                     }
                 }
 
@@ -529,13 +441,19 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
     static constexpr const float startY_list = startY - 2.0f;
     static constexpr const float fileListHeight = 380.0f - startY_list - previewBoxHeight - previewBoxBottom * 1.5f;
     static constexpr const float startY_preview = startY_list + fileListHeight;
+    static constexpr const uint previewColumns = 15 * 23 - 22;
+    static constexpr const float maxPreviewZoom = 65536.0f;
 
-    CarlaInternalPluginModule* const module;
+    AudioFileModule* const module;
     bool idleCallbackActive = false;
     bool visible = false;
     float lastPosition = 0.0f;
 
-    AudioFileWidget(CarlaInternalPluginModule* const m)
+    // 1 shows the whole file, higher values show less of it around the play position
+    float previewZoom = 1.0f;
+    SamplePeaks::Bin previewPeaks[previewColumns];
+
+    AudioFileWidget(AudioFileModule* const m)
         : module(m)
     {
         setModule(module);
@@ -568,24 +486,10 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
 
         if (module != nullptr && module->audioInfo.channels != 0)
         {
-            const float audioPreviewBarHeight = previewBoxRect[3] - 20.0f;
-            const size_t position = (module->audioInfo.position * 0.01f) * ARRAY_SIZE(module->audioInfo.preview);
-
-            nvgFillColor(args.vg, nvgRGBAf(0.839f, 0.459f, 0.086f, alpha));
+            const SampleFile* const file = module->previewFile.get();
 
-            for (size_t i=0; i<ARRAY_SIZE(module->audioInfo.preview); ++i)
-            {
-                const float value = module->audioInfo.preview[i];
-                const float height = std::max(0.01f, value * audioPreviewBarHeight);
-                const float y = previewBoxRect[1] + audioPreviewBarHeight - height;
-
-                if (position == i)
-                    nvgFillColor(args.vg, nvgRGBAf(1.0f, 1.0f, 1.0f, alpha));
-
-                nvgBeginPath(args.vg);
-                nvgRect(args.vg, previewBoxRect[0] + 3 + 3 * i, y + 2, 2, height);
-                nvgFill(args.vg);
-            }
+            if (file != nullptr && file->peaksReady.load(std::memory_order_acquire))
+                drawPreviewWaveform(args.vg, *file, alpha);
 
             std::snprintf(textInfo, sizeof(textInfo), "%s %d-Bit, %.1fkHz, %dm%02ds",
                           module->audioInfo.channels == 1 ? "Mono" : module->audioInfo.channels == 2 ? "Stereo" : "Other",
@@ -606,6 +510,54 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
         nvgText(args.vg, previewBoxRect[0] + 4, previewBoxRect[1] + previewBoxRect[3] - 6, textInfo, nullptr);
     }
 
+    // one min/max line per column, read from the peak level matching the visible range
+    void drawPreviewWaveform(NVGcontext* const vg, const SampleFile& file, const float alpha)
+    {
+        const float waveformHeight = previewBoxRect[3] - 20.0f;
+        const float startX = previewBoxRect[0] + 3;
+        const float centerY = previewBoxRect[1] + 2 + waveformHeight * 0.5f;
+
+        const int64_t frames = file.frames;
+        const int64_t position = static_cast<int64_t>(module->audioInfo.position * 0.01 * frames);
+        const int64_t range = std::max<int64_t>(previewColumns, static_cast<int64_t>(frames / previewZoom));
+        const int64_t start = std::max<int64_t>(0, std::min(position - range / 2, frames - range));
+
+        file.peaks.get(start, start + range, previewPeaks, previewColumns);
+
+        nvgBeginPath(vg);
+
+        for (uint i = 0; i < previewColumns; ++i)
+        {
+            const float top = centerY - clamp(previewPeaks[i].max, -1.f, 1.f) * waveformHeight * 0.5f;
+            const float bottom = centerY - clamp(previewPeaks[i].min, -1.f, 1.f) * waveformHeight * 0.5f;
+            nvgRect(vg, startX + i, top, 1, std::max(0.5f, bottom - top));
+        }
+
+        nvgFillColor(vg, nvgRGBAf(0.839f, 0.459f, 0.086f, alpha));
+        nvgFill(vg);
+
+        const float positionX = startX + static_cast<float>(position - start) * previewColumns / range;
+
+        nvgBeginPath(vg);
+        nvgRect(vg, positionX, previewBoxRect[1] + 2, 1, waveformHeight);
+        nvgFillColor(vg, nvgRGBAf(1.0f, 1.0f, 1.0f, alpha));
+        nvgFill(vg);
+    }
+
+    void onHoverScroll(const HoverScrollEvent& e) override
+    {
+        if (module != nullptr
+            && e.pos.x >= previewBoxRect[0] && e.pos.x < previewBoxRect[0] + previewBoxRect[2]
+            && e.pos.y >= previewBoxRect[1] && e.pos.y < previewBoxRect[1] + previewBoxRect[3])
+        {
+            previewZoom = clamp(previewZoom * (e.scrollDelta.y > 0.0f ? 1.25f : 0.8f), 1.0f, maxPreviewZoom);
+            e.consume(this);
+            return;
+        }
+
+        ModuleWidget::onHoverScroll(e);
+    }
+
     void draw(const DrawArgs& args) override
     {
         drawBackground(args.vg);
@@ -638,24 +590,20 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
     {
         menu->addChild(new ui::MenuSeparator);
 
-        const bool looping = module->fCarlaPluginDescriptor->get_parameter_value(module->fCarlaPluginHandle,
-            CarlaInternalPluginModule::kParameterLooping) > 0.5f;
-        const bool hostSync = module->fCarlaPluginDescriptor->get_parameter_value(module->fCarlaPluginHandle,
-            CarlaInternalPluginModule::kParameterHostSync) > 0.5f;
+        const bool looping = module->looping;
+        const bool hostSync = module->hostSync;
 
         menu->addChild(createMenuItem("Looping", looping ? CHECKMARK_STRING : "",
-            [=]() { module->fCarlaPluginDescriptor->set_parameter_value(module->fCarlaPluginHandle,
-                        CarlaInternalPluginModule::kParameterLooping, looping ? 0.0f : 1.0f); }
+            [=]() { module->looping = !looping; }
         ));
         menu->addChild(createMenuItem("Host sync", hostSync ? CHECKMARK_STRING : "",
-            [=]() { module->fCarlaPluginDescriptor->set_parameter_value(module->fCarlaPluginHandle,
-                        CarlaInternalPluginModule::kParameterHostSync, hostSync ? 0.0f : 1.0f); }
+            [=]() { module->hostSync = !hostSync; }
         ));
 
         struct LoadAudioFileItem : MenuItem {
-            CarlaInternalPluginModule* const module;
+            AudioFileModule* const module;
 
-            LoadAudioFileItem(CarlaInternalPluginModule* const m)
+            LoadAudioFileItem(AudioFileModule* const m)
                 : module(m)
             {
                 text = "Load audio file...";
@@ -663,7 +611,7 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
 
             void onAction(const event::Action&) override
             {
-                CarlaInternalPluginModule* const module = this->module;
+                AudioFileModule* const module = this->module;
                 async_dialog_filebrowser(false, nullptr, nullptr, text.c_str(), [module](char* path)
                 {
                     if (path == nullptr)
@@ -671,7 +619,7 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
 
                     module->currentFile = path;
                     module->fileChanged = true;
-                    module->fCarlaPluginDescriptor->set_custom_data(module->fCarlaPluginHandle, "file", path);
+                    module->setFile(path);
                     std::free(path);
                 });
             }
@@ -682,7 +630,7 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
 };
 #else
 struct AudioFileWidget : ModuleWidget {
-    AudioFileWidget(CarlaInternalPluginModule* const module) {
+    AudioFileWidget(AudioFileModule* const module) {
         setModule(module);
 
         addOutput(createOutput<PJ301MPort>({}, module, 0));
@@ -693,6 +641,6 @@ struct AudioFileWidget : ModuleWidget {
 
 // --------------------------------------------------------------------------------------------------------------------
 
-Model* modelAudioFile = createModel<CarlaInternalPluginModule, AudioFileWidget>("AudioFile");
+Model* modelAudioFile = createModel<AudioFileModule, AudioFileWidget>("AudioFile");
 
 // --------------------------------------------------------------------------------------------------------------------
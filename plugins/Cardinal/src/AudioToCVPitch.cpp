@@ -20,6 +20,8 @@
 #include "ModuleWidgets.hpp"
 #include "Widgets.hpp"
 
+#include "extra/Thread.hpp"
+
 extern "C" {
 #include "aubio.h"
 }
@@ -27,8 +29,17 @@ extern "C" {
 // --------------------------------------------------------------------------------------------------------------------
 
 // aubio setup values (tested under 48 kHz sample rate)
-static constexpr const uint32_t kAubioHopSize = 1;
-static constexpr const uint32_t kAubioBufferSize = (1024 + 256 + 128) / kAubioHopSize;
+static constexpr const uint32_t kAubioHopSize = 256;
+static constexpr const uint32_t kAubioBufferSize = 1536;
+
+// detection runs on a worker thread, results are applied this many hops after their analysis window ends.
+// this gives the worker time to run while keeping a fixed latency of kAubioHopSize * kResultDelayHops samples.
+static constexpr const uint32_t kResultDelayHops = 2;
+static constexpr const uint32_t kResultDelayFrames = kAubioHopSize * kResultDelayHops;
+
+// ring sizes, must be powers of 2
+static constexpr const uint32_t kInputRingSize = 4096;
+static constexpr const uint32_t kResultRingSize = 128;
 
 // default values
 static constexpr const float kDefaultSensitivity = 50.f;
@@ -38,6 +49,137 @@ static constexpr const float kDefaultThreshold = 12.5f;
 // static checks
 static_assert(sizeof(smpl_t) == sizeof(float), "smpl_t is float");
 static_assert(kAubioBufferSize % kAubioHopSize == 0, "kAubioBufferSize / kAubioHopSize has no remainder");
+static_assert(kInputRingSize >= kAubioBufferSize * 2, "input ring can hold a few analysis windows");
+static_assert(kResultRingSize >= PORT_MAX_CHANNELS * (kResultDelayHops + 2), "result ring can hold all results in flight");
+
+// --------------------------------------------------------------------------------------------------------------------
+
+struct PitchInputFrame {
+    uint64_t frame; // audio thread frame counter, gaps mean input was dropped
+    float samples[PORT_MAX_CHANNELS];
+    int channels;
+};
+
+struct PitchResult {
+    uint64_t frame; // frame at which the analysis window ended
+    int channel;
+    float pitchInHz;
+    float confidence;
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Pitch detection for up to 16 channels, running on a worker thread.
+//
+// Only the sliding analysis window is kept per channel, a single aubio detector provides the FFT setup and scratch
+// buffers for all of them. Hops of each channel are offset from each other by kAubioHopSize / channels frames,
+// so the detections are spread evenly over time instead of all channels running on the same frame.
+
+struct PolyPitchDetector {
+    aubio_pitch_t* detector = nullptr;
+    fvec_t* const detectedPitch = new_fvec(1);
+    fvec_t* windows[PORT_MAX_CHANNELS];
+    uint32_t hopFill[PORT_MAX_CHANNELS] = {};
+    int channels = 0;
+    uint64_t frame = 0;
+    float lastUsedTolerance = kDefaultTolerance;
+
+    PolyPitchDetector()
+    {
+        for (int c = 0; c < PORT_MAX_CHANNELS; ++c)
+            windows[c] = new_fvec(kAubioBufferSize);
+    }
+
+    ~PolyPitchDetector()
+    {
+        if (detector != nullptr)
+            del_aubio_pitch(detector);
+
+        for (int c = 0; c < PORT_MAX_CHANNELS; ++c)
+            del_fvec(windows[c]);
+
+        del_fvec(detectedPitch);
+    }
+
+    void setSampleRate(const float sampleRate)
+    {
+        float tolerance;
+
+        if (detector != nullptr)
+        {
+            tolerance = aubio_pitch_get_tolerance(detector);
+            del_aubio_pitch(detector);
+        }
+        else
+        {
+            tolerance = kDefaultTolerance * 0.01f;
+        }
+
+        // windows are slided here, so the detector always gets a full window as hop
+        detector = new_aubio_pitch("yinfast", kAubioBufferSize, kAubioBufferSize, sampleRate);
+        DISTRHO_SAFE_ASSERT_RETURN(detector != nullptr,);
+
+        aubio_pitch_set_silence(detector, -30.0f);
+        aubio_pitch_set_tolerance(detector, tolerance);
+        aubio_pitch_set_unit(detector, "Hz");
+
+        channels = 0;
+        frame = 0;
+    }
+
+    void setTolerance(const float tolerance)
+    {
+        if (d_isNotEqual(lastUsedTolerance, tolerance))
+        {
+            lastUsedTolerance = tolerance;
+            aubio_pitch_set_tolerance(detector, tolerance * 0.01f);
+        }
+    }
+
+    /* Feed one input frame, @a resultCallback is called as `func(result)` for each detection */
+    template <class Func>
+    void process(const PitchInputFrame& input, Func&& resultCallback)
+    {
+        // windows cannot be continued over a change of channels or dropped input, start them over.
+        // frames follow the audio thread counter, so results stay aligned to it after a gap.
+        if (channels != input.channels || input.frame != frame + 1)
+        {
+            channels = input.channels;
+
+            for (int c = 0; c < channels; ++c)
+            {
+                fvec_zeros(windows[c]);
+                hopFill[c] = (c * kAubioHopSize) / channels;
+            }
+        }
+
+        frame = input.frame;
+
+        for (int c = 0; c < channels; ++c)
+        {
+            smpl_t* const data = windows[c]->data;
+
+            // the window tail is filled one hop at a time, slided once the hop is complete
+            data[kAubioBufferSize - kAubioHopSize + hopFill[c]] = input.samples[c];
+
+            if (++hopFill[c] != kAubioHopSize)
+                continue;
+
+            hopFill[c] = 0;
+
+            aubio_pitch_do(detector, windows[c], detectedPitch);
+
+            const PitchResult result = {
+                frame,
+                c,
+                fvec_get_sample(detectedPitch, 0),
+                aubio_pitch_get_confidence(detector)
+            };
+            resultCallback(result);
+
+            std::memmove(data, data + kAubioHopSize, sizeof(smpl_t) * (kAubioBufferSize - kAubioHopSize));
+        }
+    }
+};
 
 // --------------------------------------------------------------------------------------------------------------------
 
@@ -56,6 +198,7 @@ struct AudioToCVPitch : Module {
     enum OutputIds {
         CV_PITCH,
         CV_GATE,
+        CV_CONFIDENCE,
         NUM_OUTPUTS
     };
     enum LightIds {
@@ -66,20 +209,64 @@ struct AudioToCVPitch : Module {
     bool smooth = true;
     int octave = 0;
 
+    // first channel, for display
     float lastKnownPitchInHz = 0.f;
     float lastKnownPitchConfidence = 0.f;
 
-    float lastUsedTolerance = kDefaultTolerance;
-    float lastUsedOutputPitch = 0.f;
-    float lastUsedOutputSignal = 0.f;
-
-    fvec_t* const detectedPitch = new_fvec(1);
-    fvec_t* const inputBuffer = new_fvec(kAubioBufferSize);
-    uint32_t inputBufferPos = 0;
-
-    aubio_pitch_t* pitchDetector = nullptr;
+    // audio thread side
+    float lastUsedOutputPitch[PORT_MAX_CHANNELS] = {};
+    float lastUsedOutputSignal[PORT_MAX_CHANNELS] = {};
+    float lastUsedOutputConfidence[PORT_MAX_CHANNELS] = {};
+    dsp::SlewLimiter smoothOutputSignal[PORT_MAX_CHANNELS];
+    uint64_t frameCount = 0;
+    uint32_t hopPos = 0;
+    bool droppingInput = false;
+    PitchResult pendingResult = {};
+    bool hasPendingResult = false;
+
+    // lock-free handoff between audio and worker threads
+    dsp::RingBuffer<PitchInputFrame, kInputRingSize> inputRing;
+    dsp::RingBuffer<PitchResult, kResultRingSize> resultRing;
+    std::atomic<float> tolerance { kDefaultTolerance };
+
+    // worker thread side
+    PolyPitchDetector detector;
+
+    struct PitchWorker : DISTRHO_NAMESPACE::Thread {
+        AudioToCVPitch* const module;
+        DISTRHO_NAMESPACE::Signal signal;
+
+        PitchWorker(AudioToCVPitch* const m)
+            : Thread("AudioToCVPitch detector"),
+              module(m) {}
+
+        void stop()
+        {
+            signalThreadShouldExit();
+            signal.signal();
+            stopThread(-1);
+        }
 
-    dsp::SlewLimiter smoothOutputSignal;
+        void run() override
+        {
+            while (! shouldThreadExit())
+            {
+                // signaled by the audio thread once per hop
+                signal.wait();
+
+                module->detector.setTolerance(module->tolerance.load());
+
+                while (! module->inputRing.empty())
+                {
+                    module->detector.process(module->inputRing.shift(), [this](const PitchResult& result)
+                    {
+                        if (! module->resultRing.full())
+                            module->resultRing.push(result);
+                    });
+                }
+            }
+        }
+    } worker { this };
 
     AudioToCVPitch()
     {
@@ -88,6 +275,7 @@ struct AudioToCVPitch : Module {
         configInput(AUDIO_INPUT, "Audio");
         configOutput(CV_PITCH, "Pitch");
         configOutput(CV_GATE, "Gate");
+        configOutput(CV_CONFIDENCE, "Confidence");
         configParam(PARAM_SENSITIVITY, 0.1f, 99.f, kDefaultSensitivity, "Sensitivity", " %");
         configParam(PARAM_CONFIDENCETHRESHOLD, 0.f, 99.f, kDefaultThreshold, "Confidence Threshold", " %");
         configParam(PARAM_TOLERANCE, 0.f, 99.f,  kDefaultTolerance, "Tolerance", " %");
@@ -95,62 +283,115 @@ struct AudioToCVPitch : Module {
 
     ~AudioToCVPitch() override
     {
-        if (pitchDetector != nullptr)
-            del_aubio_pitch(pitchDetector);
-        del_fvec(detectedPitch);
-        del_fvec(inputBuffer);
+        worker.stop();
     }
 
     void process(const ProcessArgs& args) override
     {
-        float cvPitch = lastUsedOutputPitch;
-        float cvSignal = lastUsedOutputSignal;
+        const int channels = std::max(1, inputs[AUDIO_INPUT].getChannels());
+        const float sensitivity = params[PARAM_SENSITIVITY].getValue() * 0.1f;
+
+        ++frameCount;
+
+        // constant cost per sample, detection itself happens on the worker thread.
+        // if the worker falls behind input is dropped until the next hop, never blocking the audio thread.
+        if (! droppingInput && inputRing.full())
+            droppingInput = true;
+
+        if (! droppingInput)
+        {
+            PitchInputFrame frame;
+            frame.frame = frameCount;
+            frame.channels = channels;
+
+            for (int c = 0; c < channels; ++c)
+                frame.samples[c] = inputs[AUDIO_INPUT].getVoltage(c) * sensitivity;
+
+            inputRing.push(frame);
+        }
+
+        if (++hopPos == kAubioHopSize)
+        {
+            hopPos = 0;
+            droppingInput = false;
+            tolerance.store(params[PARAM_TOLERANCE].getValue());
+            worker.signal.signal();
+        }
 
-        inputBuffer->data[inputBufferPos] = inputs[AUDIO_INPUT].getVoltage() * 0.1f
-                                          * params[PARAM_SENSITIVITY].getValue();
+        applyPitchResults();
 
-        if (++inputBufferPos == kAubioBufferSize)
+        outputs[CV_PITCH].setChannels(channels);
+        outputs[CV_GATE].setChannels(channels);
+        outputs[CV_CONFIDENCE].setChannels(channels);
+
+        for (int c = 0; c < channels; ++c)
         {
-            inputBufferPos = 0;
+            const float cvPitch = lastUsedOutputPitch[c];
+            outputs[CV_PITCH].setVoltage(smooth ? smoothOutputSignal[c].process(args.sampleTime, cvPitch) : cvPitch, c);
+            outputs[CV_GATE].setVoltage(lastUsedOutputSignal[c], c);
+            outputs[CV_CONFIDENCE].setVoltage(lastUsedOutputConfidence[c], c);
+        }
+    }
 
-            const float tolerance = params[PARAM_TOLERANCE].getValue();
-            if (d_isNotEqual(lastUsedTolerance, tolerance))
+    /* Apply results from the worker thread that are due */
+    void applyPitchResults()
+    {
+        for (;;)
+        {
+            if (! hasPendingResult)
             {
-                lastUsedTolerance = tolerance;
-                aubio_pitch_set_tolerance(pitchDetector, tolerance * 0.01f);
+                if (resultRing.empty())
+                    return;
+
+                pendingResult = resultRing.shift();
+                hasPendingResult = true;
             }
 
-            aubio_pitch_do(pitchDetector, inputBuffer, detectedPitch);
-            const float detectedPitchInHz = fvec_get_sample(detectedPitch, 0);
-            const float pitchConfidence = aubio_pitch_get_confidence(pitchDetector);
+            if (pendingResult.frame + kResultDelayFrames > frameCount)
+                return;
 
-            if (detectedPitchInHz > 0.f && pitchConfidence >=  params[PARAM_CONFIDENCETHRESHOLD].getValue() * 0.01f)
-            {
-                const float linearPitch = 12.f * (log2f(detectedPitchInHz / 440.f) + octave - 5) + 69.f;
-                cvPitch = std::max(-10.f, std::min(10.f, linearPitch * (1.f/12.f)));
+            hasPendingResult = false;
+            applyPitch(pendingResult.channel, pendingResult.pitchInHz, pendingResult.confidence);
+        }
+    }
+
+    void applyPitch(const int c, const float detectedPitchInHz, const float pitchConfidence)
+    {
+        float cvPitch = lastUsedOutputPitch[c];
+        float cvSignal;
+
+        if (detectedPitchInHz > 0.f && pitchConfidence >=  params[PARAM_CONFIDENCETHRESHOLD].getValue() * 0.01f)
+        {
+            const float linearPitch = 12.f * (log2f(detectedPitchInHz / 440.f) + octave - 5) + 69.f;
+            cvPitch = std::max(-10.f, std::min(10.f, linearPitch * (1.f/12.f)));
+            cvSignal = 10.f;
+
+            if (c == 0)
                 lastKnownPitchInHz = detectedPitchInHz;
-                cvSignal = 10.f;
-            }
-            else
+        }
+        else
+        {
+            if (! holdOutputPitch)
             {
-                if (! holdOutputPitch)
-                    lastKnownPitchInHz = cvPitch = 0.0f;
+                cvPitch = 0.0f;
 
-                cvSignal = 0.f;
+                if (c == 0)
+                    lastKnownPitchInHz = 0.0f;
             }
 
-            lastKnownPitchConfidence = pitchConfidence;
-            lastUsedOutputPitch = cvPitch;
-            lastUsedOutputSignal = cvSignal;
+            cvSignal = 0.f;
         }
 
-        outputs[CV_PITCH].setVoltage(smooth ? smoothOutputSignal.process(args.sampleTime, cvPitch) : cvPitch);
-        outputs[CV_GATE].setVoltage(cvSignal);
+        if (c == 0)
+            lastKnownPitchConfidence = pitchConfidence;
+
+        lastUsedOutputPitch[c] = cvPitch;
+        lastUsedOutputSignal[c] = cvSignal;
+        lastUsedOutputConfidence[c] = std::max(0.f, std::min(10.f, pitchConfidence * 10.f));
     }
 
     void onReset() override
     {
-        inputBufferPos = 0;
         smooth = true;
         holdOutputPitch = true;
         octave = 0;
@@ -158,28 +399,26 @@ struct AudioToCVPitch : Module {
 
     void onSampleRateChange(const SampleRateChangeEvent& e) override
     {
-        float tolerance;
+        // the engine is not processing at this point, only the worker needs to be stopped
+        worker.stop();
 
-        if (pitchDetector != nullptr)
-        {
-            tolerance = aubio_pitch_get_tolerance(pitchDetector);
-            del_aubio_pitch(pitchDetector);
-        }
-        else
+        detector.setSampleRate(e.sampleRate);
+
+        const double fall = 1.0 / (double(kAubioHopSize) / e.sampleRate);
+        for (dsp::SlewLimiter& slew : smoothOutputSignal)
         {
-            tolerance = kDefaultTolerance * 0.01f;
+            slew.reset();
+            slew.setRiseFall(fall, fall);
         }
 
-        pitchDetector = new_aubio_pitch("yinfast", kAubioBufferSize, kAubioHopSize, e.sampleRate);
-        DISTRHO_SAFE_ASSERT_RETURN(pitchDetector != nullptr,);
-
-        aubio_pitch_set_silence(pitchDetector, -30.0f);
-        aubio_pitch_set_tolerance(pitchDetector, tolerance);
-        aubio_pitch_set_unit(pitchDetector, "Hz");
+        inputRing.clear();
+        resultRing.clear();
+        hasPendingResult = false;
+        frameCount = 0;
+        hopPos = 0;
+        droppingInput = false;
 
-        const double fall = 1.0 / (double(kAubioBufferSize) / e.sampleRate);
-        smoothOutputSignal.reset();
-        smoothOutputSignal.setRiseFall(fall, fall);
+        worker.startThread();
     }
 
     json_t* dataToJson() override
@@ -228,7 +467,9 @@ struct AudioToCVPitchWidget : ModuleWidgetWith9HP {
     static constexpr const float startY_top = 71.0f;
     static constexpr const float startY_cv1 = 115.0f;
     static constexpr const float startY_cv2 = 145.0f;
+    static constexpr const float startY_knobs = 262.0f;
     static constexpr const float padding = 32.0f;
+    static constexpr const float knobPadding = 40.0f;
 
     AudioToCVPitch* const module;
     std::string monoFontPath;
@@ -245,18 +486,19 @@ struct AudioToCVPitchWidget : ModuleWidgetWith9HP {
         addInput(createInput<PJ301MPort>(Vec(startX, startY_cv1 + 0 * padding), m, AudioToCVPitch::AUDIO_INPUT));
         addOutput(createOutput<PJ301MPort>(Vec(startX, startY_cv2 + 0 * padding), m, AudioToCVPitch::CV_PITCH));
         addOutput(createOutput<PJ301MPort>(Vec(startX, startY_cv2 + 1 * padding), m, AudioToCVPitch::CV_GATE));
+        addOutput(createOutput<PJ301MPort>(Vec(startX, startY_cv2 + 2 * padding), m, AudioToCVPitch::CV_CONFIDENCE));
 
-        SmallPercentageNanoKnob* knobSens = createParamCentered<SmallPercentageNanoKnob>(Vec(box.size.x * 0.5f, startY_cv2 + 85.f),
+        SmallPercentageNanoKnob* knobSens = createParamCentered<SmallPercentageNanoKnob>(Vec(box.size.x * 0.5f, startY_knobs),
                                                                                          module, AudioToCVPitch::PARAM_SENSITIVITY);
         knobSens->displayString = "50 %";
         addChild(knobSens);
 
-        SmallPercentageNanoKnob* knobTolerance = createParamCentered<SmallPercentageNanoKnob>(Vec(box.size.x * 0.5f, startY_cv2 + 135.f),
+        SmallPercentageNanoKnob* knobTolerance = createParamCentered<SmallPercentageNanoKnob>(Vec(box.size.x * 0.5f, startY_knobs + knobPadding),
                                                                                               module, AudioToCVPitch::PARAM_TOLERANCE);
         knobTolerance->displayString = "6.25 %";
         addChild(knobTolerance);
 
-        SmallPercentageNanoKnob* knobThres = createParamCentered<SmallPercentageNanoKnob>(Vec(box.size.x * 0.5f, startY_cv2 + 185.f),
+        SmallPercentageNanoKnob* knobThres = createParamCentered<SmallPercentageNanoKnob>(Vec(box.size.x * 0.5f, startY_knobs + knobPadding * 2),
                                                                                           module, AudioToCVPitch::PARAM_CONFIDENCETHRESHOLD);
         knobThres->displayString = "12.5 %";
         addChild(knobThres);
@@ -292,15 +534,16 @@ struct AudioToCVPitchWidget : ModuleWidgetWith9HP {
         drawInputLine(args.vg, 0, "Input");
         drawOutputLine(args.vg, 0, "Pitch");
         drawOutputLine(args.vg, 1, "Gate");
+        drawOutputLine(args.vg, 2, "Conf");
 
         nvgFontSize(args.vg, 11);
         nvgBeginPath(args.vg);
         nvgFillColor(args.vg, nvgRGB(0xd0, 0xd0, 0xd0));
         nvgTextLineHeight(args.vg, 0.8f);
         nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
-        nvgTextBox(args.vg, startX + 6.f, startY_cv2 + 75.f, 11.f, "S\ne\nn\ns", nullptr);
-        nvgTextBox(args.vg, box.size.x - startX - 16.f, startY_cv2 + 130.f, 11.f, "T\no\nl", nullptr);
-        nvgTextBox(args.vg, startX + 6.f, startY_cv2 + 175.f, 11.f, "T\nh\nr\ne\ns", nullptr);
+        nvgTextBox(args.vg, startX + 6.f, startY_knobs - 10.f, 11.f, "S\ne\nn\ns", nullptr);
+        nvgTextBox(args.vg, box.size.x - startX - 16.f, startY_knobs + knobPadding - 5.f, 11.f, "T\no\nl", nullptr);
+        nvgTextBox(args.vg, startX + 6.f, startY_knobs + knobPadding * 2 - 10.f, 11.f, "T\nh\nr\ne\ns", nullptr);
 
         nvgBeginPath(args.vg);
         nvgRoundedRect(args.vg, 10.0f, startY_top, box.size.x - 20.f, 38.0f, 4);
@@ -368,7 +611,7 @@ struct AudioToCVPitchWidget : ModuleWidget {
         addInput(createInput<PJ301MPort>({}, module, AudioToCVPitch::AUDIO_INPUT));
         addOutput(createOutput<PJ301MPort>({}, module, AudioToCVPitch::CV_PITCH));
         addOutput(createOutput<PJ301MPort>({}, module, AudioToCVPitch::CV_GATE));
-
+        addOutput(createOutput<PJ301MPort>({}, module, AudioToCVPitch::CV_CONFIDENCE));
     }
 };
 #endif
@@ -0,0 +1,295 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "plugin.hpp"
+
+// -----------------------------------------------------------------------------------------------------------
+// Series of biquad sections processing several channels at once, one per SIMD lane.
+//
+// Sections use the transposed direct form II, which only needs 2 state values per section and behaves well
+// with floats. Coefficients are not applied right away but smoothed linearly over the next block, so moving
+// a knob only costs one coefficient calculation per block and does not cause zipper noise.
+// Interpolating coefficients keeps the filter stable, since the stable region of (a1, a2) is convex.
+//
+// Filter designs are the ones from Nigel Redmon's Biquad class, http://www.earlevel.com/
+
+enum BiquadType {
+    kBiquadLowpass,
+    kBiquadHighpass,
+    kBiquadBandpass,
+    kBiquadNotch,
+    kBiquadPeak,
+    kBiquadLowshelf,
+    kBiquadHighshelf,
+    kBiquadBypass
+};
+
+/** Normalized biquad coefficients, a0 is implied to be 1. */
+struct BiquadCoefficients {
+    float b0 = 1.f;
+    float b1 = 0.f;
+    float b2 = 0.f;
+    float a1 = 0.f;
+    float a2 = 0.f;
+
+    /**
+       Calculate coefficients for a filter type.
+       @a fc is the cutoff or center frequency divided by the sample rate.
+       @a gainDB is only used by the peak and shelf types.
+     */
+    static BiquadCoefficients design(const BiquadType type, const double fc, const double q, const double gainDB)
+    {
+        BiquadCoefficients c;
+
+        if (type == kBiquadBypass)
+            return c;
+
+        const double v = std::pow(10.0, std::abs(gainDB) / 20.0);
+        const double k = std::tan(M_PI * fc);
+        const double kk = k * k;
+        const double sq2 = M_SQRT2;
+        const double sq2v = std::sqrt(2.0 * v);
+        double norm, b0, b1, b2, a1, a2;
+
+        switch (type)
+        {
+        case kBiquadLowpass:
+            norm = 1.0 / (1.0 + k / q + kk);
+            b0 = kk * norm;
+            b1 = 2.0 * b0;
+            b2 = b0;
+            a1 = 2.0 * (kk - 1.0) * norm;
+            a2 = (1.0 - k / q + kk) * norm;
+            break;
+
+        case kBiquadHighpass:
+            norm = 1.0 / (1.0 + k / q + kk);
+            b0 = norm;
+            b1 = -2.0 * b0;
+            b2 = b0;
+            a1 = 2.0 * (kk - 1.0) * norm;
+            a2 = (1.0 - k / q + kk) * norm;
+            break;
+
+        case kBiquadBandpass:
+            norm = 1.0 / (1.0 + k / q + kk);
+            b0 = k / q * norm;
+            b1 = 0.0;
+            b2 = -b0;
+            a1 = 2.0 * (kk - 1.0) * norm;
+            a2 = (1.0 - k / q + kk) * norm;
+            break;
+
+        case kBiquadNotch:
+            norm = 1.0 / (1.0 + k / q + kk);
+            b0 = (1.0 + kk) * norm;
+            b1 = 2.0 * (kk - 1.0) * norm;
+            b2 = b0;
+            a1 = b1;
+            a2 = (1.0 - k / q + kk) * norm;
+            break;
+
+        case kBiquadPeak:
+            if (gainDB >= 0.0)
+            {
+                norm = 1.0 / (1.0 + k / q + kk);
+                b0 = (1.0 + v / q * k + kk) * norm;
+                b1 = 2.0 * (kk - 1.0) * norm;
+                b2 = (1.0 - v / q * k + kk) * norm;
+                a1 = b1;
+                a2 = (1.0 - k / q + kk) * norm;
+            }
+            else
+            {
+                norm = 1.0 / (1.0 + v / q * k + kk);
+                b0 = (1.0 + k / q + kk) * norm;
+                b1 = 2.0 * (kk - 1.0) * norm;
+                b2 = (1.0 - k / q + kk) * norm;
+                a1 = b1;
+                a2 = (1.0 - v / q * k + kk) * norm;
+            }
+            break;
+
+        case kBiquadLowshelf:
+            if (gainDB >= 0.0)
+            {
+                norm = 1.0 / (1.0 + sq2 * k + kk);
+                b0 = (1.0 + sq2v * k + v * kk) * norm;
+                b1 = 2.0 * (v * kk - 1.0) * norm;
+                b2 = (1.0 - sq2v * k + v * kk) * norm;
+                a1 = 2.0 * (kk - 1.0) * norm;
+                a2 = (1.0 - sq2 * k + kk) * norm;
+            }
+            else
+            {
+                norm = 1.0 / (1.0 + sq2v * k + v * kk);
+                b0 = (1.0 + sq2 * k + kk) * norm;
+                b1 = 2.0 * (kk - 1.0) * norm;
+                b2 = (1.0 - sq2 * k + kk) * norm;
+                a1 = 2.0 * (v * kk - 1.0) * norm;
+                a2 = (1.0 - sq2v * k + v * kk) * norm;
+            }
+            break;
+
+        case kBiquadHighshelf:
+            if (gainDB >= 0.0)
+            {
+                norm = 1.0 / (1.0 + sq2 * k + kk);
+                b0 = (v + sq2v * k + kk) * norm;
+                b1 = 2.0 * (kk - v) * norm;
+                b2 = (v - sq2v * k + kk) * norm;
+                a1 = 2.0 * (kk - 1.0) * norm;
+                a2 = (1.0 - sq2 * k + kk) * norm;
+            }
+            else
+            {
+                norm = 1.0 / (v + sq2v * k + kk);
+                b0 = (1.0 + sq2 * k + kk) * norm;
+                b1 = 2.0 * (kk - 1.0) * norm;
+                b2 = (1.0 - sq2 * k + kk) * norm;
+                a1 = 2.0 * (kk - v) * norm;
+                a2 = (v - sq2v * k + kk) * norm;
+            }
+            break;
+
+        default:
+            return c;
+        }
+
+        c.b0 = b0;
+        c.b1 = b1;
+        c.b2 = b2;
+        c.a1 = a1;
+        c.a2 = a2;
+        return c;
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+/**
+   Cascade of @a SECTIONS biquads.
+   @a T is the sample type, `simd::float_4` runs 4 channels in parallel and `float` a single one.
+   All lanes share the same coefficients, state is per lane.
+ */
+template <int SECTIONS, typename T = simd::float_4>
+struct BiquadCascade {
+    struct Section {
+        T b0, b1, b2, a1, a2;
+    };
+
+    Section current[SECTIONS];
+    Section target[SECTIONS];
+    Section step[SECTIONS];
+    T z1[SECTIONS];
+    T z2[SECTIONS];
+    int rampFrames = 0;
+    bool targetChanged = false;
+
+    BiquadCascade()
+    {
+        const BiquadCoefficients bypass;
+
+        for (int s = 0; s < SECTIONS; ++s)
+            setSection(s, bypass);
+
+        snap();
+        reset();
+    }
+
+    /** Set new coefficients for a section, applied smoothly over the next block. */
+    void setSection(const int index, const BiquadCoefficients& c) noexcept
+    {
+        Section& t(target[index]);
+        t.b0 = c.b0;
+        t.b1 = c.b1;
+        t.b2 = c.b2;
+        t.a1 = c.a1;
+        t.a2 = c.a2;
+        targetChanged = true;
+    }
+
+    /** Jump to the target coefficients without smoothing, for initialization and sample rate changes. */
+    void snap() noexcept
+    {
+        for (int s = 0; s < SECTIONS; ++s)
+            current[s] = target[s];
+
+        rampFrames = 0;
+        targetChanged = false;
+    }
+
+    /** Clear the filter state. */
+    void reset() noexcept
+    {
+        for (int s = 0; s < SECTIONS; ++s)
+            z1[s] = z2[s] = 0.f;
+    }
+
+    /**
+       Start a block of @a frames samples, coefficients changed since the last block ramp over its length.
+       A ramp still in progress restarts from where it currently is.
+     */
+    void beginBlock(const int frames) noexcept
+    {
+        if (! targetChanged)
+            return;
+
+        targetChanged = false;
+        rampFrames = frames;
+
+        const T inv = 1.f / frames;
+
+        for (int s = 0; s < SECTIONS; ++s)
+        {
+            step[s].b0 = (target[s].b0 - current[s].b0) * inv;
+            step[s].b1 = (target[s].b1 - current[s].b1) * inv;
+            step[s].b2 = (target[s].b2 - current[s].b2) * inv;
+            step[s].a1 = (target[s].a1 - current[s].a1) * inv;
+            step[s].a2 = (target[s].a2 - current[s].a2) * inv;
+        }
+    }
+
+    /** Process one sample per lane through all sections. */
+    T process(T x) noexcept
+    {
+        if (rampFrames != 0)
+        {
+            // land exactly on the target at the end of the ramp
+            if (--rampFrames == 0)
+            {
+                for (int s = 0; s < SECTIONS; ++s)
+                    current[s] = target[s];
+            }
+            else
+            {
+                for (int s = 0; s < SECTIONS; ++s)
+                {
+                    current[s].b0 += step[s].b0;
+                    current[s].b1 += step[s].b1;
+                    current[s].b2 += step[s].b2;
+                    current[s].a1 += step[s].a1;
+                    current[s].a2 += step[s].a2;
+                }
+            }
+        }
+
+        for (int s = 0; s < SECTIONS; ++s)
+        {
+            const Section& c(current[s]);
+            const T y = c.b0 * x + z1[s];
+            z1[s] = c.b1 * x - c.a1 * y + z2[s];
+            z2[s] = c.b2 * x - c.a2 * y;
+            x = y;
+        }
+
+        return x;
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
@@ -18,6 +18,7 @@
 #include "plugin.hpp"
 #include "plugincontext.hpp"
 #include "Expander.hpp"
+#include "HostedPluginPipeline.hpp"
 #include "ModuleWidgets.hpp"
 
 #include "CarlaNativePlugin.h"
@@ -61,6 +62,7 @@ struct CarlaModule : Module {
     enum ParamIds {
         BIPOLAR_INPUTS,
         BIPOLAR_OUTPUTS,
+        PIPELINED,
         NUM_PARAMS
     };
     enum InputIds {
@@ -100,6 +102,27 @@ struct CarlaModule : Module {
     CardinalExpanderFromCarlaMIDIToCV* midiOutExpander = nullptr;
     std::string patchStorage;
 
+    // optional pipelined processing, see HostedPluginPipeline.hpp
+    // blocks stay queued for a whole host block, up to 16 of ours (2048 frames)
+    static constexpr const uint kMaxPipelineDepth = 16;
+    typedef HostedPluginPipeline<NUM_INPUTS, NUM_OUTPUTS, BUFFER_SIZE, kMaxPipelineDepth + 1> Pipeline;
+    std::atomic<Pipeline::Slot*> fProcessSlot { nullptr }; // slot being processed by the worker thread
+    std::atomic<bool> pipelineActive { false }; // changes are logged by the widget, not the audio thread
+
+    struct PipelineCallback : Pipeline::Callback {
+        CarlaModule* const module;
+
+        PipelineCallback(CarlaModule* const m)
+            : module(m) {}
+
+        void pipelineProcess(Pipeline::Slot& slot) override
+        {
+            module->processSlot(slot);
+        }
+    } pipelineCallback { this };
+
+    Pipeline pipeline { &pipelineCallback, "Carla pipeline" };
+
 #ifdef CARLA_OS_WIN
     // must keep string pointer valid
     std::string winResourceDir;
@@ -111,6 +134,7 @@ struct CarlaModule : Module {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configParam<SwitchQuantity>(BIPOLAR_INPUTS, 0.f, 1.f, 1.f, "Bipolar CV Inputs")->randomizeEnabled = false;
         configParam<SwitchQuantity>(BIPOLAR_OUTPUTS, 0.f, 1.f, 1.f, "Bipolar CV Outputs")->randomizeEnabled = false;
+        configParam<SwitchQuantity>(PIPELINED, 0.f, 1.f, 0.f, "Pipelined Processing")->randomizeEnabled = false;
 
         for (uint i=0; i<NUM_INPUTS; ++i)
             dataInPtr[i] = dataIn[i];
@@ -220,10 +244,14 @@ struct CarlaModule : Module {
                                            0, 0, nullptr, 0.0f);
 
         fCarlaPluginDescriptor->activate(fCarlaPluginHandle);
+
+        pipeline.start();
     }
 
     ~CarlaModule() override
     {
+        pipeline.stop();
+
         if (fCarlaPluginHandle != nullptr)
             fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
 
@@ -236,7 +264,50 @@ struct CarlaModule : Module {
 
     const NativeTimeInfo* hostGetTimeInfo() const noexcept
     {
-        return &fCarlaTimeInfo;
+        const Pipeline::Slot* const slot = fProcessSlot.load();
+        return slot != nullptr ? &slot->timeInfo : &fCarlaTimeInfo;
+    }
+
+    bool hostWriteMidiEvent(const NativeMidiEvent* const event)
+    {
+        // running on the pipeline worker, events are passed on when the block is picked up
+        if (Pipeline::Slot* const slot = fProcessSlot.load())
+        {
+            if (slot->midiOutCount == Pipeline::kMaxMidiEvents)
+                return false;
+
+            carla_copyStruct(slot->midiOut[slot->midiOutCount++], *event);
+            return true;
+        }
+
+        if (CardinalExpanderFromCarlaMIDIToCV* const expander = midiOutExpander)
+        {
+            if (expander->midiEventCount == CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS)
+                return false;
+
+            NativeMidiEvent& expanderEvent(expander->midiEvents[expander->midiEventCount++]);
+            carla_copyStruct(expanderEvent, *event);
+            return true;
+        }
+
+        return false;
+    }
+
+    /** Processing latency in frames, plus the pipeline depth when pipelined. */
+    uint32_t getLatencyFrames() const noexcept
+    {
+        return pipelineActive ? BUFFER_SIZE * (1 + pipeline.depth.load()) : BUFFER_SIZE;
+    }
+
+    /** Number of our blocks covering a host block, which is how long pipelined blocks need to stay queued. */
+    uint getPipelineDepth() const noexcept
+    {
+        const uint32_t bufferSize = pcontext->bufferSize;
+
+        if (bufferSize == 0)
+            return 1;
+
+        return std::max(1u, std::min(kMaxPipelineDepth, (bufferSize + BUFFER_SIZE - 1) / BUFFER_SIZE));
     }
 
     intptr_t hostDispatcher(const NativeHostDispatcherOpcode opcode,
@@ -407,10 +478,95 @@ struct CarlaModule : Module {
                 midiOutExpander->midiEventCount = 0;
 
             audioDataFill = 0;
-            fCarlaPluginDescriptor->process(fCarlaPluginHandle, dataInPtr, dataOutPtr, BUFFER_SIZE, midiEvents, midiEventCount);
+
+            // keep going through the pipeline while it still has blocks to process after being turned off
+            const bool pipelined = params[PIPELINED].getValue() > 0.5f && pipeline.isAvailable();
+
+            if (pipelined || ! pipeline.isEmpty())
+            {
+                if (! pipelineActive.load())
+                    pipelineActive.store(true);
+
+                processPipelined(midiEvents, midiEventCount, pipelined);
+            }
+            else
+            {
+                if (pipelineActive.load())
+                {
+                    pipelineActive.store(false);
+                    pipeline.reset();
+                }
+
+                fCarlaPluginDescriptor->process(fCarlaPluginHandle, dataInPtr, dataOutPtr, BUFFER_SIZE, midiEvents, midiEventCount);
+            }
+        }
+    }
+
+    void processPipelined(const NativeMidiEvent* const midiEvents, const uint midiEventCount, bool queueBlock)
+    {
+        // the host block size changed, let the blocks in flight through before changing the latency along
+        const uint depth = getPipelineDepth();
+
+        if (depth != pipeline.depth.load())
+        {
+            if (pipeline.isEmpty())
+                pipeline.setDepth(depth);
+            else
+                queueBlock = false;
+        }
+
+        if (Pipeline::Slot* const slot = pipeline.consume())
+        {
+            std::memcpy(dataOut, slot->out, sizeof(dataOut));
+
+            if (midiOutExpander != nullptr && slot->midiOutCount != 0)
+            {
+                const uint count = std::min(slot->midiOutCount, CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS);
+                std::memcpy(midiOutExpander->midiEvents, slot->midiOut, sizeof(NativeMidiEvent) * count);
+                midiOutExpander->midiEventCount = count;
+            }
+
+            pipeline.release(*slot);
+        }
+        else
+        {
+            std::memset(dataOut, 0, sizeof(dataOut));
+        }
+
+        if (! queueBlock)
+            return;
+
+        if (Pipeline::Slot* const slot = pipeline.acquire())
+        {
+            std::memcpy(slot->in, dataIn, sizeof(dataIn));
+            slot->timeInfo = fCarlaTimeInfo;
+            slot->midiInCount = std::min(midiEventCount, Pipeline::kMaxMidiEvents);
+
+            if (slot->midiInCount != 0)
+                std::memcpy(slot->midiIn, midiEvents, sizeof(NativeMidiEvent) * slot->midiInCount);
+
+            pipeline.submit(*slot);
         }
     }
 
+    // called from the pipeline worker thread
+    void processSlot(Pipeline::Slot& slot)
+    {
+        float* ins[NUM_INPUTS];
+        float* outs[NUM_OUTPUTS];
+
+        for (uint i=0; i<NUM_INPUTS; ++i)
+            ins[i] = slot.in[i];
+        for (uint i=0; i<NUM_OUTPUTS; ++i)
+            outs[i] = slot.out[i];
+
+        slot.midiOutCount = 0;
+
+        fProcessSlot.store(&slot);
+        fCarlaPluginDescriptor->process(fCarlaPluginHandle, ins, outs, BUFFER_SIZE, slot.midiIn, slot.midiInCount);
+        fProcessSlot.store(nullptr);
+    }
+
     void onReset() override
     {
         midiOutExpander = nullptr;
@@ -423,6 +579,10 @@ struct CarlaModule : Module {
 
         midiOutExpander = nullptr;
 
+        // the engine is not processing at this point, only the pipeline worker can still be busy
+        pipeline.waitAndReset();
+        pipelineActive.store(false);
+
         fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
         fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_SAMPLE_RATE_CHANGED,
                                            0, 0, nullptr, e.sampleRate);
@@ -458,17 +618,7 @@ static const NativeTimeInfo* host_get_time_info(const NativeHostHandle handle)
 
 static bool host_write_midi_event(const NativeHostHandle handle, const NativeMidiEvent* const event)
 {
-    if (CardinalExpanderFromCarlaMIDIToCV* const expander = static_cast<CarlaModule*>(handle)->midiOutExpander)
-    {
-        if (expander->midiEventCount == CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS)
-            return false;
-
-        NativeMidiEvent& expanderEvent(expander->midiEvents[expander->midiEventCount++]);
-        carla_copyStruct(expanderEvent, *event);
-        return true;
-    }
-
-    return false;
+    return static_cast<CarlaModule*>(handle)->hostWriteMidiEvent(event);
 }
 
 static void host_ui_midi_program_changed(NativeHostHandle handle, uint8_t channel, uint32_t bank, uint32_t program)
@@ -501,6 +651,7 @@ struct CarlaModuleWidget : ModuleWidgetWith9HP, IdleCallback {
     bool hasRightSideExpander = false;
     bool idleCallbackActive = false;
     bool visible = false;
+    uint32_t lastLatencyFrames = BUFFER_SIZE;
 
     CarlaModuleWidget(CarlaModule* const m)
         : module(m)
@@ -674,6 +825,13 @@ struct CarlaModuleWidget : ModuleWidgetWith9HP, IdleCallback {
                              && module->rightExpander.module != nullptr
                              && module->rightExpander.module->model == modelExpanderOutputMIDI;
 
+        if (module != nullptr && module->getLatencyFrames() != lastLatencyFrames)
+        {
+            lastLatencyFrames = module->getLatencyFrames();
+            d_stdout("Carla: pipelined processing %s, latency is now %u frames",
+                     module->pipelineActive.load() ? "enabled" : "disabled", lastLatencyFrames);
+        }
+
         ModuleWidgetWith9HP::step();
     }
 
@@ -704,6 +862,14 @@ struct CarlaModuleWidget : ModuleWidgetWith9HP, IdleCallback {
             [=]() {return module->params[CarlaModule::BIPOLAR_OUTPUTS].getValue() > 0.1f;},
             [=]() {module->params[CarlaModule::BIPOLAR_OUTPUTS].setValue(1.0f - module->params[CarlaModule::BIPOLAR_OUTPUTS].getValue());}
         ));
+
+        const std::string latency = string::f("+%.1f ms", BUFFER_SIZE * module->getPipelineDepth() * 1000.0
+                                                          / module->pcontext->sampleRate);
+
+        menu->addChild(createCheckMenuItem("Pipelined Processing", latency,
+            [=]() {return module->params[CarlaModule::PIPELINED].getValue() > 0.5f;},
+            [=]() {module->params[CarlaModule::PIPELINED].setValue(1.0f - module->params[CarlaModule::PIPELINED].getValue());}
+        ));
     }
 
     void onDoubleClick(const DoubleClickEvent& e) override
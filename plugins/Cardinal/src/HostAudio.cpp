@@ -27,6 +27,9 @@ USE_NAMESPACE_DISTRHO;
 
 template<int numIO>
 struct HostAudio : TerminalModule {
+    static constexpr const int kNumGroups = (numIO + 3) / 4;
+    static constexpr const uint32_t kSubBlockSize = 128;
+
     CardinalPluginContext* const pcontext;
     const int numParams;
     const int numInputs;
@@ -34,11 +37,19 @@ struct HostAudio : TerminalModule {
     bool bypassed = false;
     bool in1connected = false;
     bool in2connected = false;
-    uint32_t dataFrame = 0;
-    uint32_t lastProcessCounter = 0;
+    float gain = 1.0f;
+
+    // current host block, set by the engine
+    int64_t blockStartFrame = 0;
+    uint32_t blockFrames = 0;
+
+    // audio going to the host, collected one lane per port and processed in sub-blocks
+    simd::float_4 subBlock[kSubBlockSize][kNumGroups];
+    uint32_t subBlockOffset = 0;
+    uint32_t subBlockFrames = 0;
 
     // for rack core audio module compatibility
-    dsp::RCFilter dcFilters[numIO];
+    dsp::TRCFilter<simd::float_4> dcFilters[kNumGroups];
     bool dcFilterEnabled = (numIO == 2);
 
     HostAudio()
@@ -56,7 +67,7 @@ struct HostAudio : TerminalModule {
             configParam(0, 0.f, 2.f, 1.f, "Level", " dB", -10, 40);
 
         const float sampleTime = pcontext->engine->getSampleTime();
-        for (int i=0; i<numIO; ++i)
+        for (int i=0; i<kNumGroups; ++i)
             dcFilters[i].setCutoffFreq(10.f * sampleTime);
     }
 
@@ -67,32 +78,28 @@ struct HostAudio : TerminalModule {
 
     void onSampleRateChange(const SampleRateChangeEvent& e) override
     {
-        for (int i=0; i<numIO; ++i)
+        for (int i=0; i<kNumGroups; ++i)
             dcFilters[i].setCutoffFreq(10.f * e.sampleTime);
     }
 
-    void processTerminalInput(const ProcessArgs&) override
+    void processTerminalBlockStart(const ProcessArgs& args, const int frames) override
     {
-        const uint32_t bufferSize = pcontext->bufferSize;
-        const uint32_t processCounter = pcontext->processCounter;
+        bypassed = isBypassed();
+        blockStartFrame = args.frame;
+        subBlockOffset = subBlockFrames = 0;
 
-        // only checked on input
-        if (lastProcessCounter != processCounter)
-        {
-            bypassed = isBypassed();
-            dataFrame = 0;
-            lastProcessCounter = processCounter;
+        // blocks larger than the host buffer would write out of bounds, skip them
+        DISTRHO_SAFE_ASSERT_INT2(static_cast<uint32_t>(frames) <= pcontext->bufferSize, frames, pcontext->bufferSize);
+        blockFrames = static_cast<uint32_t>(frames) <= pcontext->bufferSize ? frames : 0;
 
-            if (numIO == 2)
-            {
-                in1connected = inputs[0].isConnected();
-                in2connected = inputs[1].isConnected();
-            }
-        }
+        // gain (stereo variant only)
+        gain = numParams != 0 ? std::pow(params[0].getValue(), 2.f) : 1.0f;
 
-        // only incremented on output
-        const uint32_t k = dataFrame;
-        DISTRHO_SAFE_ASSERT_INT2_RETURN(k < bufferSize, k, bufferSize,);
+        if (numIO == 2)
+        {
+            in1connected = inputs[0].isConnected();
+            in2connected = inputs[1].isConnected();
+        }
 
         // from host into cardinal, shows as output plug
         if (bypassed)
@@ -100,13 +107,71 @@ struct HostAudio : TerminalModule {
             for (int i=0; i<numOutputs; ++i)
                 outputs[i].setVoltage(0.0f);
         }
-        else if (const float* const* const dataIns = pcontext->dataIns)
+    }
+
+    void processTerminalInput(const ProcessArgs& args) override
+    {
+        if (bypassed)
+            return;
+
+        const uint32_t k = args.frame - blockStartFrame;
+
+        if (k >= blockFrames)
+            return;
+
+        if (const float* const* const dataIns = pcontext->dataIns)
         {
             for (int i=0; i<numOutputs; ++i)
                 outputs[i].setVoltage(dataIns[i][k] * 10.0f);
         }
     }
 
+    void processTerminalBlockEnd(const ProcessArgs&, int) override
+    {
+        if (subBlockFrames != 0)
+            flushSubBlock();
+    }
+
+    /** Store the current frame of cardinal inputs, flushing to the host once a sub-block is full. */
+    void collectFrame(const int numPorts)
+    {
+        simd::float_4* const frame = subBlock[subBlockFrames];
+
+        for (int i=0; i<numPorts; ++i)
+            frame[i / 4][i % 4] = inputs[i].getVoltageSum();
+
+        if (++subBlockFrames == kSubBlockSize)
+            flushSubBlock();
+    }
+
+    /** Apply level, DC filter, gain and clamp to the collected frames in place, 4 ports at a time. */
+    void processSubBlock(const uint32_t frames)
+    {
+        const simd::float_4 vgain = gain;
+
+        if (dcFilterEnabled)
+        {
+            for (uint32_t f=0; f<frames; ++f)
+            {
+                for (int g=0; g<kNumGroups; ++g)
+                {
+                    dcFilters[g].process(subBlock[f][g] * 0.1f);
+                    subBlock[f][g] = simd::clamp(dcFilters[g].highpass() * vgain, -1.0f, 1.0f);
+                }
+            }
+        }
+        else
+        {
+            for (uint32_t f=0; f<frames; ++f)
+            {
+                for (int g=0; g<kNumGroups; ++g)
+                    subBlock[f][g] = simd::clamp(subBlock[f][g] * 0.1f * vgain, -1.0f, 1.0f);
+            }
+        }
+    }
+
+    virtual void flushSubBlock() = 0;
+
     json_t* dataToJson() override
     {
         json_t* const rootJ = json_object();
@@ -128,9 +193,6 @@ struct HostAudio : TerminalModule {
 struct HostAudio2 : HostAudio<2> {
 #ifndef HEADLESS
     // for stereo meter
-    uint32_t internalDataFrame = 0;
-    float internalDataBufferL[128] = {};
-    float internalDataBufferR[128] = {};
     volatile bool resetMeters = true;
     float gainMeterL = 0.0f;
     float gainMeterR = 0.0f;
@@ -157,7 +219,6 @@ struct HostAudio2 : HostAudio<2> {
 #ifndef HEADLESS
             if (resetMeters)
             {
-                internalDataFrame = 0;
                 gainMeterL = gainMeterR = 0.0f;
                 resetMeters = false;
             }
@@ -165,117 +226,60 @@ struct HostAudio2 : HostAudio<2> {
             return;
         }
 
-        const uint32_t bufferSize = pcontext->bufferSize;
-
-        // only incremented on output
-        const uint32_t k = dataFrame++;
-        DISTRHO_SAFE_ASSERT_INT2_RETURN(k < bufferSize, k, bufferSize,);
-
-        if (bypassed)
+        if (bypassed || blockFrames == 0)
             return;
 
-        float** const dataOuts = pcontext->dataOuts;
+        collectFrame(2);
+    }
 
-        // gain (stereo variant only)
-        const float gain = std::pow(params[0].getValue(), 2.f);
+    void flushSubBlock() override
+    {
+        const uint32_t frames = subBlockFrames;
+        const uint32_t offset = subBlockOffset;
+        subBlockOffset += frames;
+        subBlockFrames = 0;
 
-        // read stereo values
-        float valueL, valueR;
+        processSubBlock(frames);
+
+        float* const dataOutL = pcontext->dataOuts[0] + offset;
+        float* const dataOutR = pcontext->dataOuts[1] + offset;
+        float peakL = 0.0f;
+        float peakR = 0.0f;
 
         if (in1connected)
         {
-            if (!std::isfinite(dataOuts[0][k]))
-                __builtin_unreachable();
-
-            valueL = inputs[0].getVoltageSum() * 0.1f;
-
-            if (dcFilterEnabled)
+            for (uint32_t f=0; f<frames; ++f)
             {
-                dcFilters[0].process(valueL);
-                valueL = dcFilters[0].highpass();
+                const float value = subBlock[f][0][0];
+                dataOutL[f] += value;
+                peakL = std::max(peakL, std::abs(value));
             }
-
-            valueL = clamp(valueL * gain, -1.0f, 1.0f);
-            dataOuts[0][k] += valueL;
-        }
-        else
-        {
-            valueL = 0.0f;
         }
 
         if (in2connected)
         {
-            if (!std::isfinite(dataOuts[1][k]))
-                __builtin_unreachable();
-
-            valueR = inputs[1].getVoltageSum() * 0.1f;
-
-            if (dcFilterEnabled)
+            for (uint32_t f=0; f<frames; ++f)
             {
-                dcFilters[1].process(valueR);
-                valueR = dcFilters[1].highpass();
+                const float value = subBlock[f][0][1];
+                dataOutR[f] += value;
+                peakR = std::max(peakR, std::abs(value));
             }
-
-            valueR = clamp(valueR * gain, -1.0f, 1.0f);
-            dataOuts[1][k] += valueR;
         }
         else if (in1connected)
         {
-            valueR = valueL;
-            dataOuts[1][k] += valueL;
-        }
-#ifndef HEADLESS
-        else
-        {
-            valueR = 0.0f;
-        }
-
-        if (pcontext->variant == kCardinalVariantMini)
-        {
-            const uint32_t j = internalDataFrame++;
-            internalDataBufferL[j] = valueL;
-            internalDataBufferR[j] = valueR;
-
-            if (internalDataFrame == 4)
-            {
-                internalDataFrame = 0;
-
-                if (resetMeters)
-                    gainMeterL = gainMeterR = 0.0f;
+            for (uint32_t f=0; f<frames; ++f)
+                dataOutR[f] += subBlock[f][0][0];
 
-                gainMeterL = std::max(gainMeterL, d_findMaxNormalizedFloat<4>(internalDataBufferL));
-
-                if (in2connected)
-                    gainMeterR = std::max(gainMeterR, d_findMaxNormalizedFloat<4>(internalDataBufferR));
-                else
-                    gainMeterR = gainMeterL;
-
-                resetMeters = false;
-            }
+            peakR = peakL;
         }
-        else
-        {
-            const uint32_t j = internalDataFrame++;
-            internalDataBufferL[j] = valueL;
-            internalDataBufferR[j] = valueR;
 
-            if (internalDataFrame == 128)
-            {
-                internalDataFrame = 0;
-
-                if (resetMeters)
-                    gainMeterL = gainMeterR = 0.0f;
-
-                gainMeterL = std::max(gainMeterL, d_findMaxNormalizedFloat128(internalDataBufferL));
-
-                if (in2connected)
-                    gainMeterR = std::max(gainMeterR, d_findMaxNormalizedFloat128(internalDataBufferR));
-                else
-                    gainMeterR = gainMeterL;
+#ifndef HEADLESS
+        if (resetMeters)
+            gainMeterL = gainMeterR = 0.0f;
 
-                resetMeters = false;
-            }
-        }
+        gainMeterL = std::max(gainMeterL, peakL);
+        gainMeterR = std::max(gainMeterR, peakR);
+        resetMeters = false;
 #endif
     }
 };
@@ -285,34 +289,33 @@ struct HostAudio8 : HostAudio<8> {
 
     void processTerminalOutput(const ProcessArgs&) override
     {
-        if (pcontext->bypassed)
+        if (pcontext->bypassed || bypassed || blockFrames == 0)
             return;
 
-        const uint32_t bufferSize = pcontext->bufferSize;
+        collectFrame(numInputs);
+    }
 
-        // only incremented on output
-        const uint32_t k = dataFrame++;
-        DISTRHO_SAFE_ASSERT_INT2_RETURN(k < bufferSize, k, bufferSize,);
+    void flushSubBlock() override
+    {
+        const uint32_t frames = subBlockFrames;
+        const uint32_t offset = subBlockOffset;
+        subBlockOffset += frames;
+        subBlockFrames = 0;
 
-        if (bypassed)
-            return;
+        processSubBlock(frames);
 
         float** const dataOuts = pcontext->dataOuts;
 
         for (int i=0; i<numInputs; ++i)
         {
-            float v = inputs[i].getVoltageSum() * 0.1f;
+            float* const dataOut = dataOuts[i] + offset;
+            const int g = i / 4;
+            const int lane = i % 4;
 
-            if (dcFilterEnabled)
-            {
-                dcFilters[i].process(v);
-                v = dcFilters[i].highpass();
-            }
-
-            dataOuts[i][k] += clamp(v, -1.0f, 1.0f);
+            for (uint32_t f=0; f<frames; ++f)
+                dataOut[f] += subBlock[f][g][lane];
         }
     }
-
 };
 
 #ifndef HEADLESS
@@ -25,10 +25,25 @@
 USE_NAMESPACE_DISTRHO;
 
 struct HostCV : TerminalModule {
+    static constexpr const int kNumGroups = 3;
+    static constexpr const uint32_t kSubBlockSize = 128;
+
     CardinalPluginContext* const pcontext;
     bool bypassed = false;
-    int dataFrame = 0;
-    uint32_t lastProcessCounter = 0;
+    bool hasDataIns = false;
+    uint8_t ioOffset = 0;
+    int numPorts = 0;
+
+    // current host block, set by the engine
+    int64_t blockStartFrame = 0;
+    uint32_t blockFrames = 0;
+
+    // CV going to the host, collected one lane per port and written in sub-blocks
+    simd::float_4 subBlock[kSubBlockSize][kNumGroups];
+    simd::float_4 inputOffsets[kNumGroups];
+    float outputOffsets[10] = {};
+    uint32_t subBlockOffset = 0;
+    uint32_t subBlockFrames = 0;
 
     enum ParamIds {
         BIPOLAR_INPUTS_1_5,
@@ -70,100 +85,106 @@ struct HostCV : TerminalModule {
         configParam<SwitchQuantity>(BIPOLAR_OUTPUTS_6_10, 0.f, 1.f, 0.f, "Bipolar Outputs 6-10")->randomizeEnabled = false;
     }
 
-    void processTerminalInput(const ProcessArgs&) override
+    void processTerminalBlockStart(const ProcessArgs& args, const int frames) override
     {
         if (pcontext->variant != kCardinalVariantMain && pcontext->variant != kCardinalVariantMini)
             return;
 
-        const uint8_t ioOffset = pcontext->variant == kCardinalVariantMini ? 2 : 8;
-        const uint32_t bufferSize = pcontext->bufferSize;
-        const uint32_t processCounter = pcontext->processCounter;
+        bypassed = isBypassed();
+        blockStartFrame = args.frame;
+        subBlockOffset = subBlockFrames = 0;
 
-        // only checked on input
-        if (lastProcessCounter != processCounter)
-        {
-            bypassed = isBypassed();
-            dataFrame = 0;
-            lastProcessCounter = processCounter;
-        }
+        DISTRHO_SAFE_ASSERT_INT2(static_cast<uint32_t>(frames) <= pcontext->bufferSize, frames, pcontext->bufferSize);
+        blockFrames = static_cast<uint32_t>(frames) <= pcontext->bufferSize ? frames : 0;
 
-        // only incremented on output
-        const uint32_t k = dataFrame;
-        DISTRHO_SAFE_ASSERT_RETURN(k < bufferSize,);
+        ioOffset = pcontext->variant == kCardinalVariantMini ? 2 : 8;
+        numPorts = pcontext->variant == kCardinalVariantMini ? 5 : 10;
 
-        if (bypassed)
-        {
-            for (int i=0; i<10; ++i)
-                outputs[i].setVoltage(0.0f);
-        }
-        else if (const float* const* const dataIns = pcontext->dataIns)
-        {
-            if (dataIns[ioOffset] == nullptr)
-                return;
+        // bipolar switches, the same for the whole block
+        const float outputOffset1 = params[BIPOLAR_OUTPUTS_1_5].getValue() > 0.1f ? 5.f : 0.f;
+        const float outputOffset2 = params[BIPOLAR_OUTPUTS_6_10].getValue() > 0.1f ? 5.f : 0.f;
+        const float inputOffset1 = params[BIPOLAR_INPUTS_1_5].getValue() > 0.1f ? 5.f : 0.f;
+        const float inputOffset2 = params[BIPOLAR_INPUTS_6_10].getValue() > 0.1f ? 5.f : 0.f;
 
-            float outputOffset;
-            outputOffset = params[BIPOLAR_OUTPUTS_1_5].getValue() > 0.1f ? 5.f : 0.f;
+        for (int i=0; i<NUM_OUTPUTS; ++i)
+            outputOffsets[i] = i < 5 ? outputOffset1 : outputOffset2;
 
-            for (int i=0; i<5; ++i)
-                outputs[i].setVoltage(dataIns[i+ioOffset][k] - outputOffset);
+        for (int i=0; i<kNumGroups * 4; ++i)
+            inputOffsets[i / 4][i % 4] = i < 5 ? inputOffset1 : i < NUM_INPUTS ? inputOffset2 : 0.f;
 
-            if (pcontext->variant == kCardinalVariantMain)
-            {
-                outputOffset = params[BIPOLAR_OUTPUTS_6_10].getValue() > 0.1f ? 5.f : 0.f;
+        if (bypassed)
+            blockFrames = 0;
 
-                for (int i=5; i<10; ++i)
-                    outputs[i].setVoltage(dataIns[i+ioOffset][k] - outputOffset);
-            }
-            else
-            {
-                for (int i=5; i<10; ++i)
-                    outputs[i].setVoltage(0.f);
-            }
-        }
+        const float* const* const dataIns = pcontext->dataIns;
+        hasDataIns = blockFrames != 0 && dataIns != nullptr && dataIns[ioOffset] != nullptr;
+
+        // from host into cardinal, unused or bypassed ports stay at 0V for the whole block
+        for (int i = hasDataIns ? numPorts : 0; i<NUM_OUTPUTS; ++i)
+            outputs[i].setVoltage(0.0f);
     }
 
-    void processTerminalOutput(const ProcessArgs&) override
+    void processTerminalInput(const ProcessArgs& args) override
     {
-        if (pcontext->variant != kCardinalVariantMain && pcontext->variant != kCardinalVariantMini)
+        if (! hasDataIns)
             return;
-        if (pcontext->bypassed)
+
+        const uint32_t k = args.frame - blockStartFrame;
+
+        if (k >= blockFrames)
             return;
 
-        const uint8_t ioOffset = pcontext->variant == kCardinalVariantMini ? 2 : 8;
-        const uint32_t bufferSize = pcontext->bufferSize;
+        const float* const* const dataIns = pcontext->dataIns + ioOffset;
 
-        // only incremented on output
-        const uint32_t k = dataFrame++;
-        DISTRHO_SAFE_ASSERT_RETURN(k < bufferSize,);
+        for (int i=0; i<numPorts; ++i)
+            outputs[i].setVoltage(dataIns[i][k] - outputOffsets[i]);
+    }
 
-        if (bypassed)
+    void processTerminalOutput(const ProcessArgs&) override
+    {
+        if (blockFrames == 0 || pcontext->bypassed)
             return;
 
+        simd::float_4* const frame = subBlock[subBlockFrames];
+
+        for (int i=0; i<numPorts; ++i)
+            frame[i / 4][i % 4] = inputs[i].getVoltage();
+
+        if (++subBlockFrames == kSubBlockSize)
+            flushSubBlock();
+    }
+
+    void processTerminalBlockEnd(const ProcessArgs&, int) override
+    {
+        if (subBlockFrames != 0)
+            flushSubBlock();
+    }
+
+    void flushSubBlock()
+    {
+        const uint32_t frames = subBlockFrames;
+        const uint32_t offset = subBlockOffset;
+        subBlockOffset += frames;
+        subBlockFrames = 0;
+
         float** const dataOuts = pcontext->dataOuts;
 
         if (dataOuts[ioOffset] == nullptr)
             return;
 
-        float inputOffset;
-        inputOffset = params[BIPOLAR_INPUTS_1_5].getValue() > 0.1f ? 5.0f : 0.0f;
-
-        for (int i=0; i<5; ++i)
+        for (uint32_t f=0; f<frames; ++f)
         {
-            if (!std::isfinite(dataOuts[i+ioOffset][k]))
-                __builtin_unreachable();
-            dataOuts[i+ioOffset][k] += inputs[i].getVoltage() + inputOffset;
+            for (int g=0; g<kNumGroups; ++g)
+                subBlock[f][g] += inputOffsets[g];
         }
 
-        if (pcontext->variant == kCardinalVariantMain)
+        for (int i=0; i<numPorts; ++i)
         {
-            inputOffset = params[BIPOLAR_INPUTS_6_10].getValue() > 0.1f ? 5.0f : 0.0f;
+            float* const dataOut = dataOuts[i+ioOffset] + offset;
+            const int g = i / 4;
+            const int lane = i % 4;
 
-            for (int i=5; i<10; ++i)
-            {
-                if (!std::isfinite(dataOuts[i+ioOffset][k]))
-                    __builtin_unreachable();
-                dataOuts[i+ioOffset][k] += inputs[i].getVoltage() + inputOffset;
-            }
+            for (uint32_t f=0; f<frames; ++f)
+                dataOut[f] += subBlock[f][g][lane];
         }
     }
 };
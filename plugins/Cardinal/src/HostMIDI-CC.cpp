@@ -62,8 +62,7 @@ struct HostMIDICC : TerminalModule {
     struct MidiInput {
         // Cardinal specific
         CardinalPluginContext* const pcontext;
-        const MidiEvent* midiEvents;
-        uint32_t midiEventsLeft;
+        CardinalMidiEventReader midiEventReader;
         uint32_t midiEventFrame;
         uint32_t lastProcessCounter;
         uint8_t channel;
@@ -99,8 +98,7 @@ struct HostMIDICC : TerminalModule {
 
         void reset()
         {
-            midiEvents = nullptr;
-            midiEventsLeft = 0;
+            midiEventReader = CardinalMidiEventReader();
             midiEventFrame = 0;
             lastProcessCounter = 0;
             channel = 0;
@@ -129,8 +127,8 @@ struct HostMIDICC : TerminalModule {
             if (processCounterChanged)
             {
                 lastProcessCounter = processCounter;
-                midiEvents = pcontext->midiEvents;
-                midiEventsLeft = pcontext->midiEventCount;
+                midiEventReader = channel != 0 ? pcontext->midiBus.readChannel(channel - 1)
+                                               : pcontext->midiBus.readAll();
                 midiEventFrame = 0;
             }
 
@@ -140,37 +138,19 @@ struct HostMIDICC : TerminalModule {
                 return false;
             }
 
-            while (midiEventsLeft != 0)
+            while (const CardinalMidiEvent* const midiEvent = midiEventReader.next(midiEventFrame))
             {
-                const MidiEvent& midiEvent(*midiEvents);
-
-                if (midiEvent.frame > midiEventFrame)
-                    break;
-
-                ++midiEvents;
-                --midiEventsLeft;
-
-                const uint8_t* const data = midiEvent.size > MidiEvent::kDataSize
-                                          ? midiEvent.dataExt
-                                          : midiEvent.data;
-
-                if (channel != 0 && data[0] < 0xF0)
-                {
-                    if ((data[0] & 0x0F) != (channel - 1))
-                        continue;
-                }
-
-                const uint8_t status = data[0] & 0xF0;
-                const uint8_t chan = data[0] & 0x0F;
+                const uint8_t status = midiEvent->status;
+                const uint8_t chan = midiEvent->channel;
 
                 if (status == 0xD0)
                 {
-                    chPressure[chan] = data[1];
+                    chPressure[chan] = midiEvent->data1;
                     continue;
                 }
                 if (status == 0xE0)
                 {
-                    pitchbend[chan] = (data[2] << 7) | data[1];
+                    pitchbend[chan] = (midiEvent->data2 << 7) | midiEvent->data1;
                     continue;
                 }
                 if (status != 0xB0)
@@ -180,8 +160,8 @@ struct HostMIDICC : TerminalModule {
 
                 // adapted from Rack `processCC`
                 const uint8_t c = mpeMode ? chan : 0;
-                const int8_t cc = data[1];
-                const uint8_t value = data[2];
+                const int8_t cc = midiEvent->data1;
+                const uint8_t value = midiEvent->data2;
 
                 // Learn
                 if (learningId >= 0 && ccValues[cc][c] != value)
@@ -317,6 +297,7 @@ struct HostMIDICC : TerminalModule {
         // cardinal specific
         CardinalPluginContext* const pcontext;
         uint8_t channel = 0;
+        bool coalesce = false;
 
         // from Rack
         int lastValues[130];
@@ -374,7 +355,7 @@ struct HostMIDICC : TerminalModule {
 
         void sendMessage(const midi::Message& message)
         {
-            pcontext->writeMidiMessage(message, channel);
+            pcontext->writeMidiMessage(message, channel, coalesce);
         }
 
     } midiOutput;
@@ -493,6 +474,7 @@ struct HostMIDICC : TerminalModule {
         // separate
         json_object_set_new(rootJ, "inputChannel", json_integer(midiInput.channel));
         json_object_set_new(rootJ, "outputChannel", json_integer(midiOutput.channel));
+        json_object_set_new(rootJ, "outputCoalesce", json_boolean(midiOutput.coalesce));
 
         return rootJ;
     }
@@ -535,6 +517,9 @@ struct HostMIDICC : TerminalModule {
 
         if (json_t* const outputChannelJ = json_object_get(rootJ, "outputChannel"))
             midiOutput.channel = json_integer_value(outputChannelJ) & 0x0F;
+
+        if (json_t* const outputCoalesceJ = json_object_get(rootJ, "outputCoalesce"))
+            midiOutput.coalesce = json_boolean_value(outputCoalesceJ);
     }
 };
 
@@ -808,6 +793,8 @@ struct HostMIDICCWidget : ModuleWidgetWith14HP {
         outputChannelItem->rightText = string::f("%d", module->midiOutput.channel+1) + "  " + RIGHT_ARROW;
         outputChannelItem->module = module;
         menu->addChild(outputChannelItem);
+
+        menu->addChild(createBoolPtrMenuItem("Coalesce same-frame values", "", &module->midiOutput.coalesce));
     }
 };
 #else
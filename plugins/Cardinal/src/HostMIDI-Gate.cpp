@@ -58,8 +58,7 @@ struct HostMIDIGate : TerminalModule {
     struct MidiInput {
         // Cardinal specific
         CardinalPluginContext* const pcontext;
-        const MidiEvent* midiEvents;
-        uint32_t midiEventsLeft;
+        CardinalMidiEventReader midiEventReader;
         uint32_t midiEventFrame;
         uint32_t lastProcessCounter;
         uint8_t channel;
@@ -84,8 +83,7 @@ struct HostMIDIGate : TerminalModule {
 
         void reset()
         {
-            midiEvents = nullptr;
-            midiEventsLeft = 0;
+            midiEventReader = CardinalMidiEventReader();
             midiEventFrame = 0;
             lastProcessCounter = 0;
             channel = 0;
@@ -116,8 +114,8 @@ struct HostMIDIGate : TerminalModule {
             if (processCounterChanged)
             {
                 lastProcessCounter = processCounter;
-                midiEvents = pcontext->midiEvents;
-                midiEventsLeft = pcontext->midiEventCount;
+                midiEventReader = channel != 0 ? pcontext->midiBus.readChannel(channel - 1)
+                                               : pcontext->midiBus.readAll();
                 midiEventFrame = 0;
             }
 
@@ -127,35 +125,17 @@ struct HostMIDIGate : TerminalModule {
                 return processCounterChanged;
             }
 
-            while (midiEventsLeft != 0)
+            while (const CardinalMidiEvent* const midiEvent = midiEventReader.next(midiEventFrame))
             {
-                const MidiEvent& midiEvent(*midiEvents);
-
-                if (midiEvent.frame > midiEventFrame)
-                    break;
-
-                ++midiEvents;
-                --midiEventsLeft;
-
-                const uint8_t* const data = midiEvent.size > MidiEvent::kDataSize
-                                          ? midiEvent.dataExt
-                                          : midiEvent.data;
-
-                if (channel != 0 && data[0] < 0xF0)
-                {
-                    if ((data[0] & 0x0F) != (channel - 1))
-                        continue;
-                }
-
                 // adapted from Rack
-                switch (data[0] & 0xF0)
+                switch (midiEvent->status)
                 {
                 // note on
                 case 0x90:
-                    if (data[2] > 0)
+                    if (midiEvent->data2 > 0)
                     {
-                        const int c = mpeMode ? (data[0] & 0x0F) : 0;
-                        const int8_t note = data[1];
+                        const int c = mpeMode ? midiEvent->channel : 0;
+                        const int8_t note = midiEvent->data1;
                         // Learn
                         if (learningId >= 0)
                         {
@@ -178,7 +158,7 @@ struct HostMIDIGate : TerminalModule {
                             {
                                 gates[id][c] = true;
                                 gateTimes[id][c] = 1e-3f;
-                                velocities[id][c] = data[2];
+                                velocities[id][c] = midiEvent->data2;
                             }
                         }
                         break;
@@ -186,8 +166,8 @@ struct HostMIDIGate : TerminalModule {
                     // fall-through
                 // note off
                 case 0x80:
-                    const int c = mpeMode ? (data[0] & 0x0F) : 0;
-                    const int8_t note = data[1];
+                    const int c = mpeMode ? midiEvent->channel : 0;
+                    const int8_t note = midiEvent->data1;
                     // Find id
                     for (int id = 0; id < 18; ++id)
                     {
@@ -55,8 +55,7 @@ struct HostMIDIMap : TerminalModule {
 
     // Cardinal specific
     CardinalPluginContext* const pcontext;
-    const MidiEvent* midiEvents;
-    uint32_t midiEventsLeft;
+    CardinalMidiEventReader midiEventReader;
     uint32_t midiEventFrame;
     uint32_t lastProcessCounter;
     int nextLearningId;
@@ -117,8 +116,7 @@ struct HostMIDIMap : TerminalModule {
 
     void onReset() override
     {
-        midiEvents = nullptr;
-        midiEventsLeft = 0;
+        midiEventReader = CardinalMidiEventReader();
         midiEventFrame = 0;
         lastProcessCounter = 0;
         nextLearningId = -1;
@@ -144,8 +142,7 @@ struct HostMIDIMap : TerminalModule {
         {
             bypassed = isBypassed();
             lastProcessCounter = processCounter;
-            midiEvents = pcontext->midiEvents;
-            midiEventsLeft = pcontext->midiEventCount;
+            midiEventReader = pcontext->midiBus.readType(kCardinalMidiEventControlChange);
             midiEventFrame = 0;
         }
 
@@ -155,34 +152,17 @@ struct HostMIDIMap : TerminalModule {
             return;
         }
 
-        while (midiEventsLeft != 0)
+        while (const CardinalMidiEvent* const midiEvent = midiEventReader.next(midiEventFrame))
         {
-            const MidiEvent& midiEvent(*midiEvents);
-
-            if (midiEvent.frame > midiEventFrame)
-                break;
-
-            ++midiEvents;
-            --midiEventsLeft;
-
-            const uint8_t* const data = midiEvent.size > MidiEvent::kDataSize
-                                      ? midiEvent.dataExt
-                                      : midiEvent.data;
-
-            if (channel != 0 && data[0] < 0xF0)
-            {
-                if ((data[0] & 0x0F) != (channel - 1))
-                    continue;
-            }
+            if (channel != 0 && midiEvent->channel != channel - 1)
+                continue;
 
             // adapted from Rack
-            if ((data[0] & 0xF0) != 0xB0)
-                continue;
-            if (data[1] >= MAX_MIDI_CONTROL)
+            if (midiEvent->data1 >= MAX_MIDI_CONTROL)
                 continue;
 
-            const uint8_t cc = data[1];
-            const int8_t value = data[2];
+            const uint8_t cc = midiEvent->data1;
+            const int8_t value = midiEvent->data2;
 
             // Learn
             if (learningId >= 0 && values[cc] != value)
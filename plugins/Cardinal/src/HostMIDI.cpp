@@ -80,8 +80,7 @@ struct HostMIDI : TerminalModule {
         // Cardinal specific
         CardinalPluginContext* const pcontext;
         midi::Message converterMsg;
-        const MidiEvent* midiEvents;
-        uint32_t midiEventsLeft;
+        CardinalMidiEventReader midiEventReader;
         uint32_t midiEventFrame;
         uint32_t lastProcessCounter;
         bool wasPlaying;
@@ -131,7 +130,6 @@ struct HostMIDI : TerminalModule {
         MidiInput(CardinalPluginContext* const pc)
             : pcontext(pc)
         {
-            converterMsg.bytes.resize(0xff);
             heldNotes.reserve(128);
             for (int c = 0; c < 16; c++) {
                 pwFilters[c].setTau(1 / 30.f);
@@ -142,8 +140,7 @@ struct HostMIDI : TerminalModule {
 
         void reset()
         {
-            midiEvents = nullptr;
-            midiEventsLeft = 0;
+            midiEventReader = CardinalMidiEventReader();
             midiEventFrame = 0;
             lastProcessCounter = 0;
             wasPlaying = false;
@@ -190,8 +187,8 @@ struct HostMIDI : TerminalModule {
             {
                 lastProcessCounter = processCounter;
 
-                midiEvents = pcontext->midiEvents;
-                midiEventsLeft = pcontext->midiEventCount;
+                midiEventReader = channel != 0 ? pcontext->midiBus.readChannel(channel - 1)
+                                               : pcontext->midiBus.readAll();
 
                 if (isBypassed)
                 {
@@ -224,36 +221,13 @@ struct HostMIDI : TerminalModule {
                 return false;
             }
 
-            while (midiEventsLeft != 0)
+            // events are already decoded and filtered by channel, only status and 2 data bytes are used here
+            while (const CardinalMidiEvent* const midiEvent = midiEventReader.next(midiEventFrame))
             {
-                const MidiEvent& midiEvent(*midiEvents);
-
-                if (midiEvent.frame > midiEventFrame)
-                    break;
-
-                ++midiEvents;
-                --midiEventsLeft;
-
-                const uint8_t* data;
-
-                if (midiEvent.size > MidiEvent::kDataSize)
-                {
-                    data = midiEvent.dataExt;
-                    converterMsg.bytes.resize(midiEvent.size);
-                }
-                else
-                {
-                    data = midiEvent.data;
-                }
-
-                if (channel != 0 && data[0] < 0xF0)
-                {
-                    if ((data[0] & 0x0F) != (channel - 1))
-                        continue;
-                }
-
                 converterMsg.frame = midiEventFrame;
-                std::memcpy(converterMsg.bytes.data(), data, midiEvent.size);
+                converterMsg.bytes[0] = midiEvent->data[0];
+                converterMsg.bytes[1] = midiEvent->data1;
+                converterMsg.bytes[2] = midiEvent->data2;
 
                 processMessage(converterMsg);
             }
@@ -559,6 +533,7 @@ struct HostMIDI : TerminalModule {
     struct MidiOutput : dsp::MidiGenerator<PORT_MAX_CHANNELS> {
         CardinalPluginContext* const pcontext;
         uint8_t channel = 0;
+        bool coalesce = false;
 
         // caching
         struct {
@@ -577,7 +552,7 @@ struct HostMIDI : TerminalModule {
 
         void onMessage(const midi::Message& message) override
         {
-            pcontext->writeMidiMessage(message, channel);
+            pcontext->writeMidiMessage(message, channel, coalesce);
         }
     } midiOutput;
 
@@ -732,6 +707,7 @@ struct HostMIDI : TerminalModule {
 
         json_object_set_new(rootJ, "inputChannel", json_integer(midiInput.channel));
         json_object_set_new(rootJ, "outputChannel", json_integer(midiOutput.channel));
+        json_object_set_new(rootJ, "outputCoalesce", json_boolean(midiOutput.coalesce));
 
         return rootJ;
     }
@@ -767,6 +743,9 @@ struct HostMIDI : TerminalModule {
 
         if (json_t* const outputChannelJ = json_object_get(rootJ, "outputChannel"))
             midiOutput.channel = json_integer_value(outputChannelJ) & 0x0F;
+
+        if (json_t* const outputCoalesceJ = json_object_get(rootJ, "outputCoalesce"))
+            midiOutput.coalesce = json_boolean_value(outputCoalesceJ);
     }
 };
 
@@ -903,6 +882,8 @@ struct HostMIDIWidget : ModuleWidgetWith9HP {
         outputChannelItem->module = module;
         menu->addChild(outputChannelItem);
 
+        menu->addChild(createBoolPtrMenuItem("Coalesce same-frame values", "", &module->midiOutput.coalesce));
+
         menu->addChild(new MenuSeparator);
         menu->addChild(createMenuLabel("MIDI Input & Output"));
 
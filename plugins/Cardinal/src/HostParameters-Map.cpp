@@ -65,8 +65,6 @@ struct HostParametersMap : TerminalModule {
     uint8_t learningId = UINT8_MAX;
 
     CardinalPluginContext* const pcontext;
-    bool parametersChanged[kModuleParameterCount] = {};
-    float parameterValues[kModuleParameterCount];
     bool bypassed = false;
     bool firstRun = true;
     uint32_t lastProcessCounter = 0;
@@ -85,8 +83,6 @@ struct HostParametersMap : TerminalModule {
             valueFilters[id].setTau(1 / 30.f);
             pcontext->engine->addParamHandle(&mappings[id].paramHandle);
         }
-
-        std::memcpy(parameterValues, pcontext->parameters, sizeof(parameterValues));
     }
 
     ~HostParametersMap()
@@ -121,8 +117,6 @@ struct HostParametersMap : TerminalModule {
         }
 
         firstRun = true;
-        std::memcpy(parameterValues, pcontext->parameters, sizeof(parameterValues));
-        std::memset(parametersChanged, 0, sizeof(parametersChanged));
     }
 
     void processTerminalInput(const ProcessArgs& args) override
@@ -137,14 +131,9 @@ struct HostParametersMap : TerminalModule {
         if (isBypassed())
             return;
 
-        for (uint32_t i = 0; i < kModuleParameterCount; ++i)
-        {
-            if (d_isEqual(pcontext->parameters[i], parameterValues[i]))
-                continue;
-
-            parameterValues[i] = pcontext->parameters[i];
-            parametersChanged[i] = true;
-        }
+        // changes are flagged by the per-block ramps, no need to compare values here
+        const CardinalParameterRamps& ramps(pcontext->parameterRamps);
+        const float* const parameterValues = ramps.end;
 
         for (uint id = 0; id < numMappedParmeters; ++id)
         {
@@ -175,7 +164,7 @@ struct HostParametersMap : TerminalModule {
             }
 
             // Check if parameter was changed by the host
-            if (parametersChanged[hostParamId] && !firstRun)
+            if (ramps.isChanging(hostParamId) && !firstRun)
                 valueReached[id] = false;
             else if (valueReached[id])
                 continue;
@@ -209,7 +198,6 @@ struct HostParametersMap : TerminalModule {
         }
 
         firstRun = false;
-        std::memset(parametersChanged, 0, sizeof(parametersChanged));
     }
 
     void processTerminalOutput(const ProcessArgs&) override
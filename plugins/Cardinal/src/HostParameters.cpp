@@ -36,12 +36,21 @@ struct HostParameters : TerminalModule {
         NUM_LIGHTS
     };
 
+    static constexpr const uint32_t kGroupCount = kModuleParameterCount / 4;
+    static_assert(kModuleParameterCount % 4 == 0, "parameters are processed in groups of 4");
+
     CardinalPluginContext* const pcontext;
-    rack::dsp::SlewLimiter parameters[kModuleParameterCount];
     bool parametersConnected[kModuleParameterCount] = {};
     bool bypassed = false;
     bool smooth = true;
+    bool needsRefresh = true;
     uint32_t lastProcessCounter = 0;
+    uint32_t blockFrame = 0;
+
+    // groups of 4 parameters ramping in the current block, with their connected outputs
+    uint8_t activeGroups[kGroupCount];
+    uint8_t activeGroupMasks[kGroupCount];
+    uint32_t numActiveGroups = 0;
 
     HostParameters()
         : pcontext(static_cast<CardinalPluginContext*>(APP))
@@ -52,50 +61,107 @@ struct HostParameters : TerminalModule {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
     }
 
-    void processTerminalInput(const ProcessArgs& args) override
+    void processTerminalInput(const ProcessArgs&) override
     {
         const uint32_t processCounter = pcontext->processCounter;
 
         if (lastProcessCounter != processCounter)
         {
-            bypassed = isBypassed();
             lastProcessCounter = processCounter;
+            blockFrame = 0;
+            numActiveGroups = 0;
+
+            const bool wasBypassed = bypassed;
+            bypassed = isBypassed();
+
+            if (bypassed)
+                return;
+
+            if (wasBypassed)
+                needsRefresh = true;
+
+            const CardinalParameterRamps& ramps(pcontext->parameterRamps);
 
-            for (uint32_t i=0; i<kModuleParameterCount; ++i)
+            for (uint32_t g=0; g<kGroupCount; ++g)
             {
-                const bool connected = outputs[i].isConnected();
+                const uint32_t changed = ramps.getChangedMask4(g * 4);
+                uint32_t mask = 0;
+
+                for (uint32_t k=0; k<4; ++k)
+                {
+                    const uint32_t i = g * 4 + k;
+                    const bool connected = outputs[i].isConnected();
+
+                    // newly connected outputs start from the current value, ramping from there if needed
+                    if (parametersConnected[i] != connected || needsRefresh)
+                    {
+                        parametersConnected[i] = connected;
+
+                        if (connected)
+                            outputs[i].setVoltage(smooth ? ramps.start[i] : ramps.end[i]);
+                    }
+
+                    if (connected && (changed & (1u << k)) != 0)
+                        mask |= 1u << k;
+                }
+
+                if (mask == 0)
+                    continue;
 
-                if (parametersConnected[i] != connected)
+                if (smooth)
                 {
-                    parametersConnected[i] = connected;
-                    parameters[i].reset();
+                    activeGroups[numActiveGroups] = g;
+                    activeGroupMasks[numActiveGroups] = mask;
+                    ++numActiveGroups;
+                }
+                else
+                {
+                    for (uint32_t k=0; k<4; ++k)
+                        if (mask & (1u << k))
+                            outputs[g * 4 + k].setVoltage(ramps.end[g * 4 + k]);
                 }
             }
+
+            needsRefresh = false;
         }
 
-        if (bypassed)
+        if (bypassed || numActiveGroups == 0)
+            return;
+
+        const CardinalParameterRamps& ramps(pcontext->parameterRamps);
+        const uint32_t frame = blockFrame++;
+
+        if (frame >= ramps.frames)
             return;
 
-        for (uint32_t i=0; i<kModuleParameterCount; ++i)
+        // the last frame lands exactly on the target, so static parameters never drift
+        const bool lastFrame = frame + 1 == ramps.frames;
+        const simd::float_4 t = static_cast<float>(frame + 1) * ramps.invFrames;
+
+        for (uint32_t n=0; n<numActiveGroups; ++n)
         {
-            if (parametersConnected[i])
-                outputs[i].setVoltage(smooth ? parameters[i].process(args.sampleTime, pcontext->parameters[i])
-                                             : pcontext->parameters[i]);
+            const uint32_t first = activeGroups[n] * 4;
+            const uint32_t mask = activeGroupMasks[n];
+            simd::float_4 values = simd::float_4::load(ramps.end + first);
+
+            if (! lastFrame)
+            {
+                const simd::float_4 start = simd::float_4::load(ramps.start + first);
+                values = start + (values - start) * t;
+            }
+
+            for (uint32_t k=0; k<4; ++k)
+                if (mask & (1u << k))
+                    outputs[first + k].setVoltage(values[k]);
         }
     }
 
     void processTerminalOutput(const ProcessArgs&) override
     {}
 
-    void onSampleRateChange(const SampleRateChangeEvent& e) override
+    void onReset() override
     {
-        const double fall = 1.0 / (double(pcontext->bufferSize) / e.sampleRate);
-
-        for (uint32_t i=0; i<kModuleParameterCount; ++i)
-        {
-            parameters[i].reset();
-            parameters[i].setRiseFall(fall, fall);
-        }
+        needsRefresh = true;
     }
 
     // ----------------------------------------------------------------------------------------------------------------
@@ -115,6 +181,8 @@ struct HostParameters : TerminalModule {
     {
         if (json_t* const smoothJ = json_object_get(rootJ, "smooth"))
             smooth = json_boolean_value(smoothJ);
+
+        needsRefresh = true;
     }
 };
 
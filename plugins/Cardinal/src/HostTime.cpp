@@ -44,7 +44,9 @@ struct HostTime : TerminalModule {
 
     rack::dsp::PulseGenerator pulseReset, pulseBar, pulseBeat, pulseClock;
     float sampleTime = 0.0f;
-    uint32_t lastProcessCounter = 0;
+    bool bypassed = false;
+    bool playing = false;
+    bool playingWithBBT = false;
     // cached time values
     struct {
         bool reset = true;
@@ -64,32 +66,26 @@ struct HostTime : TerminalModule {
         config(NUM_PARAMS, NUM_INPUTS, kHostTimeCount, kHostTimeCount);
     }
 
-    void processTerminalInput(const ProcessArgs& args) override
+    void processTerminalBlockStart(const ProcessArgs&, int) override
     {
-        const uint32_t processCounter = pcontext->processCounter;
+        // Update time position on every new audio block
+        timeInfo.reset = pcontext->reset;
+        timeInfo.bar = pcontext->bar;
+        timeInfo.beat = pcontext->beat;
+        timeInfo.seconds = pcontext->frame / pcontext->sampleRate;
+        timeInfo.tick = pcontext->tick;
+        timeInfo.tickClock = pcontext->tickClock;
+
+        bypassed = isBypassed();
+        playing = pcontext->playing;
+        playingWithBBT = playing && pcontext->bbtValid;
+    }
 
+    void processTerminalInput(const ProcessArgs& args) override
+    {
         // local variables for faster access
-        double tick, tickClock;
-
-        // Update time position if running a new audio block
-        if (lastProcessCounter != processCounter)
-        {
-            lastProcessCounter = processCounter;
-            timeInfo.reset = pcontext->reset;
-            timeInfo.bar = pcontext->bar;
-            timeInfo.beat = pcontext->beat;
-            timeInfo.seconds = pcontext->frame / pcontext->sampleRate;
-            tick = pcontext->tick;
-            tickClock = pcontext->tickClock;
-        }
-        else
-        {
-            tick = timeInfo.tick;
-            tickClock = timeInfo.tickClock;
-        }
-
-        const bool playing = pcontext->playing;
-        const bool playingWithBBT = playing && pcontext->bbtValid;
+        double tick = timeInfo.tick;
+        double tickClock = timeInfo.tickClock;
 
         if (playingWithBBT)
         {
@@ -137,7 +133,7 @@ struct HostTime : TerminalModule {
         timeInfo.tick = tick;
         timeInfo.tickClock = tickClock;
 
-        if (isBypassed())
+        if (bypassed)
             return;
 
         const bool hasReset = pulseReset.process(args.sampleTime);
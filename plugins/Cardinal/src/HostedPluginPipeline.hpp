@@ -0,0 +1,262 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "plugin.hpp"
+#include "CarlaNativePlugin.h"
+#include "extra/Mutex.hpp"
+#include "extra/Sleep.hpp"
+#include "extra/Thread.hpp"
+
+#include <atomic>
+
+// -----------------------------------------------------------------------------------------------------------
+// Pipelined processing of a hosted Carla plugin, used by the Carla and Ildaeil modules.
+//
+// The audio thread gathers a block of samples as usual, but instead of processing it in place it queues it for
+// a worker thread, and picks it up again `depth` block boundaries later. The worker has that much time to process
+// it, which takes the hosted plugin off the audio thread so its cost is no longer paid all at once every block,
+// for `depth` extra blocks of latency. Modules with blocks smaller than the host ones use a depth covering a whole
+// host block, otherwise the worker would only get the time the engine spends on the rest of the host block.
+//
+// Slots are used in turn and handed over with atomics. A block that is not ready when picked up is waited for,
+// so no audio is lost when the system is loaded or when rendering faster than real-time.
+//
+// The worker thread can also be asked to reconfigure the hosted plugin (for things like a block size change),
+// which is then done outside of the audio thread while nothing is queued.
+
+template <uint NUM_INS, uint NUM_OUTS, uint MAX_BLOCK_SIZE, uint NUM_SLOTS = 2>
+struct HostedPluginPipeline {
+    enum SlotState {
+        kSlotFree,
+        kSlotQueued,
+        kSlotDone
+    };
+
+    static constexpr const uint kMaxMidiEvents = 128;
+    static constexpr const uint kMaxDepth = NUM_SLOTS - 1;
+
+    struct Slot {
+        std::atomic<int> state { kSlotFree };
+        uint32_t serial = 0;
+        uint32_t frames = MAX_BLOCK_SIZE;
+        uint32_t position = 0; // free for the module to use, like where the block starts in its own timeline
+        float in[NUM_INS][MAX_BLOCK_SIZE];
+        float out[NUM_OUTS][MAX_BLOCK_SIZE];
+        NativeTimeInfo timeInfo;
+        uint midiInCount = 0;
+        NativeMidiEvent midiIn[kMaxMidiEvents];
+        uint midiOutCount = 0;
+        NativeMidiEvent midiOut[kMaxMidiEvents];
+    };
+
+    /** Implemented by the module, runs the hosted plugin on a slot from the worker thread. */
+    struct Callback {
+        virtual ~Callback() {}
+        virtual void pipelineProcess(Slot& slot) = 0;
+        virtual void pipelineReconfigure() {}
+    };
+
+    Slot slots[NUM_SLOTS];
+    uint current = 0;
+    std::atomic<uint> depth { 1 };
+    uint32_t serial = 0;
+    std::atomic<bool> reconfigurePending { false };
+
+    struct Worker : DISTRHO_NAMESPACE::Thread {
+        HostedPluginPipeline* const pipeline;
+        Callback* const callback;
+        DISTRHO_NAMESPACE::Signal signal;
+        // raised after each processed block, for the audio thread waiting on a late one
+        DISTRHO_NAMESPACE::Signal doneSignal;
+
+        Worker(HostedPluginPipeline* const p, Callback* const c, const char* const name)
+            : Thread(name),
+              pipeline(p),
+              callback(c) {}
+
+        void run() override
+        {
+            while (! shouldThreadExit())
+            {
+                if (pipeline->reconfigurePending.load())
+                {
+                    callback->pipelineReconfigure();
+                    pipeline->reconfigurePending.store(false);
+                    continue;
+                }
+
+                Slot* const slot = pipeline->oldestQueuedSlot();
+
+                if (slot == nullptr)
+                {
+                    signal.wait();
+                    continue;
+                }
+
+                callback->pipelineProcess(*slot);
+                slot->state.store(kSlotDone);
+                doneSignal.signal();
+            }
+        }
+    } worker;
+
+    HostedPluginPipeline(Callback* const callback, const char* const name)
+        : worker(this, callback, name) {}
+
+    ~HostedPluginPipeline()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        worker.startThread();
+    }
+
+    void stop()
+    {
+        worker.signalThreadShouldExit();
+        worker.signal.signal();
+        worker.stopThread(-1);
+    }
+
+    /** Whether pipelined processing can be used, false if the worker thread could not be started. */
+    bool isAvailable() const noexcept
+    {
+        return worker.isThreadRunning();
+    }
+
+    /** Whether the worker has nothing left to process, the hosted plugin can then be used directly. */
+    bool isIdle() const noexcept
+    {
+        for (const Slot& slot : slots)
+        {
+            if (slot.state.load() == kSlotQueued)
+                return false;
+        }
+
+        return true;
+    }
+
+    /** Whether no block is in flight anymore, processed or not. */
+    bool isEmpty() const noexcept
+    {
+        for (const Slot& slot : slots)
+        {
+            if (slot.state.load() != kSlotFree)
+                return false;
+        }
+
+        return true;
+    }
+
+    /** Forget any processed block, only valid while idle. */
+    void reset() noexcept
+    {
+        for (Slot& slot : slots)
+            slot.state.store(kSlotFree);
+
+        current = 0;
+    }
+
+    /** Set how many block boundaries a block stays queued for, only valid while empty. */
+    void setDepth(const uint newDepth) noexcept
+    {
+        depth.store(std::max(1u, std::min(kMaxDepth, newDepth)));
+        reset();
+    }
+
+    /** Wait for the worker to finish its current work and reset, for when the audio thread is not running. */
+    void waitAndReset()
+    {
+        while (! isIdle() || isReconfiguring())
+            DISTRHO_NAMESPACE::d_msleep(1);
+
+        reset();
+    }
+
+    /**
+       Get the block queued `depth` boundaries ago, waiting for the worker if it is not done with it yet.
+       Returns nullptr if no block was queued back then. Must be followed by `release` once its data has been used.
+       Called from the audio thread once at each block boundary, before `acquire`.
+     */
+    Slot* consume() noexcept
+    {
+        current = (current + 1) % NUM_SLOTS;
+
+        Slot& slot(slots[(current + NUM_SLOTS - depth.load()) % NUM_SLOTS]);
+
+        // late, the block must not be lost so the worker gets the time it needs
+        while (slot.state.load() == kSlotQueued)
+            worker.doneSignal.wait();
+
+        return slot.state.load() == kSlotDone ? &slot : nullptr;
+    }
+
+    void release(Slot& slot) noexcept
+    {
+        slot.state.store(kSlotFree);
+    }
+
+    /**
+       Get the slot for the block gathered during this period, nullptr if it is somehow still in use.
+       The slot must be given back with `submit`.
+     */
+    Slot* acquire() noexcept
+    {
+        Slot& slot(slots[current]);
+
+        return slot.state.load() == kSlotFree ? &slot : nullptr;
+    }
+
+    void submit(Slot& slot) noexcept
+    {
+        slot.serial = serial++;
+        slot.state.store(kSlotQueued);
+        worker.signal.signal();
+    }
+
+    /**
+       Ask the worker to call `pipelineReconfigure`, the hosted plugin must not be used until `isReconfiguring`
+       returns false. Only valid while idle, returns false if the worker thread is not running.
+     */
+    bool requestReconfigure() noexcept
+    {
+        if (! isAvailable())
+            return false;
+
+        reconfigurePending.store(true);
+        worker.signal.signal();
+        return true;
+    }
+
+    bool isReconfiguring() const noexcept
+    {
+        return reconfigurePending.load();
+    }
+
+private:
+    // blocks are processed in the order they were queued, to keep the plugin state going
+    Slot* oldestQueuedSlot() noexcept
+    {
+        Slot* oldest = nullptr;
+
+        for (Slot& slot : slots)
+        {
+            if (slot.state.load() != kSlotQueued)
+                continue;
+
+            if (oldest == nullptr || static_cast<int32_t>(slot.serial - oldest->serial) < 0)
+                oldest = &slot;
+        }
+
+        return oldest;
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
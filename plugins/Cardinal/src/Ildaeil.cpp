@@ -28,6 +28,7 @@
 #include "plugin.hpp"
 #include "plugincontext.hpp"
 #include "Expander.hpp"
+#include "HostedPluginPipeline.hpp"
 
 #ifndef HEADLESS
 # include "ImGuiWidget.hpp"
@@ -38,6 +39,7 @@
 # include "water/files/FileInputStream.h"
 # include "water/files/FileOutputStream.h"
 # include "../../src/extra/SharedResourcePointer.hpp"
+# include <sys/stat.h>
 #else
 # include "extra/Mutex.hpp"
 # include "extra/String.hpp"
@@ -73,7 +75,14 @@ std::string getSpecialPath(const SpecialPath type);
 std::string homeDir();
 }
 
-#define BUFFER_SIZE 128
+// the hosted plugin is processed in blocks of the host buffer size, within these limits
+#define MIN_BUFFER_SIZE 16
+#define MAX_BUFFER_SIZE 4096
+#define DEFAULT_BUFFER_SIZE 128
+
+// fits the latency of a pipelined block plus the block itself
+#define AUDIO_RING_SIZE (MAX_BUFFER_SIZE * 4)
+#define AUDIO_RING_MASK (AUDIO_RING_SIZE - 1)
 
 // generates a warning if this is defined as anything else
 #define CARLA_API
@@ -381,6 +390,7 @@ struct JuceInitializer {
 
 struct IldaeilModule : Module {
     enum ParamIds {
+        PIPELINED,
         NUM_PARAMS
     };
     enum InputIds {
@@ -418,14 +428,58 @@ struct IldaeilModule : Module {
     void* fUI = nullptr;
     bool canUseBridges = true;
 
-    float audioDataIn1[BUFFER_SIZE];
-    float audioDataIn2[BUFFER_SIZE];
-    float audioDataOut1[BUFFER_SIZE];
-    float audioDataOut2[BUFFER_SIZE];
+    // blocks start along with host blocks, so the hosted plugin sees the same block boundaries and time info
+    float audioDataIn1[MAX_BUFFER_SIZE];
+    float audioDataIn2[MAX_BUFFER_SIZE];
+    float audioDataOut1[MAX_BUFFER_SIZE];
+    float audioDataOut2[MAX_BUFFER_SIZE];
     unsigned audioDataFill = 0;
+    uint32_t lastBlockFrames = 0;
     uint32_t lastProcessCounter = 0;
+    std::atomic<uint32_t> fBufferSize { DEFAULT_BUFFER_SIZE };
+    bool reconfiguring = false;
+
+    // buffer size changes without a pipeline worker are applied by the main thread, see prepareBlock
+    enum BufferSizeChange {
+        kBufferSizeUnchanged,
+        kBufferSizeRequested, // by the audio thread, which keeps processing at the old size
+        kBufferSizeClaimed,   // by the main thread, asking the audio thread to stop using the hosted plugin
+        kBufferSizeReady      // the audio thread stopped, the main thread can reconfigure
+    };
+    std::atomic<int> bufferSizeChange { kBufferSizeUnchanged };
+    std::atomic<uint32_t> requestedBufferSize { DEFAULT_BUFFER_SIZE };
+
+    // processed audio waiting to be played, indexed by audioFrame and cleared once read
+    float audioRing1[AUDIO_RING_SIZE];
+    float audioRing2[AUDIO_RING_SIZE];
+    uint32_t audioFrame = 0;
+    uint32_t audioBlockStart = 0;
     CardinalExpanderFromCarlaMIDIToCV* midiOutExpander = nullptr;
 
+    // optional pipelined processing, see HostedPluginPipeline.hpp
+    typedef HostedPluginPipeline<NUM_INPUTS, NUM_OUTPUTS, MAX_BUFFER_SIZE> Pipeline;
+    std::atomic<Pipeline::Slot*> fProcessSlot { nullptr }; // slot being processed by the worker thread
+    std::atomic<bool> pipelineActive { false }; // changes are logged by the widget, not the audio thread
+
+    struct PipelineCallback : Pipeline::Callback {
+        IldaeilModule* const module;
+
+        PipelineCallback(IldaeilModule* const m)
+            : module(m) {}
+
+        void pipelineProcess(Pipeline::Slot& slot) override
+        {
+            module->processSlot(slot);
+        }
+
+        void pipelineReconfigure() override
+        {
+            module->reconfigure();
+        }
+    } pipelineCallback { this };
+
+    Pipeline pipeline { &pipelineCallback, "Ildaeil pipeline" };
+
     volatile bool resetMeterIn = true;
     volatile bool resetMeterOut = true;
     float meterInL = 0.0f;
@@ -437,6 +491,7 @@ struct IldaeilModule : Module {
         : pcontext(static_cast<CardinalPluginContext*>(APP))
     {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+        configParam<SwitchQuantity>(PIPELINED, 0.f, 1.f, 0.f, "Pipelined Processing")->randomizeEnabled = false;
         for (uint i=0; i<2; ++i)
         {
             const char name[] = { 'A','u','d','i','o',' ','#',static_cast<char>('0'+i+1),'\0' };
@@ -445,6 +500,9 @@ struct IldaeilModule : Module {
         }
         std::memset(audioDataOut1, 0, sizeof(audioDataOut1));
         std::memset(audioDataOut2, 0, sizeof(audioDataOut2));
+        std::memset(audioRing1, 0, sizeof(audioRing1));
+        std::memset(audioRing2, 0, sizeof(audioRing2));
+        fBufferSize = getHostBufferSize();
 
         fCarlaPluginDescriptor = carla_get_native_rack_plugin();
         DISTRHO_SAFE_ASSERT_RETURN(fCarlaPluginDescriptor != nullptr,);
@@ -551,10 +609,14 @@ struct IldaeilModule : Module {
                                            0, 0, nullptr, 0.0f);
 
         fCarlaPluginDescriptor->activate(fCarlaPluginHandle);
+
+        pipeline.start();
     }
 
     ~IldaeilModule() override
     {
+        pipeline.stop();
+
         if (fCarlaPluginHandle != nullptr)
             fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
 
@@ -567,7 +629,51 @@ struct IldaeilModule : Module {
 
     const NativeTimeInfo* hostGetTimeInfo() const noexcept
     {
-        return &fCarlaTimeInfo;
+        const Pipeline::Slot* const slot = fProcessSlot.load();
+        return slot != nullptr ? &slot->timeInfo : &fCarlaTimeInfo;
+    }
+
+    bool hostWriteMidiEvent(const NativeMidiEvent* const event)
+    {
+        // running on the pipeline worker, events are passed on when the block is picked up
+        if (Pipeline::Slot* const slot = fProcessSlot.load())
+        {
+            if (slot->midiOutCount == Pipeline::kMaxMidiEvents)
+                return false;
+
+            carla_copyStruct(slot->midiOut[slot->midiOutCount++], *event);
+            return true;
+        }
+
+        if (CardinalExpanderFromCarlaMIDIToCV* const expander = midiOutExpander)
+        {
+            if (expander->midiEventCount == CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS)
+                return false;
+
+            NativeMidiEvent& expanderEvent(expander->midiEvents[expander->midiEventCount++]);
+            carla_copyStruct(expanderEvent, *event);
+            return true;
+        }
+
+        return false;
+    }
+
+    /** Processing latency in frames, one block more when pipelined. */
+    uint32_t getLatencyFrames() const noexcept
+    {
+        const uint32_t bufferSize = fBufferSize;
+        return pipelineActive ? bufferSize * 2 : bufferSize;
+    }
+
+    /** Block size to use for the hosted plugin, matching the host one if possible. */
+    uint32_t getHostBufferSize() const noexcept
+    {
+        const uint32_t bufferSize = pcontext->bufferSize;
+
+        if (bufferSize == 0)
+            return DEFAULT_BUFFER_SIZE;
+
+        return std::max<uint32_t>(MIN_BUFFER_SIZE, std::min<uint32_t>(MAX_BUFFER_SIZE, bufferSize));
     }
 
     intptr_t hostDispatcher(const NativeHostDispatcherOpcode opcode,
@@ -644,110 +750,293 @@ struct IldaeilModule : Module {
         if (fCarlaPluginHandle == nullptr)
             return;
 
+        const uint32_t processCounter = pcontext->processCounter;
+        const bool hostBlockStart = lastProcessCounter != processCounter;
+
+        if (hostBlockStart)
+        {
+            lastProcessCounter = processCounter;
+
+            // the host block ended before ours, process what we have so the next block starts aligned again
+            if (audioDataFill != 0)
+                processBlock();
+        }
+
+        const bool running = audioDataFill != 0 || prepareBlock(args.sampleRate, hostBlockStart);
+
+        const uint32_t ringPos = audioFrame++ & AUDIO_RING_MASK;
+
+        outputs[OUTPUT1].setVoltage(audioRing1[ringPos] * 10.0f);
+        outputs[OUTPUT2].setVoltage(audioRing2[ringPos] * 10.0f);
+        audioRing1[ringPos] = audioRing2[ringPos] = 0.0f;
+
+        if (! running)
+            return;
+
         const unsigned i = audioDataFill++;
 
         audioDataIn1[i] = inputs[INPUT1].getVoltage() * 0.1f;
         audioDataIn2[i] = inputs[INPUT2].getVoltage() * 0.1f;
-        outputs[OUTPUT1].setVoltage(audioDataOut1[i] * 10.0f);
-        outputs[OUTPUT2].setVoltage(audioDataOut2[i] * 10.0f);
 
-        if (audioDataFill == BUFFER_SIZE)
+        if (audioDataFill >= fBufferSize)
+            processBlock();
+    }
+
+    // called at the start of each block, returns false while the hosted plugin is being reconfigured
+    bool prepareBlock(const double sampleRate, const bool hostBlockStart)
+    {
+        if (reconfiguring)
         {
-            const uint32_t processCounter = pcontext->processCounter;
+            // resume at the start of a host block, so we are aligned with it again
+            if (pipeline.isReconfiguring() || bufferSizeChange.load() != kBufferSizeUnchanged || ! hostBlockStart)
+                return false;
 
-            // Update time position if running a new audio block
-            if (lastProcessCounter != processCounter)
+            reconfiguring = false;
+        }
+
+        const uint32_t bufferSize = getHostBufferSize();
+
+        // the main thread is ready to reconfigure, stop using the hosted plugin until it is done
+        if (bufferSizeChange.load() == kBufferSizeClaimed)
+        {
+            requestedBufferSize.store(bufferSize);
+            bufferSizeChange.store(kBufferSizeReady);
+            reconfiguring = true;
+            return false;
+        }
+
+        // the host buffer size changed, reconfigure once pipelined blocks still in flight are done.
+        // the hosted plugin must not be reconfigured on the audio thread, the pipeline worker does it if there is one.
+        if (bufferSize != fBufferSize && pipeline.isEmpty())
+        {
+            const uint32_t oldBufferSize = fBufferSize;
+            fBufferSize = bufferSize;
+            pipeline.reset();
+
+            if (pipeline.requestReconfigure())
             {
-                lastProcessCounter = processCounter;
-                fCarlaTimeInfo.playing = pcontext->playing;
-                fCarlaTimeInfo.frame = pcontext->frame;
-                fCarlaTimeInfo.bbt.valid = pcontext->bbtValid;
-                fCarlaTimeInfo.bbt.bar = pcontext->bar;
-                fCarlaTimeInfo.bbt.beat = pcontext->beat;
-                fCarlaTimeInfo.bbt.tick = pcontext->tick;
-                fCarlaTimeInfo.bbt.barStartTick = pcontext->barStartTick;
-                fCarlaTimeInfo.bbt.beatsPerBar = pcontext->beatsPerBar;
-                fCarlaTimeInfo.bbt.beatType = pcontext->beatType;
-                fCarlaTimeInfo.bbt.ticksPerBeat = pcontext->ticksPerBeat;
-                fCarlaTimeInfo.bbt.beatsPerMinute = pcontext->beatsPerMinute;
+                reconfiguring = true;
+                return false;
             }
-            // or advance time by BUFFER_SIZE frames if still under the same audio block
-            else if (fCarlaTimeInfo.playing)
+
+            // otherwise the main thread does, keep going at the old size until it gets to it
+            fBufferSize = oldBufferSize;
+
+            if (bufferSizeChange.load() == kBufferSizeUnchanged)
+                bufferSizeChange.store(kBufferSizeRequested);
+        }
+
+        audioBlockStart = audioFrame;
+
+        // Update time position if running a new audio block
+        if (hostBlockStart)
+        {
+            fCarlaTimeInfo.playing = pcontext->playing;
+            fCarlaTimeInfo.frame = pcontext->frame;
+            fCarlaTimeInfo.bbt.valid = pcontext->bbtValid;
+            fCarlaTimeInfo.bbt.bar = pcontext->bar;
+            fCarlaTimeInfo.bbt.beat = pcontext->beat;
+            fCarlaTimeInfo.bbt.tick = pcontext->tick;
+            fCarlaTimeInfo.bbt.barStartTick = pcontext->barStartTick;
+            fCarlaTimeInfo.bbt.beatsPerBar = pcontext->beatsPerBar;
+            fCarlaTimeInfo.bbt.beatType = pcontext->beatType;
+            fCarlaTimeInfo.bbt.ticksPerBeat = pcontext->ticksPerBeat;
+            fCarlaTimeInfo.bbt.beatsPerMinute = pcontext->beatsPerMinute;
+        }
+        // or advance time by the previous block size if still under the same audio block,
+        // only happens when the host block is bigger than MAX_BUFFER_SIZE
+        else if (fCarlaTimeInfo.playing)
+        {
+            fCarlaTimeInfo.frame += lastBlockFrames;
+
+            // adjust BBT as well
+            if (fCarlaTimeInfo.bbt.valid)
             {
-                fCarlaTimeInfo.frame += BUFFER_SIZE;
+                const double samplesPerTick = 60.0 * sampleRate
+                                            / fCarlaTimeInfo.bbt.beatsPerMinute
+                                            / fCarlaTimeInfo.bbt.ticksPerBeat;
 
-                // adjust BBT as well
-                if (fCarlaTimeInfo.bbt.valid)
-                {
-                    const double samplesPerTick = 60.0 * args.sampleRate
-                                                / fCarlaTimeInfo.bbt.beatsPerMinute
-                                                / fCarlaTimeInfo.bbt.ticksPerBeat;
+                int32_t newBar = fCarlaTimeInfo.bbt.bar;
+                int32_t newBeat = fCarlaTimeInfo.bbt.beat;
+                double newTick = fCarlaTimeInfo.bbt.tick + (double)lastBlockFrames / samplesPerTick;
 
-                    int32_t newBar = fCarlaTimeInfo.bbt.bar;
-                    int32_t newBeat = fCarlaTimeInfo.bbt.beat;
-                    double newTick = fCarlaTimeInfo.bbt.tick + (double)BUFFER_SIZE / samplesPerTick;
+                while (newTick >= fCarlaTimeInfo.bbt.ticksPerBeat)
+                {
+                    newTick -= fCarlaTimeInfo.bbt.ticksPerBeat;
 
-                    while (newTick >= fCarlaTimeInfo.bbt.ticksPerBeat)
+                    if (++newBeat > fCarlaTimeInfo.bbt.beatsPerBar)
                     {
-                        newTick -= fCarlaTimeInfo.bbt.ticksPerBeat;
+                        newBeat = 1;
 
-                        if (++newBeat > fCarlaTimeInfo.bbt.beatsPerBar)
-                        {
-                            newBeat = 1;
-
-                            ++newBar;
-                            fCarlaTimeInfo.bbt.barStartTick += fCarlaTimeInfo.bbt.beatsPerBar * fCarlaTimeInfo.bbt.ticksPerBeat;
-                        }
+                        ++newBar;
+                        fCarlaTimeInfo.bbt.barStartTick += fCarlaTimeInfo.bbt.beatsPerBar * fCarlaTimeInfo.bbt.ticksPerBeat;
                     }
-
-                    fCarlaTimeInfo.bbt.bar = newBar;
-                    fCarlaTimeInfo.bbt.beat = newBeat;
-                    fCarlaTimeInfo.bbt.tick = newTick;
                 }
+
+                fCarlaTimeInfo.bbt.bar = newBar;
+                fCarlaTimeInfo.bbt.beat = newBeat;
+                fCarlaTimeInfo.bbt.tick = newTick;
             }
+        }
+
+        return true;
+    }
+
+    void processBlock()
+    {
+        const uint32_t frames = lastBlockFrames = audioDataFill;
+        audioDataFill = 0;
 
-            NativeMidiEvent* midiEvents;
-            uint midiEventCount;
+        NativeMidiEvent* midiEvents;
+        uint midiEventCount;
 
-            if (CardinalExpanderFromCVToCarlaMIDI* const midiInExpander
-                    = leftExpander.module != nullptr && leftExpander.module->model == modelExpanderInputMIDI
-                    ? static_cast<CardinalExpanderFromCVToCarlaMIDI*>(leftExpander.module)
-                    : nullptr)
+        if (CardinalExpanderFromCVToCarlaMIDI* const midiInExpander
+                = leftExpander.module != nullptr && leftExpander.module->model == modelExpanderInputMIDI
+                ? static_cast<CardinalExpanderFromCVToCarlaMIDI*>(leftExpander.module)
+                : nullptr)
+        {
+            midiEvents = midiInExpander->midiEvents;
+            midiEventCount = midiInExpander->midiEventCount;
+            midiInExpander->midiEventCount = midiInExpander->frame = 0;
+        }
+        else
+        {
+            midiEvents = nullptr;
+            midiEventCount = 0;
+        }
+
+        if ((midiOutExpander = rightExpander.module != nullptr && rightExpander.module->model == modelExpanderOutputMIDI
+                             ? static_cast<CardinalExpanderFromCarlaMIDIToCV*>(rightExpander.module)
+                             : nullptr))
+            midiOutExpander->midiEventCount = 0;
+
+        float* ins[2] = { audioDataIn1, audioDataIn2 };
+        float* outs[2] = { audioDataOut1, audioDataOut2 };
+
+        if (resetMeterIn)
+            meterInL = meterInR = 0.0f;
+
+        meterInL = std::max(meterInL, d_findMaxNormalizedFloat(audioDataIn1, frames));
+        meterInR = std::max(meterInR, d_findMaxNormalizedFloat(audioDataIn2, frames));
+
+        if (resetMeterOut)
+            meterOutL = meterOutR = 0.0f;
+
+        // keep going through the pipeline while it still has blocks to process after being turned off,
+        // or while they drain for a buffer size change
+        const bool pipelined = params[PIPELINED].getValue() > 0.5f && pipeline.isAvailable()
+                            && fBufferSize == getHostBufferSize();
+
+        if (pipelined || ! pipeline.isEmpty())
+        {
+            if (! pipelineActive.load())
+                pipelineActive.store(true);
+
+            processPipelined(midiEvents, midiEventCount, frames, pipelined);
+        }
+        else
+        {
+            if (pipelineActive.load())
             {
-                midiEvents = midiInExpander->midiEvents;
-                midiEventCount = midiInExpander->midiEventCount;
-                midiInExpander->midiEventCount = midiInExpander->frame = 0;
+                pipelineActive.store(false);
+                pipeline.reset();
             }
-            else
+
+            fCarlaPluginDescriptor->process(fCarlaPluginHandle, ins, outs, frames, midiEvents, midiEventCount);
+
+            writeOutput(audioBlockStart, audioDataOut1, audioDataOut2, frames);
+        }
+
+        resetMeterIn = resetMeterOut = false;
+    }
+
+    void processPipelined(const NativeMidiEvent* const midiEvents, const uint midiEventCount,
+                          const uint32_t frames, const bool queueBlock)
+    {
+        if (Pipeline::Slot* const slot = pipeline.consume())
+        {
+            writeOutput(slot->position, slot->out[0], slot->out[1], slot->frames);
+
+            if (midiOutExpander != nullptr && slot->midiOutCount != 0)
             {
-                midiEvents = nullptr;
-                midiEventCount = 0;
+                const uint count = std::min(slot->midiOutCount, CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS);
+                std::memcpy(midiOutExpander->midiEvents, slot->midiOut, sizeof(NativeMidiEvent) * count);
+                midiOutExpander->midiEventCount = count;
             }
 
-            if ((midiOutExpander = rightExpander.module != nullptr && rightExpander.module->model == modelExpanderOutputMIDI
-                                 ? static_cast<CardinalExpanderFromCarlaMIDIToCV*>(rightExpander.module)
-                                 : nullptr))
-                midiOutExpander->midiEventCount = 0;
+            pipeline.release(*slot);
+        }
 
-            audioDataFill = 0;
-            float* ins[2] = { audioDataIn1, audioDataIn2 };
-            float* outs[2] = { audioDataOut1, audioDataOut2 };
+        if (! queueBlock)
+            return;
 
-            if (resetMeterIn)
-                meterInL = meterInR = 0.0f;
+        if (Pipeline::Slot* const slot = pipeline.acquire())
+        {
+            std::memcpy(slot->in[0], audioDataIn1, sizeof(float) * frames);
+            std::memcpy(slot->in[1], audioDataIn2, sizeof(float) * frames);
+            slot->frames = frames;
+            slot->position = audioBlockStart;
+            slot->timeInfo = fCarlaTimeInfo;
+            slot->midiInCount = std::min(midiEventCount, Pipeline::kMaxMidiEvents);
 
-            meterInL = std::max(meterInL, d_findMaxNormalizedFloat128(audioDataIn1));
-            meterInR = std::max(meterInR, d_findMaxNormalizedFloat128(audioDataIn2));
+            if (slot->midiInCount != 0)
+                std::memcpy(slot->midiIn, midiEvents, sizeof(NativeMidiEvent) * slot->midiInCount);
+
+            pipeline.submit(*slot);
+        }
+    }
+
+    // place a processed block in the output ring, to be played one latency after it was gathered
+    void writeOutput(const uint32_t blockStart, const float* const out1, const float* const out2, const uint32_t frames)
+    {
+        const uint32_t position = blockStart + getLatencyFrames();
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            const uint32_t ringPos = (position + i) & AUDIO_RING_MASK;
+            audioRing1[ringPos] = out1[i];
+            audioRing2[ringPos] = out2[i];
+        }
+
+        meterOutL = std::max(meterOutL, d_findMaxNormalizedFloat(out1, frames));
+        meterOutR = std::max(meterOutR, d_findMaxNormalizedFloat(out2, frames));
+    }
+
+    // called from the pipeline worker thread
+    void processSlot(Pipeline::Slot& slot)
+    {
+        float* ins[2] = { slot.in[0], slot.in[1] };
+        float* outs[2] = { slot.out[0], slot.out[1] };
 
-            fCarlaPluginDescriptor->process(fCarlaPluginHandle, ins, outs, BUFFER_SIZE, midiEvents, midiEventCount);
+        slot.midiOutCount = 0;
 
-            if (resetMeterOut)
-                meterOutL = meterOutR = 0.0f;
+        fProcessSlot.store(&slot);
+        fCarlaPluginDescriptor->process(fCarlaPluginHandle, ins, outs, slot.frames, slot.midiIn, slot.midiInCount);
+        fProcessSlot.store(nullptr);
+    }
 
-            meterOutL = std::max(meterOutL, d_findMaxNormalizedFloat128(audioDataOut1));
-            meterOutR = std::max(meterOutR, d_findMaxNormalizedFloat128(audioDataOut2));
+    // called from the pipeline worker thread, or the main thread while the audio thread stays away
+    void reconfigure()
+    {
+        fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
+        fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_BUFFER_SIZE_CHANGED,
+                                           0, fBufferSize, nullptr, 0.0f);
+        fCarlaPluginDescriptor->activate(fCarlaPluginHandle);
+    }
 
-            resetMeterIn = resetMeterOut = false;
+    /** Applies a buffer size change that prepareBlock could not hand to the pipeline worker, on the main thread. */
+    void idleBufferSizeChange()
+    {
+        switch (bufferSizeChange.load())
+        {
+        case kBufferSizeRequested:
+            bufferSizeChange.store(kBufferSizeClaimed);
+            break;
+        case kBufferSizeReady:
+            fBufferSize = requestedBufferSize.load();
+            reconfigure();
+            bufferSizeChange.store(kBufferSizeUnchanged);
+            break;
         }
     }
 
@@ -765,7 +1054,19 @@ struct IldaeilModule : Module {
         resetMeterIn = resetMeterOut = true;
         midiOutExpander = nullptr;
 
+        // the engine is not processing at this point, only the pipeline worker can still be busy
+        pipeline.waitAndReset();
+        pipelineActive.store(false);
+        reconfiguring = false;
+        bufferSizeChange.store(kBufferSizeUnchanged);
+        audioDataFill = 0;
+
+        // take any pending buffer size change along, saves a later reconfigure
+        fBufferSize = getHostBufferSize();
+
         fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
+        fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_BUFFER_SIZE_CHANGED,
+                                           0, fBufferSize, nullptr, 0.0f);
         fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_SAMPLE_RATE_CHANGED,
                                            0, 0, nullptr, e.sampleRate);
         fCarlaPluginDescriptor->activate(fCarlaPluginHandle);
@@ -776,7 +1077,7 @@ struct IldaeilModule : Module {
 
 static uint32_t host_get_buffer_size(const NativeHostHandle handle)
 {
-    return BUFFER_SIZE;
+    return static_cast<IldaeilModule*>(handle)->fBufferSize;
 }
 
 static double host_get_sample_rate(const NativeHostHandle handle)
@@ -798,17 +1099,7 @@ static const NativeTimeInfo* host_get_time_info(const NativeHostHandle handle)
 
 static bool host_write_midi_event(const NativeHostHandle handle, const NativeMidiEvent* const event)
 {
-    if (CardinalExpanderFromCarlaMIDIToCV* const expander = static_cast<IldaeilModule*>(handle)->midiOutExpander)
-    {
-        if (expander->midiEventCount == CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS)
-            return false;
-
-        NativeMidiEvent& expanderEvent(expander->midiEvents[expander->midiEventCount++]);
-        carla_copyStruct(expanderEvent, *event);
-        return true;
-    }
-
-    return false;
+    return static_cast<IldaeilModule*>(handle)->hostWriteMidiEvent(event);
 }
 
 static void host_ui_midi_program_changed(NativeHostHandle handle, uint8_t channel, uint32_t bank, uint32_t program)
@@ -837,6 +1128,7 @@ static intptr_t host_dispatcher(const NativeHostHandle handle, const NativeHostD
 #ifndef HEADLESS
 struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
     static constexpr const uint kButtonHeight = 20;
+    static constexpr const int kPluginListVersion = 1;
 
     struct PluginInfoCache {
         BinaryType btype;
@@ -925,25 +1217,56 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         kIdleHidePluginUI,
         kIdleGiveIdleToUI,
         kIdleChangePluginType,
+        kIdleRescanPlugins,
         kIdleNothing
     } fIdleState = kIdleInit;
 
+    // one discovery tool run, each in its own process so a bad plugin binary cannot take us down
+    struct DiscoveryJob {
+        BinaryType btype;
+        String tool;
+        String path;
+    };
+
     struct RunnerData {
         bool needsReinit = true;
-        CarlaPluginDiscoveryHandle handle = nullptr;
+        bool forceRescan = false; // ignore the cached list, for changes the signature does not catch
+        bool incomplete = false;
+        uint64_t signature = 0;
+        std::vector<DiscoveryJob> pending;
+        std::vector<CarlaPluginDiscoveryHandle> handles;
 
         void init()
         {
             needsReinit = true;
+            incomplete = false;
+            pending.clear();
 
-            if (handle != nullptr)
-            {
+            for (CarlaPluginDiscoveryHandle handle : handles)
                 carla_plugin_discovery_stop(handle);
-                handle = nullptr;
-            }
+
+            handles.clear();
         }
     } fRunnerData;
 
+    // plugin list of the last complete scan, shared by all instances and saved to disk for the next session
+    struct PluginListCache {
+        bool valid = false;
+        uint64_t signature = 0;
+        std::vector<PluginInfoCache> plugins;
+    };
+
+    struct PluginListCaches {
+        Mutex mutex;
+        PluginListCache lists[PLUGIN_TYPE_COUNT];
+    };
+
+    static PluginListCaches& getPluginListCaches()
+    {
+        static PluginListCaches caches;
+        return caches;
+    }
+
     BinaryType fBinaryType = BINARY_NATIVE;
    #ifdef CARLA_OS_WASM
     PluginType fPluginType = PLUGIN_JSFX;
@@ -1476,6 +1799,14 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             }
             break;
 
+        case kIdleRescanPlugins:
+            fIdleState = kIdleNothing;
+            fPluginSelected = -1;
+            stopRunner();
+            fRunnerData.forceRescan = true;
+            initAndStartRunner();
+            break;
+
         case kIdleNothing:
             break;
         }
@@ -1512,6 +1843,21 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         {
             fRunnerData.needsReinit = false;
 
+            const String& binaryPath(module->fBinaryPath);
+
+            fRunnerData.signature = getPluginListSignature(fPluginType, binaryPath);
+
+            if (fRunnerData.forceRescan)
+            {
+                fRunnerData.forceRescan = false;
+            }
+            else if (loadPluginList())
+            {
+                d_stdout("Nothing changed since last scan, using %lu cached plugins", (ulong)fPlugins.size());
+                showPluginList();
+                return false;
+            }
+
             {
                 const MutexLocker cml(fPluginsMutex);
                 fPlugins.clear();
@@ -1519,76 +1865,318 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
 
             d_stdout("Will scan plugins now...");
 
-            const String& binaryPath(module->fBinaryPath);
-
             if (binaryPath.isNotEmpty())
-            {
-                fBinaryType = BINARY_NATIVE;
-
-                fDiscoveryTool  = binaryPath;
-                fDiscoveryTool += DISTRHO_OS_SEP_STR "carla-discovery-native";
-               #ifdef CARLA_OS_WIN
-                fDiscoveryTool += ".exe";
-               #endif
-
-                fRunnerData.handle = carla_plugin_discovery_start(fDiscoveryTool,
-                                                                  fBinaryType,
-                                                                  fPluginType,
-                                                                  getPluginPath(fPluginType),
-                                                                  _binaryPluginSearchCallback,
-                                                                  _binaryPluginCheckCacheCallback,
-                                                                  this);
+                queueDiscoveryJobs(binaryPath);
 
-            }
+            showPluginList();
 
-            if (fDrawingState == kDrawingLoading)
-            {
-                fDrawingState = kDrawingPluginList;
-                fPluginSearchFirstShow = true;
-            }
-
-            if (binaryPath.isEmpty() || (fRunnerData.handle == nullptr && !startNextDiscovery()))
+            if (fRunnerData.pending.empty())
             {
                 d_stdout("Nothing found!");
                 return false;
             }
         }
 
-        DISTRHO_SAFE_ASSERT_RETURN(fRunnerData.handle != nullptr, false);
+        // keep as many discovery tools running at once as we have cores
+        const size_t maxJobs = std::max(1, system::getLogicalCoreCount());
 
-        if (carla_plugin_discovery_idle(fRunnerData.handle))
-            return true;
+        while (fRunnerData.handles.size() < maxJobs && ! fRunnerData.pending.empty())
+        {
+            const DiscoveryJob job(fRunnerData.pending.front());
+            fRunnerData.pending.erase(fRunnerData.pending.begin());
+
+            const CarlaPluginDiscoveryHandle handle = carla_plugin_discovery_start(job.tool,
+                                                                                   job.btype,
+                                                                                   fPluginType,
+                                                                                   job.path.isNotEmpty() ? job.path.buffer() : nullptr,
+                                                                                   _binaryPluginSearchCallback,
+                                                                                   _binaryPluginCheckCacheCallback,
+                                                                                   this);
+
+            if (handle != nullptr)
+                fRunnerData.handles.push_back(handle);
+            else
+                fRunnerData.incomplete = true;
+        }
+
+        for (size_t i = 0; i < fRunnerData.handles.size();)
+        {
+            if (carla_plugin_discovery_idle(fRunnerData.handles[i]))
+            {
+                ++i;
+                continue;
+            }
 
-        // stop here
-        carla_plugin_discovery_stop(fRunnerData.handle);
-        fRunnerData.handle = nullptr;
+            carla_plugin_discovery_stop(fRunnerData.handles[i]);
+            fRunnerData.handles.erase(fRunnerData.handles.begin() + i);
+        }
 
-        if (startNextDiscovery())
+        if (! fRunnerData.handles.empty() || ! fRunnerData.pending.empty())
             return true;
 
         d_stdout("Found %lu plugins!", (ulong)fPlugins.size());
+
+        // do not keep a list that might be missing plugins because a discovery tool did not start
+        if (! fRunnerData.incomplete)
+            savePluginList();
+
         return false;
     }
 
-    bool startNextDiscovery()
+    void showPluginList()
     {
-        if (! setNextDiscoveryTool())
-            return false;
+        if (fDrawingState == kDrawingLoading)
+        {
+            fDrawingState = kDrawingPluginList;
+            fPluginSearchFirstShow = true;
+        }
+    }
+
+    void queueDiscoveryJobs(const String& binaryPath)
+    {
+        fBinaryType = BINARY_NATIVE;
+
+        fDiscoveryTool  = binaryPath;
+        fDiscoveryTool += DISTRHO_OS_SEP_STR "carla-discovery-native";
+       #ifdef CARLA_OS_WIN
+        fDiscoveryTool += ".exe";
+       #endif
+
+        const char* const pluginPath = getPluginPath(fPluginType);
+
+        // file based formats are scanned one directory per job, so a big folder does not hold back the others.
+        // LV2 bundles can depend on each other across directories, so those are always scanned together.
+        bool splitPath;
+        switch (fPluginType)
+        {
+        case PLUGIN_LADSPA:
+        case PLUGIN_DSSI:
+        case PLUGIN_VST2:
+        case PLUGIN_VST3:
+        case PLUGIN_CLAP:
+            splitPath = pluginPath != nullptr;
+            break;
+        default:
+            splitPath = false;
+            break;
+        }
+
+        const std::vector<std::string> paths(splitPath ? splitPluginPath(pluginPath)
+                                                       : std::vector<std::string>(1, pluginPath != nullptr ? pluginPath : ""));
+
+        do {
+            for (const std::string& path : paths)
+                fRunnerData.pending.push_back({ fBinaryType, fDiscoveryTool, String(path.c_str()) });
+        } while (setNextDiscoveryTool());
+    }
+
+    static std::vector<std::string> splitPluginPath(const char* const pluginPath)
+    {
+       #ifdef CARLA_OS_WIN
+        static constexpr const char kSplit = ';';
+       #else
+        static constexpr const char kSplit = ':';
+       #endif
+
+        std::vector<std::string> paths;
+        const std::string path(pluginPath);
+
+        for (size_t start = 0, end; start <= path.size(); start = end + 1)
+        {
+            end = path.find(kSplit, start);
+
+            if (end == std::string::npos)
+                end = path.size();
+
+            if (end != start)
+                paths.push_back(path.substr(start, end - start));
+        }
+
+        return paths;
+    }
+
+    /**
+       Fingerprint of everything a scan looks at: discovery tools, plugin paths, and the files and bundles in them
+       (2 levels deep) along with their size and modification time.
+       Only stats files, so it is cheap enough to check every time the plugin list is shown.
+       Changes deeper inside bundles are not seen, the "Rescan" button skips the cached list for those.
+       Files that did change are then rescanned individually, the others being read from carla's per-file cache.
+     */
+    static uint64_t getPluginListSignature(const PluginType ptype, const String& binaryPath)
+    {
+        // FNV-1a
+        uint64_t hash = 0xcbf29ce484222325ULL;
+
+        const auto hashBytes = [&hash](const void* const data, const size_t size)
+        {
+            const uint8_t* const bytes = static_cast<const uint8_t*>(data);
+
+            for (size_t i = 0; i < size; ++i)
+                hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        };
+
+        const auto hashFile = [&hashBytes](const std::string& filename)
+        {
+            struct stat st;
+            if (::stat(filename.c_str(), &st) != 0)
+                return;
+
+            const int64_t size = st.st_size;
+            const int64_t mtime = st.st_mtime;
+
+            hashBytes(filename.c_str(), filename.size());
+            hashBytes(&size, sizeof(size));
+            hashBytes(&mtime, sizeof(mtime));
+        };
 
-        fRunnerData.handle = carla_plugin_discovery_start(fDiscoveryTool,
-                                                          fBinaryType,
-                                                          fPluginType,
-                                                          getPluginPath(fPluginType),
-                                                          _binaryPluginSearchCallback,
-                                                          _binaryPluginCheckCacheCallback,
-                                                          this);
+        hashBytes(&ptype, sizeof(ptype));
 
-        if (fRunnerData.handle == nullptr)
-            return startNextDiscovery();
+        if (binaryPath.isNotEmpty() && system::isDirectory(binaryPath.buffer()))
+        {
+            for (const std::string& entry : system::getEntries(binaryPath.buffer()))
+            {
+                if (string::startsWith(system::getFilename(entry), "carla-discovery-"))
+                    hashFile(entry);
+            }
+        }
+
+        const char* const pluginPath = getPluginPath(ptype);
+
+        if (pluginPath == nullptr)
+            return hash;
+
+        hashBytes(pluginPath, std::strlen(pluginPath));
+
+        for (const std::string& path : splitPluginPath(pluginPath))
+        {
+            if (! system::isDirectory(path))
+                continue;
 
+            std::vector<std::string> entries(system::getEntries(path, 1));
+            std::sort(entries.begin(), entries.end());
+
+            for (const std::string& entry : entries)
+                hashFile(entry);
+        }
+
+        return hash;
+    }
+
+    static water::File getPluginListFile(const PluginType ptype)
+    {
+        const String configDir(asset::config("Ildaeil").c_str());
+        return water::File(configDir + CARLA_OS_SEP_STR "cache" CARLA_OS_SEP_STR "list-" + getPluginTypeAsString(ptype));
+    }
+
+    // use the list from a previous scan if nothing changed since, from memory or disk
+    bool loadPluginList()
+    {
+        PluginListCaches& caches(getPluginListCaches());
+        const MutexLocker cml(caches.mutex);
+
+        PluginListCache& cache(caches.lists[fPluginType]);
+
+        if (! cache.valid)
+        {
+            cache.valid = true;
+
+            const water::File listFile(getPluginListFile(fPluginType));
+
+            if (listFile.existsAsFile())
+            {
+                water::FileInputStream stream(listFile);
+
+                if (stream.openedOk() && stream.readInt() == kPluginListVersion)
+                {
+                    cache.signature = stream.readInt64();
+
+                    const int count = stream.readInt();
+
+                    for (int i = 0; i < count && ! stream.isExhausted(); ++i)
+                    {
+                        PluginInfoCache info;
+                        info.btype = static_cast<BinaryType>(stream.readInt());
+                        info.uniqueId = stream.readInt64();
+                        info.filename = stream.readString().toRawUTF8();
+                        info.name = stream.readString().toRawUTF8();
+                        info.label = stream.readString().toRawUTF8();
+                        cache.plugins.push_back(info);
+                    }
+
+                    // truncated file
+                    if (static_cast<int>(cache.plugins.size()) != count)
+                        cache.valid = false;
+                }
+                else
+                {
+                    cache.valid = false;
+                }
+            }
+            else
+            {
+                cache.valid = false;
+            }
+
+            if (! cache.valid)
+                cache.plugins.clear();
+        }
+
+        if (! cache.valid || cache.signature != fRunnerData.signature)
+            return false;
+
+        const MutexLocker cml2(fPluginsMutex);
+        fPlugins = cache.plugins;
         return true;
     }
 
+    void savePluginList()
+    {
+        PluginListCaches& caches(getPluginListCaches());
+        const MutexLocker cml(caches.mutex);
+
+        PluginListCache& cache(caches.lists[fPluginType]);
+
+        {
+            const MutexLocker cml2(fPluginsMutex);
+            cache.plugins = fPlugins;
+        }
+
+        cache.valid = true;
+        cache.signature = fRunnerData.signature;
+
+        const water::File listFile(getPluginListFile(fPluginType));
+
+        // streams append to existing files
+        listFile.deleteFile();
+
+        if (! listFile.create().ok())
+        {
+            d_stderr("Failed to write plugin list cache directories");
+            return;
+        }
+
+        water::FileOutputStream stream(listFile);
+
+        if (! stream.openedOk())
+        {
+            d_stderr("Failed to write plugin list cache file");
+            return;
+        }
+
+        stream.writeInt(kPluginListVersion);
+        stream.writeInt64(cache.signature);
+        stream.writeInt(static_cast<int>(cache.plugins.size()));
+
+        for (const PluginInfoCache& info : cache.plugins)
+        {
+            stream.writeInt(info.btype);
+            stream.writeInt64(info.uniqueId);
+            stream.writeString(info.filename.c_str());
+            stream.writeString(info.name.c_str());
+            stream.writeString(info.label.c_str());
+        }
+    }
+
     bool setNextDiscoveryTool()
     {
         switch (fPluginType)
@@ -2177,6 +2765,14 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
                     fDrawingState = kDrawingPluginGenericUI;
             }
 
+            if (fPluginType != PLUGIN_INTERNAL)
+            {
+                ImGui::SameLine();
+
+                if (ImGui::Button("Rescan"))
+                    fIdleState = kIdleRescanPlugins;
+            }
+
             if (ImGui::BeginChild("pluginlistwindow"))
             {
                 if (ImGui::BeginTable("pluginlist", 2, ImGuiTableFlags_NoSavedSettings))
@@ -2332,6 +2928,8 @@ struct IldaeilNanoMeterOut : NanoMeter {
 struct IldaeilModuleWidget : ModuleWidgetWithSideScrews<26> {
     bool hasLeftSideExpander = false;
     bool hasRightSideExpander = false;
+    bool lastPipelineActive = false;
+    uint32_t lastBufferSize = 0;
     IldaeilWidget* ildaeilWidget = nullptr;
 
     IldaeilModuleWidget(IldaeilModule* const module)
@@ -2431,8 +3029,47 @@ struct IldaeilModuleWidget : ModuleWidgetWithSideScrews<26> {
                              && module->rightExpander.module != nullptr
                              && module->rightExpander.module->model == modelExpanderOutputMIDI;
 
+        if (IldaeilModule* const ildaeilModule = static_cast<IldaeilModule*>(module))
+        {
+            ildaeilModule->idleBufferSizeChange();
+
+            if (ildaeilModule->pipelineActive.load() != lastPipelineActive)
+            {
+                lastPipelineActive = ! lastPipelineActive;
+                d_stdout("Ildaeil: pipelined processing %s, latency is now %u frames",
+                         lastPipelineActive ? "enabled" : "disabled", ildaeilModule->getLatencyFrames());
+            }
+
+            const uint32_t bufferSize = ildaeilModule->fBufferSize.load();
+
+            if (bufferSize != lastBufferSize)
+            {
+                if (lastBufferSize != 0)
+                    d_stdout("Ildaeil: buffer size changed from %u to %u frames", lastBufferSize, bufferSize);
+
+                lastBufferSize = bufferSize;
+            }
+        }
+
         ModuleWidgetWithSideScrews<26>::step();
     }
+
+    void appendContextMenu(ui::Menu* const menu) override
+    {
+        IldaeilModule* const ildaeilModule = static_cast<IldaeilModule*>(module);
+
+        if (ildaeilModule == nullptr || ildaeilModule->pcontext == nullptr || ildaeilModule->fCarlaHostHandle == nullptr)
+            return;
+
+        menu->addChild(new ui::MenuSeparator);
+
+        const std::string latency = string::f("+%.1f ms", ildaeilModule->fBufferSize * 1000.0 / ildaeilModule->pcontext->sampleRate);
+
+        menu->addChild(createCheckMenuItem("Pipelined Processing", latency,
+            [=]() {return ildaeilModule->params[IldaeilModule::PIPELINED].getValue() > 0.5f;},
+            [=]() {ildaeilModule->params[IldaeilModule::PIPELINED].setValue(1.0f - ildaeilModule->params[IldaeilModule::PIPELINED].getValue());}
+        ));
+    }
 };
 #else
 static void host_ui_parameter_changed(NativeHostHandle, uint32_t, float) {}
@@ -73,131 +73,288 @@ static void setupIO()
     io.SetClipboardTextFn = SetClipboardTextFn;
 }
 
+// -----------------------------------------------------------------------------------------------------------
+// Font atlases shared by all ImGui widgets.
+//
+// Rasterizing fonts is by far the slowest part of setting up an ImGui context, and used to be done by every widget
+// on each zoom change. Atlases are now built once per font and scale bucket and shared by the contexts using them,
+// which switch atlas on zoom instead of being recreated. Buckets are a quarter octave apart, text being scaled down
+// a little to its exact size. A few unused atlases are kept around, so zooming back and forth does not rebuild them.
+//
+// Atlases only hold CPU-side data, the GL texture is still uploaded by each context.
+
+static void buildFontAtlas(ImFontAtlas* const atlas, const bool monospaced, const float fontSize)
+{
+    if (monospaced)
+    {
+        const std::string fontPath = asset::system("res/fonts/ShareTechMono-Regular.ttf");
+        ImFontConfig fc;
+        fc.OversampleH = 1;
+        fc.OversampleV = 1;
+        fc.PixelSnapH = true;
+        atlas->AddFontFromFileTTF(fontPath.c_str(), fontSize, &fc);
+    }
+    else
+    {
+#ifndef DGL_NO_SHARED_RESOURCES
+        using namespace dpf_resources;
+        ImFontConfig fc;
+        fc.FontDataOwnedByAtlas = false;
+        fc.OversampleH = 1;
+        fc.OversampleV = 1;
+        fc.PixelSnapH = true;
+        atlas->AddFontFromMemoryTTF((void*)dejavusans_ttf, dejavusans_ttf_size, fontSize, &fc);
+
+        // extra fonts we can try loading for unicode support
+        static const char* extraFontPathsToTry[] = {
+           #if defined(ARCH_WIN)
+            // TODO
+            // "Meiryo.ttc",
+           #elif defined(ARCH_MAC)
+            // TODO
+           #elif defined(ARCH_LIN)
+            "/usr/share/fonts/opentype/noto/NotoSerifCJK-Regular.ttc",
+           #endif
+        };
+
+        fc.FontDataOwnedByAtlas = true;
+        fc.MergeMode = true;
+
+        for (size_t i=0; i<ARRAY_SIZE(extraFontPathsToTry); ++i)
+        {
+            if (rack::system::exists(extraFontPathsToTry[i]))
+                atlas->AddFontFromFileTTF(extraFontPathsToTry[i], fontSize, &fc, atlas->GetGlyphRangesJapanese());
+        }
+#endif
+    }
+
+    // an atlas without fonts cannot be built, fallback to the built-in one
+    if (atlas->Fonts.empty())
+        atlas->AddFontDefault();
+
+    atlas->Build();
+}
+
+struct SharedFontAtlases {
+    static constexpr const uint kMaxUnusedAtlases = 4;
+
+    struct Entry {
+        ImFontAtlas atlas;
+        bool monospaced;
+        int bucket;
+        uint users = 0;
+        uint lastUsed = 0;
+    };
+
+    std::vector<Entry*> entries;
+    uint counter = 0;
+
+    ~SharedFontAtlases()
+    {
+        for (Entry* entry : entries)
+            delete entry;
+    }
+
+    static SharedFontAtlases& getInstance()
+    {
+        static SharedFontAtlases atlases;
+        return atlases;
+    }
+
+    static float getBucketScale(const int bucket)
+    {
+        return std::pow(2.0f, bucket * 0.25f);
+    }
+
+    /**
+       Get an atlas for a scale factor, building it if needed. Must be given back with `release`.
+       @a fontScale is set to the global font scale to use with it.
+     */
+    ImFontAtlas* acquire(const bool monospaced, const float scaleFactor, float& fontScale)
+    {
+        const int bucket = static_cast<int>(std::ceil(std::log2(scaleFactor) * 4.0f - 0.001f));
+        fontScale = scaleFactor / getBucketScale(bucket);
+
+        for (Entry* entry : entries)
+        {
+            if (entry->monospaced == monospaced && entry->bucket == bucket)
+            {
+                ++entry->users;
+                return &entry->atlas;
+            }
+        }
+
+        const double startTime = rack::system::getTime();
+
+        Entry* const entry = new Entry;
+        entry->monospaced = monospaced;
+        entry->bucket = bucket;
+        entry->users = 1;
+        buildFontAtlas(&entry->atlas, monospaced, 13.0f * getBucketScale(bucket));
+        entries.push_back(entry);
+
+        // pixels are kept as alpha and as the RGBA copy uploaded by the backend
+        d_stdout("ImGui: built %s font atlas for scale %.2f in %.1f ms, %dx%d texture using %d KiB",
+                 monospaced ? "monospaced" : "regular",
+                 getBucketScale(bucket),
+                 (rack::system::getTime() - startTime) * 1000.0,
+                 entry->atlas.TexWidth, entry->atlas.TexHeight,
+                 entry->atlas.TexWidth * entry->atlas.TexHeight * 5 / 1024);
+
+        return &entry->atlas;
+    }
+
+    void release(ImFontAtlas* const atlas)
+    {
+        if (atlas == nullptr)
+            return;
+
+        uint unused = 0;
+
+        for (Entry* entry : entries)
+        {
+            if (&entry->atlas == atlas)
+            {
+                --entry->users;
+                entry->lastUsed = ++counter;
+            }
+
+            if (entry->users == 0)
+                ++unused;
+        }
+
+        // drop the least recently used atlases once too many are unused
+        while (unused > kMaxUnusedAtlases)
+        {
+            std::vector<Entry*>::iterator oldest = entries.end();
+
+            for (std::vector<Entry*>::iterator it = entries.begin(); it != entries.end(); ++it)
+            {
+                if ((*it)->users == 0 && (oldest == entries.end() || (*it)->lastUsed < (*oldest)->lastUsed))
+                    oldest = it;
+            }
+
+            delete *oldest;
+            entries.erase(oldest);
+            --unused;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
 struct ImGuiWidget::PrivateData {
     ImGuiContext* context = nullptr;
+    ImFontAtlas* ownFontAtlas = nullptr; // created with the context, unused but must be restored before destroying it
+    ImFontAtlas* fontAtlas = nullptr;    // shared, see SharedFontAtlases
+    ImTextureID fontTexture = 0;         // this context's upload of the shared atlas
     bool created = false;
     bool darkMode = true;
-    bool fontGenerated = false;
     bool useMonospacedFont = false;
-    float originalScaleFactor = 0.0f;
     float scaleFactor = 0.0f;
     double lastFrameTime = 0.0;
 
     PrivateData()
     {
         IMGUI_CHECKVERSION();
-        context = ImGui::CreateContext();
-        ImGui::SetCurrentContext(context);
-        setupIO();
+        createContext();
     }
 
     ~PrivateData()
     {
         // this should not happen
         if (created)
-        {
-            ImGui::SetCurrentContext(context);
+            shutdownBackend();
+
+        destroyContext();
+    }
+
+    void createContext()
+    {
+        context = ImGui::CreateContext();
+        ImGui::SetCurrentContext(context);
+        setupIO();
+        ownFontAtlas = ImGui::GetIO().Fonts;
+    }
+
+    void destroyContext()
+    {
+        ImGui::SetCurrentContext(context);
+        ImGui::GetIO().Fonts = ownFontAtlas;
+        SharedFontAtlases::getInstance().release(fontAtlas);
+        fontAtlas = nullptr;
+        ImGui::DestroyContext(context);
+    }
+
+    void initBackend()
+    {
 #if defined(DGL_USE_OPENGL3)
-            ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplOpenGL3_Init();
 #else
-            ImGui_ImplOpenGL2_Shutdown();
+        ImGui_ImplOpenGL2_Init();
 #endif
-        }
-
-        ImGui::DestroyContext(context);
+        fontTexture = 0;
+        created = true;
     }
 
-    void generateFontIfNeeded()
+    void shutdownBackend()
     {
-        if (fontGenerated)
-            return;
+        ImGui::SetCurrentContext(context);
+#if defined(DGL_USE_OPENGL3)
+        ImGui_ImplOpenGL3_Shutdown();
+#else
+        ImGui_ImplOpenGL2_Shutdown();
+#endif
+        fontTexture = 0;
+        created = false;
+    }
 
+    // switch to the shared atlas matching the current scale factor, context must be current
+    void updateFontAtlas()
+    {
         DISTRHO_SAFE_ASSERT_RETURN(scaleFactor != 0.0f,);
 
-        fontGenerated = true;
-
+        SharedFontAtlases& atlases(SharedFontAtlases::getInstance());
         ImGuiIO& io(ImGui::GetIO());
 
-        if (useMonospacedFont)
+        float fontScale;
+        ImFontAtlas* const atlas = atlases.acquire(useMonospacedFont, scaleFactor, fontScale);
+        io.FontGlobalScale = fontScale;
+
+        if (atlas == fontAtlas)
         {
-            const std::string fontPath = asset::system("res/fonts/ShareTechMono-Regular.ttf");
-            ImFontConfig fc;
-            fc.OversampleH = 1;
-            fc.OversampleV = 1;
-            fc.PixelSnapH = true;
-            io.Fonts->AddFontFromFileTTF(fontPath.c_str(), 13.0f * scaleFactor, &fc);
-            io.Fonts->Build();
+            atlases.release(atlas);
+            return;
         }
-        else
-        {
-#ifndef DGL_NO_SHARED_RESOURCES
-            using namespace dpf_resources;
-            ImFontConfig fc;
-            fc.FontDataOwnedByAtlas = false;
-            fc.OversampleH = 1;
-            fc.OversampleV = 1;
-            fc.PixelSnapH = true;
-            io.Fonts->AddFontFromMemoryTTF((void*)dejavusans_ttf, dejavusans_ttf_size, 13.0f * scaleFactor, &fc);
-
-            // extra fonts we can try loading for unicode support
-            static const char* extraFontPathsToTry[] = {
-               #if defined(ARCH_WIN)
-                // TODO
-                // "Meiryo.ttc",
-               #elif defined(ARCH_MAC)
-                // TODO
-               #elif defined(ARCH_LIN)
-                "/usr/share/fonts/opentype/noto/NotoSerifCJK-Regular.ttc",
-               #endif
-            };
-
-            fc.FontDataOwnedByAtlas = true;
-            fc.MergeMode = true;
-
-            for (size_t i=0; i<ARRAY_SIZE(extraFontPathsToTry); ++i)
-            {
-                if (rack::system::exists(extraFontPathsToTry[i]))
-                    io.Fonts->AddFontFromFileTTF(extraFontPathsToTry[i], 13.0f * scaleFactor, &fc,
-                                                 io.Fonts->GetGlyphRangesJapanese());
-            }
 
-            io.Fonts->Build();
+        // let the backend upload the new atlas on the next frame
+        if (created)
+        {
+#if defined(DGL_USE_OPENGL3)
+            ImGui_ImplOpenGL3_DestroyFontsTexture();
+#else
+            ImGui_ImplOpenGL2_DestroyFontsTexture();
 #endif
+            fontTexture = 0;
         }
+
+        io.Fonts = atlas;
+        atlases.release(fontAtlas);
+        fontAtlas = atlas;
     }
 
     void resetEverything(const bool doInit)
     {
         if (created)
-        {
-            ImGui::SetCurrentContext(context);
-#if defined(DGL_USE_OPENGL3)
-            ImGui_ImplOpenGL3_Shutdown();
-#else
-            ImGui_ImplOpenGL2_Shutdown();
-#endif
-            created = false;
-        }
+            shutdownBackend();
 
-        fontGenerated = false;
-        originalScaleFactor = 0.0f;
         scaleFactor = 0.0f;
         lastFrameTime = 0.0;
-        ImGui::DestroyContext(context);
-
-        context = ImGui::CreateContext();
-        ImGui::SetCurrentContext(context);
-        setupIO();
+        destroyContext();
+        createContext();
 
         if (doInit)
-        {
-#if defined(DGL_USE_OPENGL3)
-            ImGui_ImplOpenGL3_Init();
-#else
-            ImGui_ImplOpenGL2_Init();
-#endif
-            created = true;
-        }
+            initBackend();
     }
 
     void resetStyle()
@@ -262,26 +419,13 @@ void ImGuiWidget::onContextCreate(const ContextCreateEvent& e)
     DISTRHO_SAFE_ASSERT_RETURN(!imData->created,);
 
     ImGui::SetCurrentContext(imData->context);
-#if defined(DGL_USE_OPENGL3)
-    ImGui_ImplOpenGL3_Init();
-#else
-    ImGui_ImplOpenGL2_Init();
-#endif
-    imData->created = true;
+    imData->initBackend();
 }
 
 void ImGuiWidget::onContextDestroy(const ContextDestroyEvent& e)
 {
     if (imData->created)
-    {
-        ImGui::SetCurrentContext(imData->context);
-#if defined(DGL_USE_OPENGL3)
-        ImGui_ImplOpenGL3_Shutdown();
-#else
-        ImGui_ImplOpenGL2_Shutdown();
-#endif
-        imData->created = false;
-    }
+        imData->shutdownBackend();
 
     OpenGlWidgetWithBrowserPreview::onContextDestroy(e);
 }
@@ -293,7 +437,7 @@ void ImGuiWidget::setAsCurrentContext()
 
 void ImGuiWidget::setUseMonospaceFont(const bool useMonoFont)
 {
-    DISTRHO_SAFE_ASSERT_RETURN(!imData->fontGenerated,);
+    DISTRHO_SAFE_ASSERT_RETURN(imData->fontAtlas == nullptr,);
 
     imData->useMonospacedFont = useMonoFont;
 }
@@ -445,9 +589,6 @@ void ImGuiWidget::drawFramebuffer()
 {
     const float scaleFactor = APP->window->pixelRatio * std::max(1.0f, APP->scene->rack->getAbsoluteZoom());
 
-    if (d_isNotEqual(imData->scaleFactor, scaleFactor))
-        imData->resetEverything(true);
-
     drawFramebufferCommon(getFramebufferSize(), scaleFactor);
 }
 
@@ -469,16 +610,7 @@ void ImGuiWidget::drawFramebufferCommon(const Vec& fbSize, const float scaleFact
         ImGuiStyle& style(ImGui::GetStyle());
         new(&style)ImGuiStyle();
         imData->resetStyle();
-
-        if (! imData->fontGenerated)
-        {
-            imData->originalScaleFactor = scaleFactor;
-            imData->generateFontIfNeeded();
-        }
-        else
-        {
-            io.FontGlobalScale = scaleFactor / imData->originalScaleFactor;
-        }
+        imData->updateFontAtlas();
     }
 
 #if defined(DGL_USE_OPENGL3)
@@ -501,25 +633,24 @@ void ImGuiWidget::drawFramebufferCommon(const Vec& fbSize, const float scaleFact
     io.DisplayFramebufferScale = ImVec2(fbSize.x / (box.size.x * scaleFactor), fbSize.y / (box.size.y * scaleFactor));
 
     if (!imData->created)
-    {
-#if defined(DGL_USE_OPENGL3)
-        ImGui_ImplOpenGL3_Init();
-#else
-        ImGui_ImplOpenGL2_Init();
-#endif
-        imData->created = true;
-    }
+        imData->initBackend();
 
     const double time = glfwGetTime();
     io.DeltaTime = time - imData->lastFrameTime;
     imData->lastFrameTime = time;
 
+    // the shared atlas holds the texture of whichever context uploaded it last, point it to ours.
+    // if we do not have one yet, the backend uploads it now
+    io.Fonts->SetTexID(imData->fontTexture);
+
 #if defined(DGL_USE_OPENGL3)
     ImGui_ImplOpenGL3_NewFrame();
 #else
     ImGui_ImplOpenGL2_NewFrame();
 #endif
 
+    imData->fontTexture = io.Fonts->TexID;
+
     ImGui::NewFrame();
     drawImGui();
     ImGui::Render();
@@ -0,0 +1,902 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "plugin.hpp"
+#include "audio_decoder/ad.h"
+#include "extra/Mutex.hpp"
+#include "extra/Sleep.hpp"
+#include "extra/Thread.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#if !(defined(DISTRHO_OS_WINDOWS) || defined(DISTRHO_OS_WASM))
+# define SAMPLE_CACHE_USE_MMAP
+# include <climits>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+// -----------------------------------------------------------------------------------------------------------
+// Process-wide cache of decoded audio files, used by the AudioFile module.
+//
+// Files are decoded once and shared by every module playing them, reference counted so they go away with their
+// last user. Decoded samples live in a mapping of an unlinked temporary file, so the OS can page them out instead
+// of them taking up anonymous memory.
+//
+// Files too big to be cached, or that would go over the total cache budget, are streamed from disk instead, each
+// player keeping a fixed read-ahead ring filled by a disk thread. Memory use is then bounded by the budget plus
+// one ring per player, no matter how many or how long the files are.
+//
+// Waveform peaks are computed once per file during its first decoding pass, see `SamplePeaks`.
+
+struct SampleCache;
+
+/**
+   Min/max peaks of a file at several resolutions, for waveform displays.
+   The finest level has one bin per `kBaseFrames` frames of the file, each following level halves the one before,
+   down to a single bin. Displays pick the level closest to their pixel width, so drawing costs the same for any
+   file length or zoom, without touching the sample data.
+   Filled by the loader thread, read-only once `SampleFile::peaksReady` is set.
+ */
+struct SamplePeaks {
+    static constexpr const uint kBaseShift = 8;
+    static constexpr const uint kBaseFrames = 1 << kBaseShift;
+
+    struct Bin {
+        float min, max;
+    };
+
+    int64_t frames = 0;
+    std::vector<Bin> bins; // all levels one after the other, finest first
+    std::vector<size_t> levelOffsets;
+    std::vector<size_t> levelSizes;
+
+    void init(const int64_t numFrames)
+    {
+        frames = numFrames;
+        levelOffsets.clear();
+        levelSizes.clear();
+
+        size_t offset = 0;
+        size_t size = static_cast<size_t>((numFrames + kBaseFrames - 1) >> kBaseShift);
+
+        for (;;)
+        {
+            levelOffsets.push_back(offset);
+            levelSizes.push_back(size);
+            offset += size;
+
+            if (size <= 1)
+                break;
+
+            size = (size + 1) / 2;
+        }
+
+        bins.assign(offset, Bin { 0.f, 0.f });
+    }
+
+    /** Add interleaved frames starting at @a frame to the finest level, all channels are merged. */
+    void add(const int64_t frame, const float* const buffer, const int64_t count, const uint channels) noexcept
+    {
+        Bin* const level0 = bins.data();
+        const size_t size = levelSizes[0];
+
+        for (int64_t i = 0; i < count; ++i)
+        {
+            const size_t index = static_cast<size_t>((frame + i) >> kBaseShift);
+
+            if (index >= size)
+                break;
+
+            Bin& bin(level0[index]);
+
+            for (uint c = 0; c < channels; ++c)
+            {
+                const float value = buffer[i * channels + c];
+                bin.min = std::min(bin.min, value);
+                bin.max = std::max(bin.max, value);
+            }
+        }
+    }
+
+    /** Compute the coarser levels from the finest one, once all frames were added. */
+    void build() noexcept
+    {
+        for (size_t l = 1; l < levelSizes.size(); ++l)
+        {
+            const Bin* const src = bins.data() + levelOffsets[l - 1];
+            const size_t srcSize = levelSizes[l - 1];
+            Bin* const dst = bins.data() + levelOffsets[l];
+
+            for (size_t i = 0; i < levelSizes[l]; ++i)
+            {
+                Bin bin = src[i * 2];
+
+                if (i * 2 + 1 < srcSize)
+                {
+                    bin.min = std::min(bin.min, src[i * 2 + 1].min);
+                    bin.max = std::max(bin.max, src[i * 2 + 1].max);
+                }
+
+                dst[i] = bin;
+            }
+        }
+    }
+
+    /**
+       Get the peaks of the [@a start, @a end) range of frames split into @a count columns, usually one per pixel.
+       Uses the coarsest level whose bins are not wider than a column, columns outside of the file are silent.
+     */
+    void get(const int64_t start, const int64_t end, Bin out[], const uint count) const noexcept
+    {
+        if (count == 0)
+            return;
+
+        if (bins.empty() || end <= start)
+        {
+            std::memset(out, 0, sizeof(Bin) * count);
+            return;
+        }
+
+        const int64_t range = end - start;
+        const int64_t framesPerColumn = std::max<int64_t>(1, range / count);
+
+        uint level = 0;
+        while (level + 1 < levelSizes.size() && (int64_t(kBaseFrames) << (level + 1)) <= framesPerColumn)
+            ++level;
+
+        const uint shift = kBaseShift + level;
+        const Bin* const levelBins = bins.data() + levelOffsets[level];
+        const int64_t levelSize = static_cast<int64_t>(levelSizes[level]);
+
+        for (uint i = 0; i < count; ++i)
+        {
+            const int64_t f1 = start + range * i / count;
+            const int64_t f2 = start + range * (i + 1) / count;
+
+            if (f2 <= 0 || f1 >= frames)
+            {
+                out[i] = Bin { 0.f, 0.f };
+                continue;
+            }
+
+            const int64_t b1 = std::max<int64_t>(0, f1) >> shift;
+            const int64_t b2 = std::min(levelSize, std::max(b1 + 1, ((std::min(f2, frames) - 1) >> shift) + 1));
+
+            Bin bin = levelBins[b1];
+
+            for (int64_t b = b1 + 1; b < b2; ++b)
+            {
+                bin.min = std::min(bin.min, levelBins[b].min);
+                bin.max = std::max(bin.max, levelBins[b].max);
+            }
+
+            out[i] = bin;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+struct SampleFile {
+    const std::string filename;
+    const int64_t fileSize;
+    const int64_t fileTime;
+
+    // set by the loader thread before `ready`, read-only afterwards
+    uint channels = 0;
+    uint sampleRate = 0;
+    uint bitDepth = 0;
+    int64_t frames = 0;
+    bool streaming = false;
+    const float* samples = nullptr; // interleaved, nullptr when streaming
+
+    // set by the loader thread before `peaksReady`
+    SamplePeaks peaks;
+
+    std::atomic<bool> ready { false };
+    std::atomic<bool> peaksReady { false };
+    std::atomic<bool> failed { false };
+
+    // whether `streaming` is final, guarded by `SampleCache::streamsMutex`
+    bool decided = false;
+
+    SampleFile(const std::string& f, const int64_t size, const int64_t time)
+        : filename(f),
+          fileSize(size),
+          fileTime(time) {}
+
+    ~SampleFile();
+
+    size_t getDecodedSize() const noexcept
+    {
+        return static_cast<size_t>(frames) * channels * sizeof(float);
+    }
+
+    bool allocate(size_t size);
+
+private:
+    size_t allocatedSize = 0;
+   #ifdef SAMPLE_CACHE_USE_MMAP
+    void* mapping = nullptr;
+   #else
+    std::vector<float> storage;
+   #endif
+
+    friend struct SampleCache;
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+/**
+   Read-ahead ring of a streamed file, always stereo.
+   Positions are in "stream frames", which keep increasing across loops of the file.
+ */
+struct SampleStream {
+    static constexpr const uint kRingFrames = 1 << 16;
+    static constexpr const uint kRingMask = kRingFrames - 1;
+    static constexpr const uint kChunkFrames = 4096;
+
+    float ring[kRingFrames][2];
+
+    // written by the disk thread
+    std::atomic<int64_t> bufferStart { 0 };
+    std::atomic<int64_t> bufferEnd { 0 };
+
+    // written by the player
+    std::atomic<int64_t> consumed { 0 };
+    std::atomic<int64_t> seekTarget { 0 };
+    std::atomic<bool> looping { false };
+
+    // set once the disk thread opened the file
+    std::atomic<bool> opened { false };
+
+    // wakes up the disk thread, raised by the player once there is room to read more or after a jump
+    DISTRHO_NAMESPACE::Signal* signal = nullptr;
+
+    // only used by the disk thread
+    void* handle = nullptr;
+    int64_t fileFrame = 0;
+    std::vector<float> chunk;
+
+    ~SampleStream()
+    {
+        if (handle != nullptr)
+            ad_close(handle);
+    }
+};
+
+/**
+   One playback of a sample file, owned by a module.
+   Created and destroyed through `SampleCache`, only `read` and `isReady` are meant for the audio thread.
+ */
+struct SampleSource {
+    std::shared_ptr<SampleFile> file;
+    // only created for streamed files, once the loader knows the file does not fit in the cache
+    std::atomic<SampleStream*> stream { nullptr };
+
+    ~SampleSource()
+    {
+        delete stream.load();
+    }
+
+    bool isReady() const noexcept
+    {
+        if (! file->ready.load(std::memory_order_acquire))
+            return false;
+
+        if (! file->streaming)
+            return true;
+
+        // wait for the first read-ahead, so playback does not start with silence
+        const SampleStream* const s = stream.load(std::memory_order_acquire);
+        return s != nullptr && s->bufferEnd.load(std::memory_order_acquire) > 0;
+    }
+
+    /** Get @a count stereo frames starting at @a index, output is silence for anything not available. */
+    void read(const int64_t index, const uint count, float out[][2], const bool looping) noexcept
+    {
+        const SampleFile& f(*file);
+
+        if (f.streaming)
+            return readStream(index, count, out, looping);
+
+        const float* const samples = f.samples;
+        const uint channels = f.channels;
+        const uint right = channels > 1 ? 1 : 0;
+        int64_t frame = looping ? index % f.frames : index;
+
+        for (uint i = 0; i < count; ++i, ++frame)
+        {
+            if (frame >= f.frames)
+            {
+                if (! looping)
+                {
+                    for (; i < count; ++i)
+                        out[i][0] = out[i][1] = 0.f;
+                    return;
+                }
+
+                frame = 0;
+            }
+
+            out[i][0] = samples[frame * channels];
+            out[i][1] = samples[frame * channels + right];
+        }
+    }
+
+private:
+    void readStream(const int64_t index, const uint count, float out[][2], const bool looping) noexcept
+    {
+        SampleStream* const sp = stream.load(std::memory_order_acquire);
+
+        if (sp == nullptr)
+        {
+            for (uint i = 0; i < count; ++i)
+                out[i][0] = out[i][1] = 0.f;
+            return;
+        }
+
+        SampleStream& s(*sp);
+
+        s.looping.store(looping, std::memory_order_relaxed);
+
+        const int64_t start = s.bufferStart.load(std::memory_order_acquire);
+        const int64_t end = s.bufferEnd.load(std::memory_order_acquire);
+
+        // not read ahead in time or a jump, start over from where we will be next time
+        if (index < start || index + count > end)
+        {
+            for (uint i = 0; i < count; ++i)
+                out[i][0] = out[i][1] = 0.f;
+
+            s.consumed.store(index + count, std::memory_order_release);
+            s.seekTarget.store(index + count, std::memory_order_release);
+            s.signal->signal();
+            return;
+        }
+
+        for (uint i = 0; i < count; ++i)
+        {
+            const float* const frame = s.ring[(index + i) & SampleStream::kRingMask];
+            out[i][0] = frame[0];
+            out[i][1] = frame[1];
+        }
+
+        s.consumed.store(index + count, std::memory_order_release);
+
+        if (end - (index + count) <= SampleStream::kRingFrames - SampleStream::kChunkFrames * 4)
+            s.signal->signal();
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+struct SampleCache {
+    // files bigger than this once decoded are always streamed
+    static constexpr const size_t kMaxCachedFileSize = 64 * 1024 * 1024;
+    // total decoded size of all cached files, files that do not fit are streamed
+    static constexpr const size_t kMaxCachedTotalSize = 512 * 1024 * 1024;
+
+    DISTRHO_NAMESPACE::Mutex mutex;
+    std::map<std::string, std::weak_ptr<SampleFile>> files;
+    std::vector<std::shared_ptr<SampleFile>> loadQueue;
+    size_t cachedTotalSize = 0;
+
+    DISTRHO_NAMESPACE::Mutex streamsMutex;
+    std::vector<SampleSource*> streamingSources;
+    std::vector<SampleSource*> waitingSources; // not known yet if cached or streamed
+    SampleSource* fillingSource = nullptr; // being read into by the disk thread, outside of the lock
+    std::vector<SampleSource*> fillingSources; // only used by the disk thread, snapshot of `streamingSources`
+
+    static SampleCache& getInstance()
+    {
+        static SampleCache cache;
+        return cache;
+    }
+
+    /** Open a file for playback, decoding happens in the background. Not for the audio thread. */
+    SampleSource* open(const std::string& filename)
+    {
+        struct stat st;
+        const int64_t size = ::stat(filename.c_str(), &st) == 0 ? static_cast<int64_t>(st.st_size) : -1;
+        const int64_t time = size != -1 ? static_cast<int64_t>(st.st_mtime) : 0;
+
+        SampleSource* const source = new SampleSource;
+
+        // an outdated file can lose its last reference here, which must happen without holding `mutex`
+        // as its destructor takes it too
+        std::shared_ptr<SampleFile> oldFile;
+
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(mutex);
+
+            std::weak_ptr<SampleFile>& entry(files[filename]);
+
+            // reuse a file already in use, unless it changed on disk since it was decoded
+            std::shared_ptr<SampleFile> file(entry.lock());
+            if (file == nullptr || file->fileSize != size || file->fileTime != time)
+            {
+                oldFile.swap(file);
+                file = std::make_shared<SampleFile>(filename, size, time);
+                entry = file;
+                loadQueue.push_back(file);
+            }
+
+            source->file.swap(file);
+        }
+
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(streamsMutex);
+
+            if (! source->file->decided)
+                waitingSources.push_back(source);
+            else if (source->file->streaming && ! source->file->failed.load())
+                addStream(source);
+        }
+
+        if (! loader.isThreadRunning())
+            loader.startThread();
+        if (! streamer.isThreadRunning())
+            streamer.startThread();
+
+        loader.signal.signal();
+        return source;
+    }
+
+    /** Give back a source from `open`, the file is freed along with its last source. Not for the audio thread. */
+    void close(SampleSource* const source)
+    {
+        if (source == nullptr)
+            return;
+
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(streamsMutex);
+
+            for (std::vector<SampleSource*>* const list : { &streamingSources, &waitingSources })
+            {
+                const auto it = std::find(list->begin(), list->end(), source);
+                if (it != list->end())
+                    list->erase(it);
+            }
+        }
+
+        // the disk thread no longer picks this source, but might be reading into it right now
+        for (;;)
+        {
+            {
+                const DISTRHO_NAMESPACE::MutexLocker cml(streamsMutex);
+                if (fillingSource != source)
+                    break;
+            }
+            DISTRHO_NAMESPACE::d_msleep(1);
+        }
+
+        std::shared_ptr<SampleFile> file;
+
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(mutex);
+            file.swap(source->file);
+
+            // unused files still waiting to be decoded do not need to be
+            if (file.use_count() == 2)
+            {
+                for (auto it = loadQueue.begin(); it != loadQueue.end(); ++it)
+                {
+                    if (*it == file)
+                    {
+                        loadQueue.erase(it);
+                        break;
+                    }
+                }
+            }
+
+            auto it = files.find(file->filename);
+            if (it != files.end() && it->second.use_count() == 1 && it->second.lock() == file)
+                files.erase(it);
+        }
+
+        delete source;
+    }
+
+private:
+    struct LoaderThread : DISTRHO_NAMESPACE::Thread {
+        SampleCache* const cache;
+        DISTRHO_NAMESPACE::Signal signal;
+
+        LoaderThread(SampleCache* const c)
+            : Thread("Sample cache loader"),
+              cache(c) {}
+
+        void run() override
+        {
+            while (! shouldThreadExit())
+            {
+                std::shared_ptr<SampleFile> file;
+
+                {
+                    const DISTRHO_NAMESPACE::MutexLocker cml(cache->mutex);
+
+                    if (! cache->loadQueue.empty())
+                    {
+                        file = cache->loadQueue.front();
+                        cache->loadQueue.erase(cache->loadQueue.begin());
+                    }
+                }
+
+                if (file == nullptr)
+                {
+                    signal.wait();
+                    continue;
+                }
+
+                cache->load(*file);
+            }
+        }
+    } loader { this };
+
+    struct StreamThread : DISTRHO_NAMESPACE::Thread {
+        SampleCache* const cache;
+        DISTRHO_NAMESPACE::Signal signal;
+
+        StreamThread(SampleCache* const c)
+            : Thread("Sample cache streamer"),
+              cache(c) {}
+
+        void run() override
+        {
+            while (! shouldThreadExit())
+            {
+                if (! cache->fillStreams())
+                    signal.wait();
+            }
+        }
+    } streamer { this };
+
+    SampleCache()
+    {
+        ad_init();
+    }
+
+    ~SampleCache()
+    {
+        loader.signalThreadShouldExit();
+        loader.signal.signal();
+        loader.stopThread(-1);
+        streamer.signalThreadShouldExit();
+        streamer.signal.signal();
+        streamer.stopThread(-1);
+    }
+
+    // give a streamed source its read-ahead ring, `streamsMutex` must be held
+    void addStream(SampleSource* const source)
+    {
+        SampleStream* const stream = new SampleStream;
+        stream->signal = &streamer.signal;
+        source->stream.store(stream, std::memory_order_release);
+        streamingSources.push_back(source);
+        streamer.signal.signal();
+    }
+
+    // called by the loader once it is known whether @a file is cached or streamed, or that it failed to open
+    void resolveWaitingSources(SampleFile& file)
+    {
+        const DISTRHO_NAMESPACE::MutexLocker cml(streamsMutex);
+
+        file.decided = true;
+
+        for (auto it = waitingSources.begin(); it != waitingSources.end();)
+        {
+            SampleSource* const source = *it;
+
+            if (source->file.get() != &file)
+            {
+                ++it;
+                continue;
+            }
+
+            it = waitingSources.erase(it);
+
+            if (file.streaming && ! file.failed.load())
+                addStream(source);
+        }
+    }
+
+    // decode a whole file once, keeping the samples if it fits in the cache and computing its peaks
+    void load(SampleFile& file)
+    {
+        adinfo nfo;
+        ad_clear_nfo(&nfo);
+
+        void* const handle = ad_open(file.filename.c_str(), &nfo);
+
+        if (handle == nullptr || nfo.channels == 0 || nfo.frames <= 0)
+        {
+            d_stderr("Failed to open audio file '%s'", file.filename.c_str());
+
+            if (handle != nullptr)
+                ad_close(handle);
+
+            ad_free_nfo(&nfo);
+            file.failed.store(true);
+            resolveWaitingSources(file);
+            return;
+        }
+
+        file.channels = nfo.channels;
+        file.sampleRate = nfo.sample_rate;
+        file.bitDepth = nfo.bit_depth;
+        file.frames = nfo.frames;
+        ad_free_nfo(&nfo);
+
+        const size_t decodedSize = file.getDecodedSize();
+
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(mutex);
+
+            file.streaming = decodedSize > kMaxCachedFileSize
+                          || cachedTotalSize + decodedSize > kMaxCachedTotalSize;
+
+            if (! file.streaming)
+                cachedTotalSize += decodedSize;
+        }
+
+        if (! file.streaming && ! file.allocate(decodedSize))
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(mutex);
+            cachedTotalSize -= decodedSize;
+            file.streaming = true;
+        }
+
+        // streamed files can start playing right away, peaks are computed after
+        if (file.streaming)
+            file.ready.store(true, std::memory_order_release);
+
+        resolveWaitingSources(file);
+
+        const uint channels = file.channels;
+        const int64_t frames = file.frames;
+        float* const samples = const_cast<float*>(file.samples);
+
+        std::vector<float> chunk(SampleStream::kChunkFrames * channels);
+        int64_t frame = 0;
+
+        file.peaks.init(frames);
+
+        while (frame < frames && ! loader.shouldThreadExit())
+        {
+            const int64_t todo = std::min<int64_t>(SampleStream::kChunkFrames, frames - frame);
+            float* const buffer = samples != nullptr ? samples + frame * channels : chunk.data();
+
+            // ad_read works on interleaved samples, not frames
+            const ssize_t ret = ad_read(handle, buffer, static_cast<size_t>(todo * channels));
+
+            if (ret <= 0)
+                break;
+
+            const int64_t done = ret / channels;
+
+            file.peaks.add(frame, buffer, done, channels);
+            frame += done;
+        }
+
+        ad_close(handle);
+
+        // decoder reported more frames than it could give, keep what we got
+        if (! file.streaming)
+        {
+            if (frame < frames)
+                std::memset(samples + frame * channels, 0, static_cast<size_t>(frames - frame) * channels * sizeof(float));
+
+           #ifdef SAMPLE_CACHE_USE_MMAP
+            ::mprotect(file.mapping, file.allocatedSize, PROT_READ);
+           #endif
+
+            file.ready.store(true, std::memory_order_release);
+        }
+
+        file.peaks.build();
+        file.peaksReady.store(true, std::memory_order_release);
+    }
+
+    // top up the read-ahead ring of every streaming source, returns true if there was something to do.
+    // disk I/O happens without holding `streamsMutex`, `close` waits for the source being read into instead.
+    bool fillStreams()
+    {
+        {
+            const DISTRHO_NAMESPACE::MutexLocker cml(streamsMutex);
+            fillingSources = streamingSources;
+        }
+
+        bool didWork = false;
+
+        for (SampleSource* const source : fillingSources)
+        {
+            {
+                const DISTRHO_NAMESPACE::MutexLocker cml(streamsMutex);
+
+                // closed since the snapshot
+                if (std::find(streamingSources.begin(), streamingSources.end(), source) == streamingSources.end())
+                    continue;
+
+                fillingSource = source;
+            }
+
+            if (fillStream(*source))
+                didWork = true;
+
+            const DISTRHO_NAMESPACE::MutexLocker cml(streamsMutex);
+            fillingSource = nullptr;
+        }
+
+        return didWork;
+    }
+
+    bool fillStream(SampleSource& source)
+    {
+        SampleFile& file(*source.file);
+
+        if (! file.ready.load(std::memory_order_acquire) || ! file.streaming)
+            return false;
+
+        SampleStream& s(*source.stream.load(std::memory_order_relaxed));
+        bool didWork = false;
+
+        if (s.handle == nullptr)
+        {
+            adinfo nfo;
+            ad_clear_nfo(&nfo);
+            void* const handle = ad_open(file.filename.c_str(), &nfo);
+            ad_free_nfo(&nfo);
+
+            if (handle == nullptr)
+                return false;
+
+            s.chunk.resize(SampleStream::kChunkFrames * file.channels);
+            s.fileFrame = 0;
+            s.handle = handle;
+            s.opened.store(true, std::memory_order_release);
+            didWork = true;
+        }
+
+        // jump requested by the player
+        const int64_t target = s.seekTarget.exchange(-1, std::memory_order_acq_rel);
+
+        if (target != -1)
+        {
+            s.bufferEnd.store(target, std::memory_order_release);
+            s.bufferStart.store(target, std::memory_order_release);
+
+            const bool looping = s.looping.load(std::memory_order_relaxed);
+            s.fileFrame = looping ? target % file.frames : target;
+
+            if (s.fileFrame < file.frames)
+                ad_seek(s.handle, s.fileFrame);
+        }
+
+        // read a few chunks per round, so all streams get their turn
+        for (uint n = 0; n < 4; ++n)
+        {
+            const int64_t start = s.bufferStart.load(std::memory_order_relaxed);
+            const int64_t end = s.bufferEnd.load(std::memory_order_relaxed);
+            const int64_t consumed = std::max(start, s.consumed.load(std::memory_order_acquire));
+
+            if (end - consumed + SampleStream::kChunkFrames > SampleStream::kRingFrames)
+                break;
+
+            if (s.fileFrame >= file.frames)
+            {
+                if (! s.looping.load(std::memory_order_relaxed))
+                    break;
+
+                s.fileFrame = 0;
+                ad_seek(s.handle, 0);
+            }
+
+            const int64_t todo = std::min<int64_t>(SampleStream::kChunkFrames, file.frames - s.fileFrame);
+            const ssize_t ret = ad_read(s.handle, s.chunk.data(), static_cast<size_t>(todo * file.channels));
+
+            // treat errors as the end of the file
+            const int64_t done = ret > 0 ? ret / file.channels : 0;
+
+            if (done == 0)
+            {
+                s.fileFrame = file.frames;
+                continue;
+            }
+
+            const uint right = file.channels > 1 ? 1 : 0;
+
+            for (int64_t i = 0; i < done; ++i)
+            {
+                float* const frame = s.ring[(end + i) & SampleStream::kRingMask];
+                frame[0] = s.chunk[i * file.channels];
+                frame[1] = s.chunk[i * file.channels + right];
+            }
+
+            s.fileFrame += done;
+
+            if (end + done - start > SampleStream::kRingFrames)
+                s.bufferStart.store(end + done - SampleStream::kRingFrames, std::memory_order_release);
+
+            s.bufferEnd.store(end + done, std::memory_order_release);
+            didWork = true;
+        }
+
+        return didWork;
+    }
+
+    void releaseCachedSize(const size_t size)
+    {
+        const DISTRHO_NAMESPACE::MutexLocker cml(mutex);
+        cachedTotalSize -= size;
+    }
+
+    friend struct SampleFile;
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+inline bool SampleFile::allocate(const size_t size)
+{
+   #ifdef SAMPLE_CACHE_USE_MMAP
+    char tmpl[PATH_MAX];
+    std::snprintf(tmpl, sizeof(tmpl), "%s/cardinal-sample-XXXXXX", rack::system::getTempDirectory().c_str());
+
+    const int fd = ::mkstemp(tmpl);
+
+    if (fd < 0)
+        return false;
+
+    ::unlink(tmpl);
+
+    void* ptr = MAP_FAILED;
+
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+        ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ::close(fd);
+
+    if (ptr == MAP_FAILED)
+        return false;
+
+    mapping = ptr;
+    samples = static_cast<const float*>(ptr);
+   #else
+    try {
+        storage.resize(size / sizeof(float));
+    } DISTRHO_SAFE_EXCEPTION_RETURN("SampleFile::allocate", false);
+
+    samples = storage.data();
+   #endif
+
+    allocatedSize = size;
+    return true;
+}
+
+inline SampleFile::~SampleFile()
+{
+    if (allocatedSize == 0)
+        return;
+
+   #ifdef SAMPLE_CACHE_USE_MMAP
+    ::munmap(mapping, allocatedSize);
+   #endif
+
+    SampleCache::getInstance().releaseCachedSize(allocatedSize);
+}
+
+// -----------------------------------------------------------------------------------------------------------
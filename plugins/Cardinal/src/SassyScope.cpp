@@ -20,13 +20,7 @@
 #include "sassy/sassy.hpp"
 #include "sassy/sassy_scope.cpp"
 
-namespace ffft {
-template<class DT, int size>
-class FFTRealWithSize : public FFTReal<DT> {
-public:
-    explicit FFTRealWithSize() : FFTReal<DT>(size) {}
-};
-}
+#include "extra/Thread.hpp"
 
 struct SassyScopeModule : Module {
     enum ParamIds {
@@ -48,46 +42,31 @@ struct SassyScopeModule : Module {
 
     ScopeData scope;
 
-    ffft::FFTRealWithSize<float, 16*2> fftObj16;
-    ffft::FFTRealWithSize<float, 32*2> fftObj32;
-    ffft::FFTRealWithSize<float, 64*2> fftObj64;
-    ffft::FFTRealWithSize<float, 128*2> fftObj128;
-    ffft::FFTRealWithSize<float, 256*2> fftObj256;
-    ffft::FFTRealWithSize<float, 512*2> fftObj512;
-    ffft::FFTRealWithSize<float, 1024*2> fftObj1024;
-    ffft::FFTRealWithSize<float, 2048*2> fftObj2048;
-    ffft::FFTRealWithSize<float, 4096*2> fftObj4096;
-    ffft::FFTRealWithSize<float, 8192*2> fftObj8192;
-    ffft::FFTRealWithSize<float, 16384*2> fftObj16384;
-    ffft::FFTRealWithSize<float, 32768*2> fftObj32768;
-    ffft::FFTRealWithSize<float, 65536*2> fftObj65536;
+    // samples are gathered here and copied into the scope capture in blocks
+    static constexpr const int kBlockSize = 64;
+    float block[4][kBlockSize];
+    int blockFrames = 0;
 
     SassyScopeModule()
     {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
         scope.fft.average = 1;
-        scope.fft.obj16 = &fftObj16;
-        scope.fft.obj32 = &fftObj32;
-        scope.fft.obj64 = &fftObj64;
-        scope.fft.obj128 = &fftObj128;
-        scope.fft.obj256 = &fftObj256;
-        scope.fft.obj512 = &fftObj512;
-        scope.fft.obj1024 = &fftObj1024;
-        scope.fft.obj2048 = &fftObj2048;
-        scope.fft.obj4096 = &fftObj4096;
-        scope.fft.obj8192 = &fftObj8192;
-        scope.fft.obj16384 = &fftObj16384;
-        scope.fft.obj32768 = &fftObj32768;
-        scope.fft.obj65536 = &fftObj65536;
     }
 
     void process(const ProcessArgs&) override
     {
-        scope.probe(inputs[INPUT1].getVoltage(),
-                    inputs[INPUT2].getVoltage(),
-                    inputs[INPUT3].getVoltage(),
-                    inputs[INPUT4].getVoltage());
+        block[0][blockFrames] = inputs[INPUT1].getVoltage();
+        block[1][blockFrames] = inputs[INPUT2].getVoltage();
+        block[2][blockFrames] = inputs[INPUT3].getVoltage();
+        block[3][blockFrames] = inputs[INPUT4].getVoltage();
+
+        if (++blockFrames == kBlockSize)
+        {
+            const float* const data[4] = { block[0], block[1], block[2], block[3] };
+            scope.write(data, kBlockSize);
+            blockFrames = 0;
+        }
     }
 
     void onSampleRateChange(const SampleRateChangeEvent& e) override
@@ -224,39 +203,12 @@ struct SassyScopeModule : Module {
 static ScopeData* getFakeScopeInstance()
 {
     static ScopeData scope;
-    static ffft::FFTReal<float> fftObj16(16*2);
-    static ffft::FFTReal<float> fftObj32(32*2);
-    static ffft::FFTReal<float> fftObj64(64*2);
-    static ffft::FFTReal<float> fftObj128(128*2);
-    static ffft::FFTReal<float> fftObj256(256*2);
-    static ffft::FFTReal<float> fftObj512(512*2);
-    static ffft::FFTReal<float> fftObj1024(1024*2);
-    static ffft::FFTReal<float> fftObj2048(2048*2);
-    static ffft::FFTReal<float> fftObj4096(4096*2);
-    static ffft::FFTReal<float> fftObj8192(8192*2);
-    static ffft::FFTReal<float> fftObj16384(16384*2);
-    static ffft::FFTReal<float> fftObj32768(32768*2);
-    static ffft::FFTReal<float> fftObj65536(65536*2);
-
     static bool needsInit = true;
 
     if (needsInit)
     {
         needsInit = false;
         scope.fft.average = 1;
-        scope.fft.obj16 = &fftObj16;
-        scope.fft.obj32 = &fftObj32;
-        scope.fft.obj64 = &fftObj64;
-        scope.fft.obj128 = &fftObj128;
-        scope.fft.obj256 = &fftObj256;
-        scope.fft.obj512 = &fftObj512;
-        scope.fft.obj1024 = &fftObj1024;
-        scope.fft.obj2048 = &fftObj2048;
-        scope.fft.obj4096 = &fftObj4096;
-        scope.fft.obj8192 = &fftObj8192;
-        scope.fft.obj16384 = &fftObj16384;
-        scope.fft.obj32768 = &fftObj32768;
-        scope.fft.obj65536 = &fftObj65536;
         scope.realloc(48000);
     }
 
@@ -268,6 +220,32 @@ struct SassyScopeWidget : ImGuiWidget {
     int lastClickedSliderBox = -1;
     Rect sliderBoxes[8];
 
+    // spectrum analysis away from the UI thread, started once a spectrum is shown and woken up on each frame
+    struct AnalysisThread : DISTRHO_NAMESPACE::Thread {
+        ScopeData* scope = nullptr;
+        ScopeAnalyzer analyzer;
+        DISTRHO_NAMESPACE::Signal signal;
+
+        AnalysisThread()
+            : Thread("SassyScope analysis") {}
+
+        void stop()
+        {
+            signalThreadShouldExit();
+            signal.signal();
+            stopThread(-1);
+        }
+
+        void run() override
+        {
+            while (! shouldThreadExit())
+            {
+                signal.wait();
+                scope_analyze(scope, analyzer);
+            }
+        }
+    } analysisThread;
+
     SassyScopeWidget()
     {
         for (int i=0; i<8; ++i)
@@ -277,6 +255,11 @@ struct SassyScopeWidget : ImGuiWidget {
         }
     }
 
+    ~SassyScopeWidget() override
+    {
+        analysisThread.stop();
+    }
+
     void drawImGui() override
     {
         const float scaleFactor = getScaleFactor();
@@ -287,6 +270,18 @@ struct SassyScopeWidget : ImGuiWidget {
         ScopeData* const scope = module != nullptr ? &module->scope : getFakeScopeInstance();
         scope->darkMode = settings::preferDarkPanels;
         do_show_scope_window(scope, scaleFactor);
+
+        // the module browser preview has no module, it analyses the fake instance instead
+        if (scope->mAnalysisRequest.pot.load() != 0)
+        {
+            if (! analysisThread.isThreadRunning())
+            {
+                analysisThread.scope = scope;
+                analysisThread.startThread();
+            }
+
+            analysisThread.signal.signal();
+        }
     }
 
     void onButton(const ButtonEvent& e) override
@@ -94,7 +94,8 @@ struct glBarsRendererWidget : OpenGlWidgetWithBrowserPreview {
 
     void drawFramebufferForBrowserPreview() override
     {
-        glBarsState state;
+        // never receives audio, so a single shared instance works for all previews
+        static glBarsState state;
         drawFramebuffer(state, box.size);
     }
 
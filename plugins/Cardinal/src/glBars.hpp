@@ -22,52 +22,53 @@
 
 #include "plugin.hpp"
 
-static inline
-void draw_rectangle(GLfloat x1, GLfloat y1, GLfloat z1, GLfloat x2, GLfloat y2, GLfloat z2)
-{
-    if (y1 == y2)
-    {
-        glVertex3f(x1, y1, z1);
-        glVertex3f(x2, y1, z1);
-        glVertex3f(x2, y2, z2);
+#include <atomic>
 
-        glVertex3f(x2, y2, z2);
-        glVertex3f(x1, y2, z2);
-        glVertex3f(x1, y1, z1);
-    }
-    else
-    {
-        glVertex3f(x1, y1, z1);
-        glVertex3f(x2, y1, z2);
-        glVertex3f(x2, y2, z2);
+// Bars are drawn from retained vertex arrays, with a single draw call per frame.
+// Positions and colours of all bars are built once, each frame only the heights of the top vertices change.
+// Plain GL 1.1 client-side arrays are used, as this runs on the same legacy contexts as the immediate mode
+// code it replaces, and buffer objects or instancing would need entry points that are not always exported.
 
-        glVertex3f(x2, y2, z2);
-        glVertex3f(x1, y2, z1);
-        glVertex3f(x1, y1, z1);
-    }
-}
+// one bar of unit height, made of its 3 visible faces: left, right and top
+static constexpr const int kBarVertices = 12;
+static constexpr const int kBarIndices = 18;
+static constexpr const int kNumBars = 16 * 16;
 
-static inline
-void draw_bar(GLfloat x_offset, GLfloat z_offset, GLfloat height, GLfloat red, GLfloat green, GLfloat blue)
-{
-    static constexpr const GLfloat width = 0.1;
+static constexpr const GLfloat kBarWidth = 0.1f;
 
+// x offset, height factor and z offset of each vertex
+static constexpr const GLfloat kUnitBar[kBarVertices][3] = {
     // left
-    glColor3f(0.25 * red, 0.25 * green, 0.25 * blue);
-    draw_rectangle(x_offset, 0.0, z_offset , x_offset, height, z_offset + 0.1);
-
+    { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.1f }, { 0.f, 1.f, 0.1f }, { 0.f, 1.f, 0.f },
     // right
-    glColor3f(0.5 * red, 0.5 * green, 0.5 * blue);
-    draw_rectangle(x_offset, 0.0, z_offset + 0.1, x_offset + width, height, z_offset + 0.1);
-
+    { 0.f, 0.f, 0.1f }, { kBarWidth, 0.f, 0.1f }, { kBarWidth, 1.f, 0.1f }, { 0.f, 1.f, 0.1f },
     // top
-    glColor3f(red, green, blue);
-    draw_rectangle(x_offset, height, z_offset, x_offset + width, height, z_offset + 0.1);
-}
+    { 0.f, 1.f, 0.f }, { kBarWidth, 1.f, 0.f }, { kBarWidth, 1.f, 0.1f }, { 0.f, 1.f, 0.1f },
+};
+
+// colour factor of each face
+static constexpr const GLfloat kUnitBarShade[3] = { 0.25f, 0.5f, 1.f };
 
 struct glBarsState {
-    GLfloat heights[16][16], cHeights[16][16], scale;
+    // audio side, history of bar heights
+    GLfloat heights[16][16], scale;
+
+    // audio to UI handover of bar heights, as a lock-free triple buffer.
+    // the audio side fills `back` and swaps it with the middle buffer, the UI swaps the middle buffer with
+    // `front` when it holds new heights. neither side waits or ever sees a buffer while it is being written.
+    static constexpr const int kFreshFlag = 4;
+    GLfloat buffers[3][16][16];
+    std::atomic<int> middle { 1 }; // buffer index, with kFreshFlag set if not read yet
+    int back = 0;
+    int front = 2;
+
+    // UI side
+    GLfloat cHeights[16][16];
     GLfloat hSpeed;
+    GLfloat vertices[kNumBars * kBarVertices][3];
+    GLfloat colors[kNumBars * kBarVertices][3];
+    GLfloat unitHeights[kNumBars * kBarVertices];
+    GLushort indices[kNumBars * kBarIndices];
 
     glBarsState()
     {
@@ -86,46 +87,104 @@ struct glBarsState {
         //hSpeed = 0.05f;           // "Very Slow"
 
         std::memset(heights, 0, sizeof(heights));
+        std::memset(buffers, 0, sizeof(buffers));
         std::memset(cHeights, 0, sizeof(cHeights));
+
+        buildGeometry();
+    }
+
+    // bars are stored in drawing order, back to front, as there is no depth testing
+    void buildGeometry()
+    {
+        int bar = 0;
+
+        for (int y = 16; --y >= 0;)
+        {
+            const GLfloat z_offset = -1.6 + ((15 - y) * 0.2);
+            const GLfloat b_base = y * (1.0 / 15);
+            const GLfloat r_base = 1.0 - b_base;
+
+            for (int x = 16; --x >= 0; ++bar)
+            {
+                const GLfloat x_offset = -1.6 + ((float)x * 0.2);
+                const GLfloat red = r_base - (float(x) * (r_base / 15.0));
+                const GLfloat green = (float)x * (1.0 / 15);
+                const GLfloat blue = b_base;
+
+                for (int v = 0; v < kBarVertices; ++v)
+                {
+                    const int i = bar * kBarVertices + v;
+                    const GLfloat shade = kUnitBarShade[v / 4];
+
+                    vertices[i][0] = x_offset + kUnitBar[v][0];
+                    vertices[i][1] = 0.f;
+                    vertices[i][2] = z_offset + kUnitBar[v][2];
+                    unitHeights[i] = kUnitBar[v][1];
+                    colors[i][0] = shade * red;
+                    colors[i][1] = shade * green;
+                    colors[i][2] = shade * blue;
+                }
+
+                // 2 triangles per face
+                for (int f = 0; f < 3; ++f)
+                {
+                    const GLushort first = bar * kBarVertices + f * 4;
+                    GLushort* const idx = indices + bar * kBarIndices + f * 6;
+                    idx[0] = first;
+                    idx[1] = first + 1;
+                    idx[2] = first + 2;
+                    idx[3] = first + 2;
+                    idx[4] = first + 3;
+                    idx[5] = first;
+                }
+            }
+        }
     }
 
     void Render()
     {
-        GLfloat x_offset, z_offset, r_base, b_base;
+        // pick up new heights from the audio side
+        if (middle.load() & kFreshFlag)
+            front = middle.exchange(front) & ~kFreshFlag;
 
-        glPushMatrix();
-        glTranslatef(0.0,0.25,-4.0);
-        glRotatef(30.0,1.0,0.0,0.0);
-        glRotatef(45,0.0,1.0,0.0);
+        const GLfloat (&targets)[16][16](buffers[front]);
 
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glBegin(GL_TRIANGLES);
+        int bar = 0;
 
         for (int y = 16; --y >= 0;)
         {
-            z_offset = -1.6 + ((15 - y) * 0.2);
-
-            b_base = y * (1.0 / 15);
-            r_base = 1.0 - b_base;
-
-            for (int x = 16; --x >= 0;)
+            for (int x = 16; --x >= 0; ++bar)
             {
-                x_offset = -1.6 + ((float)x * 0.2);
-                if (::fabs(cHeights[y][x]-heights[y][x])>hSpeed)
+                if (::fabs(cHeights[y][x]-targets[y][x])>hSpeed)
                 {
-                  if (cHeights[y][x]<heights[y][x])
+                  if (cHeights[y][x]<targets[y][x])
                       cHeights[y][x] += hSpeed;
                   else
                       cHeights[y][x] -= hSpeed;
                 }
 
-                draw_bar(x_offset, z_offset,
-                         cHeights[y][x], r_base - (float(x) * (r_base / 15.0)),
-                         (float)x * (1.0 / 15), b_base /*, 16*y+x*/);
+                const GLfloat height = cHeights[y][x];
+
+                for (int i = bar * kBarVertices, end = i + kBarVertices; i < end; ++i)
+                    vertices[i][1] = unitHeights[i] * height;
             }
         }
 
-        glEnd();
+        glPushMatrix();
+        glTranslatef(0.0,0.25,-4.0);
+        glRotatef(30.0,1.0,0.0,0.0);
+        glRotatef(45,0.0,1.0,0.0);
+
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, vertices);
+        glColorPointer(3, GL_FLOAT, 0, colors);
+        glDrawElements(GL_TRIANGLES, kNumBars * kBarIndices, GL_UNSIGNED_SHORT, indices);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+
         glPopMatrix();
     }
 
@@ -163,6 +222,10 @@ struct glBarsState {
                 val = 0;
             heights[0][i] = val;
         }
+
+        // hand the new heights over to the UI
+        std::memcpy(buffers[back], heights, sizeof(heights));
+        back = middle.exchange(back | kFreshFlag) & ~kFreshFlag;
     }
 };
 
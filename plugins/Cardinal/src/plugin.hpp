@@ -110,3 +110,28 @@ float d_findMaxNormalizedFloat128(const float floats[128])
 
     return maxf2;
 }
+
+/*
+ * Find the highest absolute and normalized value within a float array of runtime size.
+ */
+static inline
+float d_findMaxNormalizedFloat(const float floats[], const std::size_t count)
+{
+    float tmp, maxf2 = 0.f;
+
+    for (std::size_t i=0; i<count; ++i)
+    {
+        if (!std::isfinite(floats[i]))
+            __builtin_unreachable();
+
+        tmp = std::abs(floats[i]);
+
+        if (tmp > maxf2)
+            maxf2 = tmp;
+    }
+
+    if (maxf2 > 1.f)
+        maxf2 = 1.f;
+
+    return maxf2;
+}
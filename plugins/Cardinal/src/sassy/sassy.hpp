@@ -40,7 +40,11 @@
 
 #pragma once
 
-#include "fftreal/FFTReal.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
 
 // int gFFTAverage = 1;
 // int gSamplerate;
@@ -48,7 +52,7 @@
 // // gScope
 
 struct ScopeData {
-    int mIndex = 0;
+    std::atomic<int> mIndex { 0 };
     int mSampleRate = 0;
     float mScroll = 0;
     float mTimeScale = 0.01f;
@@ -60,9 +64,6 @@ struct ScopeData {
     int mFFTZoom = 0;
     int mPot = 0;
     bool darkMode = true;
-    float fft1[65536 * 2];
-    float fft2[65536 * 2];
-    float ffta[65536 * 2];
     unsigned int colors[4] = {
         0xffc0c0c0,
         0xffa0a0ff,
@@ -75,57 +76,151 @@ struct ScopeData {
         float mScale = 1.0f / 5.0f;
         int mScaleSlider = 0;
         float mOffset = 0;
-        float* mData = nullptr;
+        float* mData = nullptr; // view of the capture buffer, updated by the UI on each frame
+    } mCh[4];
+
+    struct {
+        int average;
+    } fft;
+
+    /**
+     * Capture ring for all channels, sized to the selected time scale.
+     * Resizing is requested by the UI and picked up by the audio thread, which hands the old buffer back
+     * to be deleted by the UI, so neither side blocks or frees memory the other one may be using.
+     */
+    struct Capture {
+        const int size;
+        float* const data;
 
-        ~Channel()
+        Capture(const int s)
+            : size(s),
+              data(new float[s * 4]()) {}
+
+        ~Capture()
         {
-            delete[] mData;
+            delete[] data;
         }
+    };
+
+    std::atomic<Capture*> mCapture { nullptr };
+    std::atomic<Capture*> mPendingCapture { nullptr };
+    std::atomic<Capture*> mRetiredCapture { nullptr };
+    int mCycle = 0; // size of the capture the UI is currently looking at
 
-        void realloc(const int sampleRate)
+    /**
+     * Spectrum analysis runs on a separate thread.
+     * The UI publishes what it shows on each frame, the analysis thread computes magnitudes for the enabled
+     * channels and hands them over by swapping buffers under a short lock. The same lock is held while the
+     * analysis thread copies from the capture, so the UI cannot delete it in the meantime.
+     */
+    struct Spectrum {
+        int pot = 0;
+        int stride = 0;
+        std::vector<float> mag; // pot / 4 magnitudes per channel, padded for interpolation
+
+        const float* channel(const int c) const
         {
-            mData = new float[sampleRate * 10];
-            memset(mData, 0, sizeof(float) * sampleRate * 10);
+            return mag.data() + stride * c;
         }
-    } mCh[4];
+    };
 
     struct {
-        int average;
-        ffft::FFTReal<float>* obj16;
-        ffft::FFTReal<float>* obj32;
-        ffft::FFTReal<float>* obj64;
-        ffft::FFTReal<float>* obj128;
-        ffft::FFTReal<float>* obj256;
-        ffft::FFTReal<float>* obj512;
-        ffft::FFTReal<float>* obj1024;
-        ffft::FFTReal<float>* obj2048;
-        ffft::FFTReal<float>* obj4096;
-        ffft::FFTReal<float>* obj8192;
-        ffft::FFTReal<float>* obj16384;
-        ffft::FFTReal<float>* obj32768;
-        ffft::FFTReal<float>* obj65536;
-    } fft;
+        std::atomic<int> frame { 0 };    // bumped by the UI on each drawn frame
+        std::atomic<int> pot { 0 };      // 0 when the spectrum is not shown
+        std::atomic<int> ofs { 0 };
+        std::atomic<int> average { 1 };
+        std::atomic<int> channels { 0 }; // bitmask of enabled channels
+    } mAnalysisRequest;
+
+    std::mutex mAnalysisMutex;
+    Spectrum mSpectrumReady;
+    bool mSpectrumFresh = false;
+    Spectrum mSpectrumShown; // UI only
+
+    ~ScopeData()
+    {
+        delete mCapture.load();
+        delete mPendingCapture.load();
+        delete mRetiredCapture.load();
+    }
+
+    /** Capture length needed for the selected time scale: ten screens, at least 1 second and at most 10. */
+    int captureSize() const
+    {
+        const float seconds = std::max(1.0f, std::min(10.0f, mTimeScale * 10));
+        return static_cast<int>(mSampleRate * seconds);
+    }
+
+    /** Request a capture buffer of the right size, allocates and thus must not be called from the audio thread. */
+    void requestCapture()
+    {
+        if (mSampleRate <= 0)
+            return;
+
+        Capture* const capture = new Capture(captureSize());
+
+        // nothing is capturing yet, use it right away
+        Capture* expected = nullptr;
+        if (mCapture.compare_exchange_strong(expected, capture))
+            return;
+
+        delete mPendingCapture.exchange(capture);
+    }
+
+    /** Delete a capture buffer no longer used by the audio thread, called from the UI. */
+    void reclaimCapture()
+    {
+        if (mRetiredCapture.load() == nullptr)
+            return;
+
+        const std::lock_guard<std::mutex> lock(mAnalysisMutex);
+        delete mRetiredCapture.exchange(nullptr);
+    }
 
     void realloc(const int sampleRate)
     {
-        mIndex = 0;
         mSampleRate = sampleRate;
-
-        for (int i = 0; i < 4; i++)
-            mCh[i].realloc(sampleRate);
+        requestCapture();
     }
 
-    inline void probe(float data1, float data2, float data3, float data4)
+    /** Append a block of @a frames samples for each of the 4 channels, called from the audio thread. */
+    void write(const float* const data[4], const int frames)
     {
-        // since probe has several channels, need to deal with index here
-        if (mMode == 0)
+        // swap in a resized buffer, once the previous old one has been reclaimed
+        if (mPendingCapture.load(std::memory_order_relaxed) != nullptr && mRetiredCapture.load() == nullptr)
         {
-            mCh[0].mData[mIndex] = data1;
-            mCh[1].mData[mIndex] = data2;
-            mCh[2].mData[mIndex] = data3;
-            mCh[3].mData[mIndex] = data4;
-            mIndex = (mIndex + 1) % (mSampleRate * 10);
+            if (Capture* const pending = mPendingCapture.exchange(nullptr))
+            {
+                mRetiredCapture.store(mCapture.exchange(pending));
+                mIndex.store(0);
+            }
         }
+
+        Capture* const capture = mCapture.load(std::memory_order_relaxed);
+
+        if (mMode != 0 || capture == nullptr)
+            return;
+
+        const int size = capture->size;
+        int index = mIndex.load(std::memory_order_relaxed);
+
+        // blocks are much smaller than the capture, so they wrap around at most once
+        const int first = std::min(frames, size - index);
+
+        for (int c = 0; c < 4; ++c)
+        {
+            float* const dst = capture->data + size * c;
+            std::memcpy(dst + index, data[c], sizeof(float) * first);
+
+            if (first != frames)
+                std::memcpy(dst, data[c] + first, sizeof(float) * (frames - first));
+        }
+
+        index += frames;
+        if (index >= size)
+            index -= size;
+
+        mIndex.store(index, std::memory_order_release);
     }
 };
 
@@ -40,8 +40,196 @@
 
 #include "sassy.hpp"
 
+#include <pffft.h>
+
 #define POW_2_3_4TH 1.6817928305074290860622509524664297900800685247135690216264521719
 
+// FFT setups are created on first use and shared by all scopes, they are read-only once created.
+static struct SharedFFTSetups {
+    std::mutex mutex;
+    PFFFT_Setup* setups[18] = {};
+
+    ~SharedFFTSetups()
+    {
+        for (PFFFT_Setup* setup : setups)
+            if (setup != nullptr)
+                pffft_destroy_setup(setup);
+    }
+} gFFTSetups;
+
+static PFFFT_Setup* get_shared_fft(const int size)
+{
+    int bits = 0;
+    while ((1 << bits) < size)
+        ++bits;
+
+    if (bits >= 18 || (1 << bits) != size)
+        return nullptr;
+
+    const std::lock_guard<std::mutex> lock(gFFTSetups.mutex);
+
+    if (gFFTSetups.setups[bits] == nullptr)
+        gFFTSetups.setups[bits] = pffft_new_setup(size, PFFFT_REAL);
+
+    return gFFTSetups.setups[bits];
+}
+
+/**
+ * Spectrum analysis state of one scope, owned by its analysis thread.
+ * Uses Welch's method: Hann windows overlapping by half, going back in time from the position shown by the UI,
+ * with power averaged over as many windows as requested and available in the capture.
+ */
+struct ScopeAnalyzer {
+    int pot = 0;
+    int lastFrame = -1;
+    float* input = nullptr;
+    float* output = nullptr;
+    float* work = nullptr;
+    std::vector<float> window;
+    std::vector<float> samples; // copy of the analysed part of the capture, per channel
+    std::vector<float> power;
+    ScopeData::Spectrum spectrum;
+
+    ~ScopeAnalyzer()
+    {
+        resize(0);
+    }
+
+    void resize(const int newPot)
+    {
+        if (pot == newPot)
+            return;
+
+        pffft_aligned_free(input);
+        pffft_aligned_free(output);
+        pffft_aligned_free(work);
+        input = output = work = nullptr;
+        pot = newPot;
+
+        if (newPot == 0)
+            return;
+
+        input = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * pot));
+        output = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * pot));
+        work = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * pot));
+
+        // periodic hann window, scaled by 2 to keep the levels of the unwindowed transform
+        window.resize(pot);
+        for (int i = 0; i < pot; i++)
+            window[i] = 1.0f - std::cos(2.0 * M_PI * i / pot);
+
+        power.resize(pot / 4);
+    }
+};
+
+/**
+ * Compute the spectra requested by the UI, called from the analysis thread.
+ * Returns false if there was nothing to do, so the caller can sleep.
+ */
+static bool scope_analyze(ScopeData* gScope, ScopeAnalyzer& an)
+{
+    const int frame = gScope->mAnalysisRequest.frame.load();
+
+    // only analyse once per drawn frame, nothing is done while the UI is hidden
+    if (frame == an.lastFrame)
+        return false;
+
+    an.lastFrame = frame;
+
+    const int pot = gScope->mAnalysisRequest.pot.load();
+    const int channels = gScope->mAnalysisRequest.channels.load();
+    const int average = std::max(1, gScope->mAnalysisRequest.average.load());
+
+    if (pot == 0 || channels == 0)
+        return false;
+
+    PFFFT_Setup* const setup = get_shared_fft(pot);
+    if (setup == nullptr)
+        return false;
+
+    an.resize(pot);
+
+    const int hop = pot / 2;
+    const int bins = pot / 4;
+    int windows, span;
+
+    {
+        const std::lock_guard<std::mutex> lock(gScope->mAnalysisMutex);
+
+        const ScopeData::Capture* const capture = gScope->mCapture.load();
+        if (capture == nullptr || capture->size < pot)
+            return false;
+
+        const int cycle = capture->size;
+        const int index = gScope->mIndex.load(std::memory_order_acquire) % cycle;
+        const int ofs = std::max(pot, std::min(cycle, gScope->mAnalysisRequest.ofs.load()));
+
+        windows = std::max(1, std::min(average, (cycle - ofs) / hop + 1));
+        span = pot + hop * (windows - 1);
+
+        // copy the analysed span, oldest sample first
+        const int start = (index - ofs - hop * (windows - 1) + cycle * 2) % cycle;
+        const int first = std::min(span, cycle - start);
+
+        an.samples.resize(span * 4);
+
+        for (int j = 0; j < 4; j++)
+        {
+            if ((channels & (1 << j)) == 0)
+                continue;
+
+            const float* const src = capture->data + cycle * j;
+            float* const dst = an.samples.data() + span * j;
+            std::memcpy(dst, src + start, sizeof(float) * first);
+            if (first != span)
+                std::memcpy(dst + first, src, sizeof(float) * (span - first));
+        }
+    }
+
+    ScopeData::Spectrum& spectrum(an.spectrum);
+    spectrum.pot = pot;
+    spectrum.stride = bins + 4;
+    spectrum.mag.assign(spectrum.stride * 4, 0.0f);
+
+    for (int j = 0; j < 4; j++)
+    {
+        if ((channels & (1 << j)) == 0)
+            continue;
+
+        std::fill(an.power.begin(), an.power.end(), 0.0f);
+
+        for (int w = 0; w < windows; w++)
+        {
+            const float* const src = an.samples.data() + span * j + hop * w;
+
+            for (int i = 0; i < pot; i++)
+                an.input[i] = src[i] * an.window[i];
+
+            pffft_transform_ordered(setup, an.input, an.output, an.work, PFFFT_FORWARD);
+
+            // ordered output is dc, nyquist and then interleaved complex bins.
+            // each displayed bin covers 2 fft bins, as the original implementation did
+            const float* const out = an.output;
+            an.power[0] += out[0] * out[0] + out[2] * out[2] + out[3] * out[3];
+
+            for (int i = 1; i < bins; i++)
+                an.power[i] += out[i * 4 + 0] * out[i * 4 + 0] + out[i * 4 + 1] * out[i * 4 + 1]
+                             + out[i * 4 + 2] * out[i * 4 + 2] + out[i * 4 + 3] * out[i * 4 + 3];
+        }
+
+        float* const mag = spectrum.mag.data() + spectrum.stride * j;
+        const float scale = 0.5f / windows;
+
+        for (int i = 0; i < bins; i++)
+            mag[i] = std::sqrt(an.power[i] * scale);
+    }
+
+    const std::lock_guard<std::mutex> lock(gScope->mAnalysisMutex);
+    std::swap(gScope->mSpectrumReady, an.spectrum);
+    gScope->mSpectrumFresh = true;
+    return true;
+}
+
 static double catmullrom(double t, double p0, double p1, double p2, double p3)
 {
     return 0.5 * (
@@ -148,7 +336,7 @@ static int scope_sync(ScopeData* gScope, int index)
 {
     const float gSamplerate = gScope->mSampleRate;
     int samples = (int)(gSamplerate * gScope->mTimeScale);
-    int cycle = gSamplerate * 10;
+    int cycle = gScope->mCycle;
     int ofs = samples;
 
     if (gScope->mMode == 0)
@@ -181,8 +369,8 @@ static int scope_sync(ScopeData* gScope, int index)
         ofs = -(int)(gScope->mScroll * gSamplerate);
         if (ofs < samples)
             ofs = samples;
-        if (ofs > gSamplerate * 10 - samples)
-            ofs = gSamplerate * 10 - samples;
+        if (ofs > cycle - samples)
+            ofs = cycle - samples;
     }
     gScope->mScroll = -((float)ofs / gSamplerate);
 
@@ -194,7 +382,7 @@ static void scope_plot(ScopeData* gScope, const float uiScale, int index)
 {
     ImVec2 p = ImGui::GetItemRectMin();
     const float gSamplerate = gScope->mSampleRate;
-    int cycle = gSamplerate * 10;
+    int cycle = gScope->mCycle;
     /*
     Okay, max scale is 1 second, so..
     */
@@ -255,7 +443,7 @@ static void scope_time(ScopeData* gScope, const float uiScale, int index)
 {
     ImVec2 p = ImGui::GetItemRectMin();
     const float gSamplerate = gScope->mSampleRate;
-    int cycle = gSamplerate * 10;
+    int cycle = gScope->mCycle;
     ImDrawList* dl = ImGui::GetWindowDrawList();
     /*
     Okay, max scale is 1 second, so..
@@ -376,7 +564,6 @@ static void scope_freq(ScopeData* gScope, const float uiScale, int index)
     ImVec2 p = ImGui::GetItemRectMin();
     ImDrawList* dl = ImGui::GetWindowDrawList();
     const float gSamplerate = gScope->mSampleRate;
-    int cycle = gSamplerate * 10;
     /*
     Okay, max scale is 1 second, so..
     */
@@ -393,38 +580,50 @@ static void scope_freq(ScopeData* gScope, const float uiScale, int index)
     // Shift down and add one to round it up
     pot = (pot >> 1) + 1;
 
-    if (pot < 16) pot = 16;
+    // smallest real transform supported by pffft
+    if (pot < 32) pot = 32;
     if (pot > 65536) pot = 65536;
 
     gScope->mPot = pot;
 
-    ffft::FFTReal<float>* fft = NULL;
-    switch (pot)
-    {
-    case 16: fft = gScope->fft.obj16; break;
-    case 32: fft = gScope->fft.obj32; break;
-    case 64: fft = gScope->fft.obj64; break;
-    case 128: fft = gScope->fft.obj128; break;
-    case 256: fft = gScope->fft.obj256; break;
-    case 512: fft = gScope->fft.obj512; break;
-    case 1024: fft = gScope->fft.obj1024; break;
-    case 2048: fft = gScope->fft.obj2048; break;
-    case 4096: fft = gScope->fft.obj4096; break;
-    case 8192: fft = gScope->fft.obj8192; break;
-    case 16384: fft = gScope->fft.obj16384; break;
-    case 32768: fft = gScope->fft.obj32768; break;
-    case 65536: fft = gScope->fft.obj65536; break;
-    }
-    if (!fft) return;
-
-    int average = gScope->fft.average;
     int ofs = scope_sync(gScope, index);
+
+    // ask the analysis thread for the next spectra, and pick up the last finished ones
+    int channels = 0;
+    for (int j = 0; j < 4; j++)
+        if (gScope->mCh[j].mEnabled)
+            channels |= 1 << j;
+
+    gScope->mAnalysisRequest.pot.store(pot);
+    gScope->mAnalysisRequest.ofs.store(ofs);
+    gScope->mAnalysisRequest.average.store(gScope->fft.average);
+    gScope->mAnalysisRequest.channels.store(channels);
+
+    {
+        const std::lock_guard<std::mutex> lock(gScope->mAnalysisMutex);
+
+        if (gScope->mSpectrumFresh)
+        {
+            std::swap(gScope->mSpectrumReady, gScope->mSpectrumShown);
+            gScope->mSpectrumFresh = false;
+        }
+    }
+
+    const ScopeData::Spectrum& spectrum(gScope->mSpectrumShown);
+
+    // the spectrum can lag behind a time scale change by a frame, draw it with its own size
+    if (spectrum.pot != 0)
+        pot = spectrum.pot;
+
     int size = grid_size - 1;
     float sizef = size;
     float freqbin = gSamplerate / (float)(pot / 2);
     float freqbins[size];
     float zoom = 1.0f / (1 << gScope->mFFTZoom);
 
+    for (int i = 0; i < size; i++)
+        freqbins[i] = powf(zoom * i / sizef, 2.0f) * pot / 4 * freqbin;
+
     for (int i = 0; i < 10; i++)
     {
         vertline(uiScale, sqrt(100 / freqbin * i / (pot / 4)) / zoom * sizef, 1);
@@ -434,39 +633,21 @@ static void scope_freq(ScopeData* gScope, const float uiScale, int index)
 
     for (int j = 0; j < 4; j++)
     {
-        if (gScope->mCh[j].mEnabled)
+        if (gScope->mCh[j].mEnabled && spectrum.pot != 0)
         {
-
-
-            memset(gScope->ffta, 0, sizeof(float) * 65536 * 2);
-            for (int k = 0; k < average; k++)
-            {
-                float* graphdata = gScope->mCh[j].mData;
-
-                for (int i = 0; i < pot; i++)
-                {
-                    gScope->fft1[i * 2] = graphdata[(index - ofs + i + cycle - k) % cycle];
-                    gScope->fft1[i * 2 + 1] = 0;
-                }
-
-                fft->do_fft(gScope->fft2, gScope->fft1);
-
-                for (int i = 0; i < pot / 4; i++)
-                    gScope->ffta[i] += (1.0f / average) * sqrt(gScope->fft2[i * 2 + 0] * gScope->fft2[i * 2 + 0] + gScope->fft2[i * 2 + 1] * gScope->fft2[i * 2 + 1]);
-            }
+            const float* ffta = spectrum.channel(j);
 
             ImVec2 vert[size];
 
             for (int i = 0; i < size; i++)
             {
                 float ppos = powf(zoom * i / sizef, 2.0f) * pot / 4;
-                freqbins[i] = ppos * freqbin;
                 
                 float f = ppos - (int)ppos;
-                float a = i ? gScope->ffta[(int)ppos - 1] : 0;
-                float b = gScope->ffta[(int)ppos];
-                float c = i < size ? gScope->ffta[(int)ppos + 1] : 0;
-                float d = i < (size-1) ? gScope->ffta[(int)ppos + 2] : 0;
+                float a = i ? ffta[(int)ppos - 1] : 0;
+                float b = ffta[(int)ppos];
+                float c = i < size ? ffta[(int)ppos + 1] : 0;
+                float d = i < (size-1) ? ffta[(int)ppos + 2] : 0;
 
                 float v0 = (float)catmullrom(f, a, b, c, d);
                 
@@ -596,9 +777,24 @@ static void detect_fundamentals(ScopeData* gScope)
 
 void do_show_scope_window(ScopeData* gScope, const float uiScale)
 {
+    // Resize the capture for the selected time scale, not while paused as that would discard the capture
+    gScope->reclaimCapture();
+
+    const ScopeData::Capture* const capture = gScope->mCapture.load();
+
+    if (capture != nullptr && capture->size != gScope->captureSize() && gScope->mMode == 0
+        && gScope->mPendingCapture.load() == nullptr)
+        gScope->requestCapture();
+
     // Data is updated live, so let's take local copies of critical stuff.
     int index = gScope->mIndex;
 
+    gScope->mCycle = capture != nullptr ? capture->size : 0;
+    for (int i = 0; i < 4; i++)
+        gScope->mCh[i].mData = capture != nullptr ? capture->data + capture->size * i : nullptr;
+
+    const float maxScroll = capture != nullptr ? static_cast<float>(capture->size) / gScope->mSampleRate : 0.0f;
+
     ImGui::Begin("Scope", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
 
     ImGui::BeginChild("Channel options", ImVec2((4 * 25)*uiScale, (2 * 152 + 32) * uiScale));
@@ -707,10 +903,19 @@ void do_show_scope_window(ScopeData* gScope, const float uiScale)
     ImGui::BeginChild("Scope and scroll", ImVec2(grid_size * uiScale, (grid_size + 24)* uiScale));
     ImGui::BeginChild("Scope proper", ImVec2(grid_size * uiScale, grid_size * uiScale));
 
-    if (gScope->mDisplay == 0)
-        scope_time(gScope, uiScale, index);
-    if (gScope->mDisplay == 1)
-        scope_freq(gScope, uiScale, index);
+    // scope_freq requests a new analysis, otherwise the analysis thread stays idle
+    if (capture == nullptr || gScope->mDisplay != 1)
+        gScope->mAnalysisRequest.pot.store(0);
+
+    if (capture != nullptr)
+    {
+        if (gScope->mDisplay == 0)
+            scope_time(gScope, uiScale, index);
+        if (gScope->mDisplay == 1)
+            scope_freq(gScope, uiScale, index);
+    }
+
+    gScope->mAnalysisRequest.frame.fetch_add(1);
     /*
     if (gScope->mDisplay == 2 || gScope->mDisplay == 3)
         scope_plot(gScope, uiScale, index);
@@ -755,7 +960,7 @@ void do_show_scope_window(ScopeData* gScope, const float uiScale)
     if (gScope->mMode)
     {
         ImGui::SetNextItemWidth(grid_size * uiScale);
-        ImGui::SliderFloat("###scroll", &gScope->mScroll, -10.0f, 0.0f, "%.3f s");
+        ImGui::SliderFloat("###scroll", &gScope->mScroll, -maxScroll, 0.0f, "%.3f s");
     }
     else
     {
@@ -768,7 +973,7 @@ void do_show_scope_window(ScopeData* gScope, const float uiScale)
         ImGui::PushStyleColor(ImGuiCol_SliderGrabActive, sliderCol);
         ImGui::SetNextItemWidth(grid_size * uiScale);
         float x = gScope->mScroll;
-        ImGui::SliderFloat("###scroll", &x, -10.0f, 0.0f, "%.3f s");
+        ImGui::SliderFloat("###scroll", &x, -maxScroll, 0.0f, "%.3f s");
         ImGui::PopStyleColor(5);
     }
     ImGui::EndChild();
@@ -32,6 +32,8 @@
 #include <engine/Engine.hpp>
 #include <window/Window.hpp>
 
+#include <algorithm>
+
 #ifndef DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
 # error wrong build
 #endif
@@ -196,9 +198,9 @@ void CardinalPluginContext::removeIdleCallback(IdleCallback* const cb) const
    #endif
 }
 
-void CardinalPluginContext::writeMidiMessage(const rack::midi::Message& message, const uint8_t channel)
+void CardinalPluginContext::writeMidiMessage(const rack::midi::Message& message, const uint8_t channel, const bool coalesce)
 {
-    if (bypassed)
+    if (bypassed || plugin == nullptr)
         return;
 
     const size_t size = message.bytes.size();
@@ -260,7 +262,236 @@ void CardinalPluginContext::writeMidiMessage(const rack::midi::Message& message,
     if (channel != 0 && event.data[0] < 0xF0)
         event.data[0] |= channel & 0x0F;
 
-    plugin->writeMidiEvent(event);
+    midiOutQueue.push(event, coalesce);
+}
+
+// -----------------------------------------------------------------------------------------------------------
+
+static inline
+bool isCoalescableMidiEvent(const MidiEvent& event) noexcept
+{
+    switch (event.data[0] & 0xF0)
+    {
+    case 0xB0:
+        // data entry, increment/decrement and (N)RPN select are meaningful per message
+        switch (event.data[1])
+        {
+        case 6:
+        case 38:
+        case 96:
+        case 97:
+        case 98:
+        case 99:
+        case 100:
+        case 101:
+            return false;
+        }
+        return true;
+    case 0xA0:
+    case 0xD0:
+    case 0xE0:
+        return true;
+    }
+    return false;
+}
+
+static inline
+uint16_t getCoalescingKey(const MidiEvent& event) noexcept
+{
+    // pitch-bend and channel pressure have a single value per channel
+    switch (event.data[0] & 0xF0)
+    {
+    case 0xD0:
+    case 0xE0:
+        return event.data[0] << 8;
+    }
+    return (event.data[0] << 8) | event.data[1];
+}
+
+void CardinalMidiOutputQueue::flush(Plugin* const plugin) noexcept
+{
+    const uint32_t count = eventCount;
+
+    if (count == 0)
+        return;
+
+    eventCount = 0;
+
+    // modules write in their own frame order, so we usually get a few sorted runs to merge
+    bool sorted = true;
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        if (events[order[i]].frame < events[order[i - 1]].frame)
+        {
+            sorted = false;
+            break;
+        }
+    }
+
+    // stable bottom-up merge sort, using preallocated scratch space
+    if (! sorted)
+    {
+        uint16_t* src = order;
+        uint16_t* dst = scratch;
+
+        for (uint32_t width = 1; width < count; width *= 2)
+        {
+            for (uint32_t start = 0; start < count; start += width * 2)
+            {
+                const uint32_t mid = std::min(start + width, count);
+                const uint32_t end = std::min(start + width * 2, count);
+                uint32_t l = start, r = mid, o = start;
+
+                while (l < mid && r < end)
+                    dst[o++] = events[src[r]].frame < events[src[l]].frame ? src[r++] : src[l++];
+                while (l < mid)
+                    dst[o++] = src[l++];
+                while (r < end)
+                    dst[o++] = src[r++];
+            }
+
+            std::swap(src, dst);
+        }
+
+        if (src != order)
+            std::memcpy(order, src, sizeof(uint16_t) * count);
+    }
+
+    // mark values directly replaced by the next event on the same frame, nothing else moves
+    for (uint32_t i = 0; i + 1 < count; ++i)
+    {
+        if (! coalescable[order[i]] || ! coalescable[order[i + 1]])
+            continue;
+
+        MidiEvent& event(events[order[i]]);
+        const MidiEvent& next(events[order[i + 1]]);
+
+        if (event.frame != next.frame || ! isCoalescableMidiEvent(event) || ! isCoalescableMidiEvent(next))
+            continue;
+        if (getCoalescingKey(event) != getCoalescingKey(next))
+            continue;
+
+        event.size = 0;
+        ++coalescedCount;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const MidiEvent& event(events[order[i]]);
+
+        if (event.size == 0)
+            continue;
+
+        if (! plugin->writeMidiEvent(event))
+        {
+            // host buffer is full, everything else gets lost
+            for (; i < count; ++i)
+            {
+                if (events[order[i]].size != 0)
+                    ++droppedCount;
+            }
+            break;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------
+
+void CardinalMidiEventBus::decode(const MidiEvent* const midiEvents, const uint32_t midiEventCount) noexcept
+{
+    uint32_t count = 0;
+    bool sorted = true;
+
+    droppedCount = 0;
+
+    for (uint32_t i = 0; i < midiEventCount; ++i)
+    {
+        const MidiEvent& midiEvent(midiEvents[i]);
+
+        if (count == kMaxEvents)
+        {
+            droppedCount += midiEventCount - i;
+            break;
+        }
+
+        const uint8_t* const data = midiEvent.size > MidiEvent::kDataSize
+                                  ? midiEvent.dataExt
+                                  : midiEvent.data;
+
+        if (midiEvent.size == 0 || data == nullptr || data[0] < 0x80)
+        {
+            ++droppedCount;
+            continue;
+        }
+
+        CardinalMidiEvent& event(events[count]);
+        event.frame = midiEvent.frame;
+        event.size = midiEvent.size;
+        event.data = data;
+        event.status = data[0] >= 0xF0 ? data[0] : data[0] & 0xF0;
+        event.channel = data[0] >= 0xF0 ? 0 : data[0] & 0x0F;
+        event.data1 = midiEvent.size > 1 ? data[1] : 0;
+        event.data2 = midiEvent.size > 2 ? data[2] : 0;
+
+        if (count != 0 && event.frame < events[count - 1].frame)
+            sorted = false;
+
+        ++count;
+    }
+
+    // hosts should give us sorted events, but be safe and keep same-frame events in their original order
+    if (! sorted)
+    {
+        for (uint32_t i = 1; i < count; ++i)
+        {
+            const CardinalMidiEvent event = events[i];
+            uint32_t j = i;
+
+            for (; j != 0 && events[j - 1].frame > event.frame; --j)
+                events[j] = events[j - 1];
+
+            events[j] = event;
+        }
+    }
+
+    // build indices with a counting sort, which keeps frame order within each group
+    uint16_t channelCounts[16] = {};
+    uint16_t typeCounts[kCardinalMidiEventTypeCount] = {};
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint8_t type = (events[i].status >> 4) - 8;
+        ++typeCounts[type];
+
+        if (type != kCardinalMidiEventSystem)
+            ++channelCounts[events[i].channel];
+    }
+
+    channelOffsets[0] = typeOffsets[0] = 0;
+
+    for (uint8_t c = 0; c < 16; ++c)
+        channelOffsets[c + 1] = channelOffsets[c] + channelCounts[c];
+
+    for (uint8_t t = 0; t < kCardinalMidiEventTypeCount; ++t)
+        typeOffsets[t + 1] = typeOffsets[t] + typeCounts[t];
+
+    uint16_t channelPos[16];
+    uint16_t typePos[kCardinalMidiEventTypeCount];
+    std::memcpy(channelPos, channelOffsets, sizeof(channelPos));
+    std::memcpy(typePos, typeOffsets, sizeof(typePos));
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint8_t type = (events[i].status >> 4) - 8;
+
+        orderIndices[i] = i;
+        typeIndices[typePos[type]++] = i;
+
+        if (type != kCardinalMidiEventSystem)
+            channelIndices[channelPos[events[i].channel]++] = i;
+    }
+
+    eventCount = count;
 }
 
 // -----------------------------------------------------------------------------------------------------------
@@ -269,15 +500,19 @@ namespace rack {
 namespace midi {
 
 struct InputQueue::Internal {
+    static constexpr const size_t kSysexBufferSize = 4096;
+
     CardinalPluginContext* const pcontext = static_cast<CardinalPluginContext*>(APP);
-    const CardinalDISTRHO::MidiEvent* midiEvents = nullptr;
-    uint32_t midiEventsLeft = 0;
+    CardinalMidiEventReader midiEventReader;
     uint32_t lastProcessCounter = 0;
     int64_t lastBlockFrame = 0;
+    // reserved off the audio thread, handed over to the first message that does not fit the caller's buffer
+    std::vector<uint8_t> sysexBuffer;
 };
 
 InputQueue::InputQueue() {
     internal = new Internal;
+    internal->sysexBuffer.reserve(Internal::kSysexBufferSize);
 }
 
 InputQueue::~InputQueue() {
@@ -293,38 +528,29 @@ bool InputQueue::tryPop(Message* const messageOut, int64_t maxFrame)
     {
         internal->lastBlockFrame = internal->pcontext->engine->getBlockFrame();
         internal->lastProcessCounter = processCounter;
-
-        internal->midiEvents = internal->pcontext->midiEvents;
-        internal->midiEventsLeft = internal->pcontext->midiEventCount;
+        internal->midiEventReader = internal->pcontext->midiBus.readAll();
     }
 
-    if (internal->midiEventsLeft == 0 || maxFrame < internal->lastBlockFrame)
+    if (maxFrame < internal->lastBlockFrame)
         return false;
 
     const uint32_t frame = maxFrame - internal->lastBlockFrame;
 
-    if (frame > internal->midiEvents->frame)
-        return false;
-
-    const CardinalDISTRHO::MidiEvent& midiEvent(*internal->midiEvents);
-
-    const uint8_t* data;
-    if (midiEvent.size > CardinalDISTRHO::MidiEvent::kDataSize)
+    while (const CardinalMidiEvent* const midiEvent = internal->midiEventReader.next(frame))
     {
-        data = midiEvent.dataExt;
-        messageOut->bytes.resize(midiEvent.size);
-    }
-    else
-    {
-        data = midiEvent.data;
+        // sysex does not fit the default message capacity, swap in our reserved buffer instead of allocating.
+        // the caller usually reuses its message, so this happens once; only a second fresh message or
+        // something bigger than kSysexBufferSize falls back to resizing (and thus allocating) below.
+        if (midiEvent->size > messageOut->bytes.capacity() && midiEvent->size <= internal->sysexBuffer.capacity())
+            messageOut->bytes.swap(internal->sysexBuffer);
+
+        messageOut->frame = frame;
+        messageOut->bytes.resize(midiEvent->size);
+        std::memcpy(messageOut->bytes.data(), midiEvent->data, midiEvent->size);
+        return true;
     }
 
-    messageOut->frame = frame;
-    std::memcpy(messageOut->bytes.data(), data, midiEvent.size);
-
-    ++internal->midiEvents;
-    --internal->midiEventsLeft;
-    return true;
+    return false;
 }
 
 json_t* InputQueue::toJson() const
@@ -0,0 +1,426 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <engine/Engine.hpp>
+
+#include "extra/Thread.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+// -----------------------------------------------------------------------------------------------------------
+// DSP to UI streaming of module lights and output voltages, used by the separated Mini variant.
+//
+// Every entry (a module light or the first channel of a module output) gets a key, assigned by walking the
+// engine modules sorted by id, lights first and then outputs. DSP and UI run the same patch so both sides
+// agree on the keys without sending any layout information.
+//
+// Each stream slot is a hidden output parameter carrying one key and a quantized value, packed as an
+// integer-valued float so it survives the host untouched. Slots are rewritten at a decimated rate and only
+// for values that changed since they were last sent, which bounds the cost to `kSlotCount` floats per block.
+// Slots left free by dirty values are used to resend old values in a round-robin fashion, so that values lost
+// on the way (hosts are allowed to skip output parameter updates) eventually reach the UI.
+
+namespace rack {
+namespace engine {
+void Engine_setBlockCallback(Engine*, CardinalEngineBlockCallback*);
+}
+}
+
+namespace miniStream {
+
+using rack::engine::Engine_setBlockCallback;
+
+static constexpr const uint32_t kSlotCount = 16;
+static constexpr const uint32_t kValueBits = 10;
+static constexpr const uint32_t kValueMax = (1u << kValueBits) - 1;
+// 24 bits of float mantissa minus value bits, minus one since 0 is reserved for empty slots
+static constexpr const uint32_t kMaxEntries = (1u << (24 - kValueBits)) - 1;
+static constexpr const uint32_t kMaxModules = 1024;
+static constexpr const uint16_t kInvalidValue = 0xffff;
+static constexpr const float kRefreshRate = 30.f;
+static constexpr const float kMaxPackedValue = static_cast<float>(1u << 24);
+
+static inline
+uint16_t quantizeLight(const float value) noexcept
+{
+    return static_cast<uint16_t>(std::max(0.f, std::min(1.f, value)) * kValueMax + 0.5f);
+}
+
+static inline
+uint16_t quantizeVoltage(const float value) noexcept
+{
+    return static_cast<uint16_t>((std::max(-10.f, std::min(10.f, value)) + 10.f) * 0.05f * kValueMax + 0.5f);
+}
+
+static inline
+float unquantizeLight(const uint16_t value) noexcept
+{
+    return static_cast<float>(value) / kValueMax;
+}
+
+static inline
+float unquantizeVoltage(const uint16_t value) noexcept
+{
+    return static_cast<float>(value) / kValueMax * 20.f - 10.f;
+}
+
+static inline
+float pack(const uint32_t key, const uint16_t value) noexcept
+{
+    return static_cast<float>(1 + (key << kValueBits) + value);
+}
+
+static inline
+bool unpack(const float packed, uint32_t& key, uint16_t& value) noexcept
+{
+    if (!(packed >= 1.f && packed <= kMaxPackedValue))
+        return false;
+
+    const uint32_t ipacked = static_cast<uint32_t>(packed + 0.5f) - 1;
+    key = ipacked >> kValueBits;
+    value = ipacked & kValueMax;
+    return key < kMaxEntries;
+}
+
+// -----------------------------------------------------------------------------------------------------------
+
+/**
+   Sorted list of module ids, used to know when the patch layout changes.
+ */
+struct ModuleList {
+    int64_t ids[kMaxModules];
+    uint32_t count = 0;
+    uint64_t signature = 0;
+
+    /** Fetch the current module ids, returns true if they changed since the last call. */
+    bool update(rack::engine::Engine* const engine)
+    {
+        count = engine->getModuleIds(ids, kMaxModules);
+        std::sort(ids, ids + count);
+
+        // FNV-1a over the ids and their port/light counts
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            hash = (hash ^ static_cast<uint64_t>(ids[i])) * 0x100000001b3ULL;
+
+            if (rack::engine::Module* const module = engine->getModule(ids[i]))
+            {
+                hash = (hash ^ module->lights.size()) * 0x100000001b3ULL;
+                hash = (hash ^ module->outputs.size()) * 0x100000001b3ULL;
+            }
+        }
+
+        if (signature == hash)
+            return false;
+
+        signature = hash;
+        return true;
+    }
+};
+
+/**
+   Walk all stream entries in key order.
+   @a func is called as `func(key, module, index, isLight)`, returns the number of entries.
+ */
+template <class Func>
+static inline
+uint32_t forEachEntry(rack::engine::Engine* const engine, const ModuleList& list, Func&& func)
+{
+    uint32_t key = 0;
+
+    for (uint32_t i = 0; i < list.count && key < kMaxEntries; ++i)
+    {
+        rack::engine::Module* const module = engine->getModule(list.ids[i]);
+
+        if (module == nullptr)
+            continue;
+
+        const uint32_t numLights = module->lights.size();
+        const uint32_t numOutputs = module->outputs.size();
+
+        for (uint32_t l = 0; l < numLights && key < kMaxEntries; ++l)
+            func(key++, module, l, true);
+
+        for (uint32_t o = 0; o < numOutputs && key < kMaxEntries; ++o)
+            func(key++, module, o, false);
+    }
+
+    return key;
+}
+
+// -----------------------------------------------------------------------------------------------------------
+
+/**
+   DSP side of the stream, fills the output slots at the end of engine blocks.
+
+   Values are read from the engine block callback, while the engine is locked so modules cannot go away.
+   The list of entries is built on a separate thread whenever modules are added or removed, which keeps sorting
+   and module lookups away from the audio thread. Streaming pauses until the new list is ready.
+ */
+struct Encoder : CardinalEngineBlockCallback {
+    struct Entry {
+        rack::engine::Module* module;
+        uint32_t index;
+        bool isLight;
+    };
+
+    enum LayoutState {
+        kLayoutInUse,     // owned by the audio thread
+        kLayoutRequested, // being rebuilt by the layout thread
+        kLayoutReady      // rebuilt, audio thread picks it up on the next update
+    };
+
+    struct LayoutThread : DISTRHO_NAMESPACE::Thread {
+        Encoder* const encoder;
+        DISTRHO_NAMESPACE::Signal signal;
+
+        LayoutThread(Encoder* const e)
+            : Thread("MiniStreamLayout"),
+              encoder(e) {}
+
+        void run() override
+        {
+            while (! shouldThreadExit())
+            {
+                signal.wait();
+
+                if (encoder->layoutState.load() == kLayoutRequested)
+                {
+                    encoder->buildLayout();
+                    encoder->layoutState.store(kLayoutReady);
+                }
+            }
+        }
+    } layoutThread;
+
+    // layout, only touched by whoever owns it according to `layoutState`
+    ModuleList modules;
+    Entry entries[kMaxEntries];
+    uint32_t numEntries = 0;
+    uint32_t layoutVersion = 0;
+    uint32_t requestedVersion = 0;
+    rack::engine::Engine* engine = nullptr;
+    std::atomic<int> layoutState { kLayoutInUse };
+
+    float* slots = nullptr;
+    uint16_t current[kMaxEntries];
+    uint16_t lastSent[kMaxEntries];
+    uint32_t dirtyCursor = 0;
+    uint32_t refreshCursor = 0;
+    uint32_t framesPerUpdate = 0;
+    uint32_t framesSinceUpdate = 0;
+
+    Encoder()
+        : layoutThread(this)
+    {
+        std::memset(lastSent, 0xff, sizeof(lastSent));
+    }
+
+    ~Encoder() override
+    {
+        stop();
+    }
+
+    /** Start streaming into @a outputSlots (of `kSlotCount` size), values are written at the end of engine blocks. */
+    void start(rack::engine::Engine* const e, float* const outputSlots)
+    {
+        engine = e;
+        slots = outputSlots;
+        layoutThread.startThread();
+        Engine_setBlockCallback(engine, this);
+    }
+
+    void stop()
+    {
+        if (engine == nullptr)
+            return;
+
+        Engine_setBlockCallback(engine, nullptr);
+        layoutThread.signalThreadShouldExit();
+        layoutThread.signal.signal();
+        layoutThread.stopThread(-1);
+        engine = nullptr;
+    }
+
+    void setSampleRate(const double sampleRate) noexcept
+    {
+        framesPerUpdate = static_cast<uint32_t>(sampleRate / kRefreshRate + 0.5);
+    }
+
+    // called from the layout thread, the engine is not locked here so module pointers are only used later,
+    // by the audio thread after checking nothing changed since `requestedVersion`
+    void buildLayout()
+    {
+        modules.update(engine);
+
+        numEntries = forEachEntry(engine, modules,
+            [this](const uint32_t key, rack::engine::Module* const module, const uint32_t index, const bool isLight)
+        {
+            entries[key] = { module, index, isLight };
+        });
+
+        layoutVersion = requestedVersion;
+    }
+
+    void engineBlockProcessed(rack::engine::Engine*, const uint32_t frames, const uint32_t moduleListVersion) override
+    {
+        framesSinceUpdate += frames;
+
+        if (framesSinceUpdate < framesPerUpdate)
+            return;
+
+        framesSinceUpdate = 0;
+
+        int state = layoutState.load();
+
+        if (state == kLayoutReady)
+        {
+            layoutState.store(kLayoutInUse);
+            state = kLayoutInUse;
+            std::memset(lastSent, 0xff, sizeof(lastSent));
+            dirtyCursor = refreshCursor = 0;
+        }
+
+        if (state != kLayoutInUse)
+            return;
+
+        if (layoutVersion != moduleListVersion)
+        {
+            // keys are about to change, stop sending values for the old ones
+            std::memset(slots, 0, sizeof(float) * kSlotCount);
+            requestedVersion = moduleListVersion;
+            layoutState.store(kLayoutRequested);
+            layoutThread.signal.signal();
+            return;
+        }
+
+        if (numEntries == 0)
+        {
+            std::memset(slots, 0, sizeof(float) * kSlotCount);
+            return;
+        }
+
+        for (uint32_t key = 0; key < numEntries; ++key)
+        {
+            const Entry& entry(entries[key]);
+            current[key] = entry.isLight ? quantizeLight(entry.module->lights[entry.index].getBrightness())
+                                         : quantizeVoltage(entry.module->outputs[entry.index].getVoltage());
+        }
+
+        uint32_t used = 0;
+
+        // dirty values first, starting where we stopped last time so no entry starves
+        for (uint32_t i = 0, key = dirtyCursor % numEntries; i < numEntries && used < kSlotCount; ++i)
+        {
+            if (current[key] != lastSent[key])
+            {
+                lastSent[key] = current[key];
+                slots[used++] = pack(key, current[key]);
+                dirtyCursor = key + 1;
+            }
+
+            if (++key == numEntries)
+                key = 0;
+        }
+
+        // resend unchanged values on the remaining slots
+        const uint32_t dirtyUsed = used;
+
+        if (refreshCursor >= numEntries)
+            refreshCursor = 0;
+
+        for (uint32_t i = 0; i < numEntries && used < kSlotCount; ++i)
+        {
+            const uint32_t key = refreshCursor;
+            const float packed = pack(key, current[key]);
+
+            if (++refreshCursor == numEntries)
+                refreshCursor = 0;
+
+            // already sent as dirty value in this update
+            if (std::find(slots, slots + dirtyUsed, packed) != slots + dirtyUsed)
+                continue;
+
+            lastSent[key] = current[key];
+            slots[used++] = packed;
+        }
+
+        // mark unused slots as empty, so the same value sent twice on one slot is still seen as a change
+        for (; used < kSlotCount; ++used)
+            slots[used] = 0.f;
+    }
+};
+
+/**
+   UI side of the stream, receives slot values and applies them to the local modules after each engine step.
+ */
+struct Decoder {
+    struct Entry {
+        rack::engine::Module* module;
+        uint32_t index;
+        bool isLight;
+    };
+
+    ModuleList modules;
+    std::vector<Entry> entries;
+    uint16_t values[kMaxEntries];
+
+    Decoder()
+    {
+        std::memset(values, 0xff, sizeof(values));
+    }
+
+    void receive(const float packed) noexcept
+    {
+        uint32_t key;
+        uint16_t value;
+
+        if (unpack(packed, key, value))
+            values[key] = value;
+    }
+
+    void apply(rack::engine::Engine* const engine)
+    {
+        if (modules.update(engine))
+        {
+            entries.clear();
+            forEachEntry(engine, modules,
+                [this](uint32_t, rack::engine::Module* const module, const uint32_t index, const bool isLight)
+            {
+                entries.push_back({ module, index, isLight });
+            });
+            std::memset(values, 0xff, sizeof(values));
+            return;
+        }
+
+        const uint32_t numEntries = entries.size();
+
+        for (uint32_t key = 0; key < numEntries; ++key)
+        {
+            const uint16_t value = values[key];
+
+            if (value == kInvalidValue)
+                continue;
+
+            const Entry& entry(entries[key]);
+
+            if (entry.isLight)
+                entry.module->lights[entry.index].setBrightness(unquantizeLight(value));
+            else
+                entry.module->outputs[entry.index].setVoltage(unquantizeVoltage(value));
+        }
+    }
+};
+
+}
+
+// -----------------------------------------------------------------------------------------------------------
@@ -194,6 +194,7 @@ class CardinalPlugin : public CardinalBasePlugin
    #endif
    #if CARDINAL_VARIANT_MINI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
     float fMiniReportValues[kCardinalParameterCountAtMini - kCardinalParameterStartMini];
+    miniStream::Encoder fMiniStream;
    #endif
 
    #ifdef DISTRHO_PLUGIN_EXTRA_IO
@@ -248,6 +249,7 @@ public:
         fMiniReportValues[kCardinalParameterMiniTimeBeatsPerBar - kCardinalParameterStartMini] = 4;
         fMiniReportValues[kCardinalParameterMiniTimeBeatType - kCardinalParameterStartMini] = 4;
         fMiniReportValues[kCardinalParameterMiniTimeBeatsPerMinute - kCardinalParameterStartMini] = 120;
+        fMiniStream.setSampleRate(getSampleRate());
        #endif
 
         // create unique temporary path for this instance
@@ -313,6 +315,11 @@ public:
             context->scene->rackScroll->reset();
         }
 
+       #if CARDINAL_VARIANT_MINI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+        fMiniStream.start(context->engine,
+                          fMiniReportValues + (kCardinalParameterStartMiniStream - kCardinalParameterStartMini));
+       #endif
+
        #ifdef CARDINAL_INIT_OSC_THREAD
         fInitializer->remotePluginInstance = this;
        #endif
@@ -325,6 +332,10 @@ public:
             fInitializer->remotePluginInstance = nullptr;
        #endif
 
+       #if CARDINAL_VARIANT_MINI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+        fMiniStream.stop();
+       #endif
+
         {
             const ScopedContext sc(this);
             context->patch->clear();
@@ -729,6 +740,19 @@ protected:
        #endif
 
        #if CARDINAL_VARIANT_MINI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+        if (index >= kCardinalParameterStartMiniStream && index < kCardinalParameterCountAtMiniStream)
+        {
+            parameter.name = "Report Stream Slot ";
+            parameter.name += String(index - kCardinalParameterStartMiniStream + 1);
+            parameter.symbol = "r_stream_";
+            parameter.symbol += String(index - kCardinalParameterStartMiniStream + 1);
+            parameter.hints = kParameterIsAutomatable|kParameterIsOutput|kParameterIsInteger;
+            parameter.ranges.def = 0.0f;
+            parameter.ranges.min = 0.0f;
+            parameter.ranges.max = miniStream::kMaxPackedValue;
+            return;
+        }
+
         switch (index)
         {
         case kCardinalParameterMiniAudioIn1:
@@ -1285,8 +1309,14 @@ protected:
             context->midiEventCount = midiEventCount;
         }
 
+        context->midiBus.decode(context->midiEvents, context->midiEventCount);
+        context->parameterRamps.update(context->parameters, frames);
+
         ++context->processCounter;
         context->engine->stepBlock(frames);
+        context->parameterRamps.finish();
+
+        context->midiOutQueue.flush(this);
 
         fWasBypassed = bypassed;
     }
@@ -1297,6 +1327,9 @@ protected:
         rack::settings::sampleRate = newSampleRate;
         context->sampleRate = newSampleRate;
         context->engine->setSampleRate(newSampleRate);
+       #if CARDINAL_VARIANT_MINI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+        fMiniStream.setSampleRate(newSampleRate);
+       #endif
     }
 
    #ifdef DISTRHO_PLUGIN_EXTRA_IO
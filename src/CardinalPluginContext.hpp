@@ -40,6 +40,10 @@
 
 #include "plugincontext.hpp"
 
+#if CARDINAL_VARIANT_MINI
+# include "CardinalMiniStream.hpp"
+#endif
+
 START_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------------------------------------------
@@ -73,7 +77,9 @@ enum CardinalParameters {
     kCardinalParameterMiniTimeTick,
     kCardinalParameterMiniTimeTicksPerBeat,
     kCardinalParameterCountAtMiniTime,
-    kCardinalParameterCountAtMini = kCardinalParameterCountAtMiniTime,
+    kCardinalParameterStartMiniStream = kCardinalParameterCountAtMiniTime,
+    kCardinalParameterCountAtMiniStream = kCardinalParameterStartMiniStream + miniStream::kSlotCount,
+    kCardinalParameterCountAtMini = kCardinalParameterCountAtMiniStream,
     kCardinalParameterCount = kCardinalParameterCountAtMini
    #else
     kCardinalParameterCount = kCardinalParameterCountAtWindow
@@ -109,6 +115,7 @@ static_assert(kCardinalParameterStartMini == kCardinalParameterBypass + kWindowP
 static_assert(kCardinalParameterStartMini == kModuleParameterCount + kWindowParameterCount + 1, "valid parameter indexes");
 static_assert(kCardinalParameterCountAtWindow == kModuleParameterCount + kWindowParameterCount + 1, "valid parameter indexes");
 static_assert(DISTRHO_PLUGIN_NUM_INPUTS == kCardinalParameterCountAtMiniBuffers - kCardinalParameterStartMiniBuffers, "valid parameter indexes");
+static_assert(miniStream::kSlotCount == kCardinalParameterCountAtMiniStream - kCardinalParameterStartMiniStream, "valid parameter indexes");
 #endif
 
 // -----------------------------------------------------------------------------------------------------------
@@ -301,10 +301,16 @@ class CardinalUI : public CardinalBaseUI,
    #endif
     std::string fAutosavePath;
   #endif
+  #if CARDINAL_VARIANT_MINI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+    miniStream::Decoder fMiniStream;
+  #endif
 
     rack::math::Vec lastMousePos;
     WindowParameters windowParameters;
     int rateLimitStep = 0;
+    uint32_t lastMidiOutDroppedCount = 0;
+    uint32_t lastMidiOutCoalescedCount = 0;
+    double lastMidiOutReportTime = 0.0;
    #if defined(DISTRHO_OS_WASM) && ! CARDINAL_VARIANT_MINI
     int8_t counterForFirstIdlePoint = 0;
    #endif
@@ -641,13 +647,32 @@ public:
             filebrowserhandle = nullptr;
         }
 
+        // the audio thread only counts, report from here at most every few seconds
+        if (rack::system::getTime() - lastMidiOutReportTime >= 5.0)
+        {
+            const uint32_t dropped = context->midiOutQueue.droppedCount.load(std::memory_order_relaxed);
+            const uint32_t coalesced = context->midiOutQueue.coalescedCount.load(std::memory_order_relaxed);
+
+            if (dropped != lastMidiOutDroppedCount || coalesced != lastMidiOutCoalescedCount)
+            {
+                d_stdout("Cardinal: MIDI output has %u dropped and %u coalesced events since start",
+                         dropped, coalesced);
+                lastMidiOutReportTime = rack::system::getTime();
+                lastMidiOutDroppedCount = dropped;
+                lastMidiOutCoalescedCount = coalesced;
+            }
+        }
+
        #if CARDINAL_VARIANT_MINI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
         {
             const ScopedContext sc(this);
             for (uint32_t i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS;++i)
                 context->dataOuts[i][0] = 0.f;
+            context->parameterRamps.update(context->parameters, 1);
             ++context->processCounter;
             context->engine->stepBlock(1);
+            context->parameterRamps.finish();
+            fMiniStream.apply(context->engine);
         }
        #endif
 
@@ -858,6 +883,12 @@ protected:
             return;
         }
 
+        if (index >= kCardinalParameterStartMiniStream && index < kCardinalParameterCountAtMiniStream)
+        {
+            fMiniStream.receive(value);
+            return;
+        }
+
         switch (index)
         {
         case kCardinalParameterMiniTimeFlags: {
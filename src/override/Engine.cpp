@@ -33,6 +33,7 @@
 #include <plugin.hpp>
 #include <mutex.hpp>
 #include <helpers.hpp>
+#include <cpu-dispatch.hpp>
 
 #ifdef NDEBUG
 # undef DEBUG
@@ -40,6 +41,7 @@
 
 #include "../CardinalRemote.hpp"
 #include "DistrhoUtils.hpp"
+#include "plugincontext.hpp"
 
 
 // known terminal modules
@@ -102,6 +104,11 @@ struct Engine::Internal {
 	Readers lock when using the engine's state.
 	*/
 	SharedMutex mutex;
+
+	// Cardinal specific
+	CardinalEngineBlockCallback* blockCallback = nullptr;
+	// Changes every time a module is added or removed
+	uint32_t moduleListVersion = 0;
 };
 
 
@@ -271,8 +278,29 @@ static void Module__doProcess(Module* const module, const Module::ProcessArgs& a
 }
 
 
+/** Notifies terminal modules about the start or end of a block, so they can exchange whole buffers with the host
+*/
+static void Engine_stepTerminalBlock(Engine* that, int frames, bool start) {
+	Engine::Internal* internal = that->internal;
+
+	Module::ProcessArgs processArgs;
+	processArgs.sampleRate = internal->sampleRate;
+	processArgs.sampleTime = internal->sampleTime;
+	processArgs.frame = internal->blockFrame;
+
+	for (TerminalModule* terminalModule : internal->terminalModules) {
+		if (start)
+			terminalModule->processTerminalBlockStart(processArgs, frames);
+		else
+			terminalModule->processTerminalBlockEnd(processArgs, frames);
+	}
+}
+
+
 /** Steps a single frame
 */
+// cables are copied inline here, which the x86-64-v3 version does with wider moves
+CARDINAL_CPU_DISPATCH
 static void Engine_stepFrame(Engine* that) {
 	Engine::Internal* internal = that->internal;
 
@@ -563,12 +591,18 @@ void Engine::stepBlock(int frames) {
 	}
 
 	// Step individual frames
+	Engine_stepTerminalBlock(this, frames, true);
 	for (int i = 0; i < frames; i++) {
 		Engine_stepFrame(this);
 	}
+	Engine_stepTerminalBlock(this, frames, false);
 
 	internal->block++;
 
+	// Let Cardinal look at module state while modules cannot be removed
+	if (internal->blockCallback != nullptr)
+		internal->blockCallback->engineBlockProcessed(this, frames, internal->moduleListVersion);
+
 #ifndef HEADLESS
 	// Stop timer
 	double endTime = system::getTime();
@@ -753,6 +787,7 @@ void Engine::addModule(Module* module) {
 	else
 		internal->modules.push_back(module);
 	internal->modulesCache[module->id] = module;
+	++internal->moduleListVersion;
 	// Dispatch AddEvent
 	Module::AddEvent eAdd;
 	module->onAdd(eAdd);
@@ -818,6 +853,7 @@ static void removeModule_NoLock_common(Engine::Internal* internal, Module* modul
 	module->rightExpander.module = NULL;
 	// Remove module
 	internal->modulesCache.erase(module->id);
+	++internal->moduleListVersion;
 }
 
 
@@ -1341,5 +1377,11 @@ void Engine_setRemoteDetails(Engine* const engine, remoteUtils::RemoteDetails* c
 }
 
 
+void Engine_setBlockCallback(Engine* const engine, CardinalEngineBlockCallback* const callback) {
+	std::lock_guard<SharedMutex> lock(engine->internal->mutex);
+	engine->internal->blockCallback = callback;
+}
+
+
 } // namespace engine
 } // namespace rack
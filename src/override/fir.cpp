@@ -0,0 +1,227 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <dsp/fir.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+
+#if defined(ARCH_MAC)
+# include <dispatch/dispatch.h>
+#elif defined(ARCH_WIN)
+# include <windows.h>
+#else
+# include <cerrno>
+# include <semaphore.h>
+#endif
+
+#include "extra/Mutex.hpp"
+#include "extra/Thread.hpp"
+
+
+namespace rack {
+namespace dsp {
+namespace convolverworkers {
+
+
+/** Counting semaphore, posting to it does not take any lock so the audio thread can wake up workers. */
+struct Semaphore {
+#if defined(ARCH_MAC)
+	dispatch_semaphore_t sem;
+
+	Semaphore() : sem(dispatch_semaphore_create(0)) {}
+	~Semaphore() { dispatch_release(sem); }
+	void post() { dispatch_semaphore_signal(sem); }
+	void wait() { dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER); }
+#elif defined(ARCH_WIN)
+	HANDLE sem;
+
+	Semaphore() : sem(CreateSemaphoreW(NULL, 0, LONG_MAX, NULL)) {}
+	~Semaphore() { CloseHandle(sem); }
+	void post() { ReleaseSemaphore(sem, 1, NULL); }
+	void wait() { WaitForSingleObject(sem, INFINITE); }
+#else
+	sem_t sem;
+
+	Semaphore() { sem_init(&sem, 0, 0); }
+	~Semaphore() { sem_destroy(&sem); }
+	void post() { sem_post(&sem); }
+	void wait() { while (sem_wait(&sem) != 0 && errno == EINTR) {} }
+#endif
+};
+
+
+struct Workers {
+	struct Worker : DISTRHO_NAMESPACE::Thread {
+		Workers* const workers;
+
+		Worker(Workers* const w)
+			: Thread("ConvolverWorker"),
+			  workers(w) {}
+
+		void run() override {
+			workers->run(this);
+		}
+	};
+
+	// protects `convolvers` and claiming their stages
+	DISTRHO_NAMESPACE::Mutex mutex;
+	// posted once per queued job
+	Semaphore semaphore;
+	std::vector<RealTimeConvolver*> convolvers;
+	// serializes adding and removing convolvers, which starts and stops the threads
+	std::mutex threadsMutex;
+	std::vector<Worker*> threads;
+
+	void run(Worker* const worker) {
+		while (!worker->shouldThreadExit()) {
+			RealTimeConvolver* convolver = NULL;
+			RealTimeConvolver::Stage* stage = NULL;
+			RealTimeConvolver::Slot* slot = NULL;
+
+			{
+				const DISTRHO_NAMESPACE::MutexLocker cml(mutex);
+
+				// Earliest deadline first across all convolvers, stages are sequential so busy ones are skipped
+				size_t remaining = SIZE_MAX;
+				for (RealTimeConvolver* c : convolvers) {
+					if (c->suspended)
+						continue;
+					if (RealTimeConvolver::Slot* s = c->getNextJob(stage, remaining)) {
+						convolver = c;
+						slot = s;
+					}
+				}
+
+				if (slot != NULL) {
+					// The calling thread may have run the job meanwhile because it was late, then look again
+					if (!claim(stage, slot))
+						continue;
+					convolver->busyStages++;
+				}
+			}
+
+			if (slot == NULL) {
+				semaphore.wait();
+				continue;
+			}
+
+			stage->run(*slot);
+
+			stage->busy = false;
+			convolver->busyStages--;
+		}
+	}
+
+	static bool claim(RealTimeConvolver::Stage* const stage, RealTimeConvolver::Slot* const slot) {
+		bool idle = false;
+		if (!stage->busy.compare_exchange_strong(idle, true))
+			return false;
+		if (slot->state == RealTimeConvolver::kSlotQueued)
+			return true;
+		stage->busy = false;
+		return false;
+	}
+
+	void start() {
+		const unsigned count = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+
+		for (unsigned i = 0; i < count; i++) {
+			Worker* const worker = new Worker(this);
+			if (!worker->startThread(true) && !worker->startThread()) {
+				delete worker;
+				break;
+			}
+			threads.push_back(worker);
+		}
+	}
+
+	void stop() {
+		for (Worker* worker : threads) {
+			worker->signalThreadShouldExit();
+			semaphore.post();
+		}
+		for (Worker* worker : threads) {
+			worker->stopThread(-1);
+			delete worker;
+		}
+		threads.clear();
+	}
+};
+
+
+static Workers& getWorkers() {
+	static Workers workers;
+	return workers;
+}
+
+
+bool add(RealTimeConvolver* convolver) {
+	Workers& workers(getWorkers());
+	const std::lock_guard<std::mutex> lock(workers.threadsMutex);
+
+	if (workers.threads.empty())
+		workers.start();
+	if (workers.threads.empty())
+		return false;
+
+	const DISTRHO_NAMESPACE::MutexLocker cml(workers.mutex);
+	workers.convolvers.push_back(convolver);
+	return true;
+}
+
+
+void remove(RealTimeConvolver* convolver) {
+	Workers& workers(getWorkers());
+	const std::lock_guard<std::mutex> lock(workers.threadsMutex);
+
+	{
+		const DISTRHO_NAMESPACE::MutexLocker cml(workers.mutex);
+		workers.convolvers.erase(std::remove(workers.convolvers.begin(), workers.convolvers.end(), convolver), workers.convolvers.end());
+	}
+
+	// Not called from the audio thread, so the running jobs can be waited for
+	while (convolver->busyStages != 0)
+		std::this_thread::yield();
+
+	if (workers.convolvers.empty())
+		workers.stop();
+}
+
+
+void suspend(RealTimeConvolver* convolver) {
+	const DISTRHO_NAMESPACE::MutexLocker cml(getWorkers().mutex);
+	convolver->suspended = true;
+}
+
+
+void resume(RealTimeConvolver* convolver) {
+	convolver->suspended = false;
+	getWorkers().semaphore.post();
+}
+
+
+void notify() {
+	getWorkers().semaphore.post();
+}
+
+
+} // namespace convolverworkers
+} // namespace dsp
+} // namespace rack
@@ -0,0 +1,112 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Checks and benchmarks rack::dsp::RealTimeConvolver with 1 to 10 second impulse responses.
+//
+// For each length the convolver runs inline and threaded, the output is compared against a direct convolution and the
+// time spent per block is reported, average and worst. Not part of the regular build, from the repository root:
+//
+//   FLAGS="-Iinclude -Iinclude/simd-compat -Idpf/distrho -Isrc/Rack/include -Isrc/Rack/dep/include -Isrc/Rack/dep/pffft"
+//   cc -O2 -c src/Rack/dep/pffft/pffft.c -o pffft.o
+//   c++ -O2 -std=gnu++17 -pthread $FLAGS utils/benchmark-convolver.cpp src/override/fir.cpp pffft.o -o benchmark-convolver
+
+#include <dsp/fir.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+static constexpr const double kSampleRate = 48000.0;
+static constexpr const size_t kBlockSize = 128;
+static constexpr const size_t kNumImpulses = 16;
+
+struct Result {
+    double maxError;
+    double averageBlockTime;
+    double worstBlockTime;
+    uint32_t lateFrames;
+};
+
+static Result run(const std::vector<float>& kernel, const std::vector<float>& input, const bool threaded)
+{
+    rack::dsp::RealTimeConvolver convolver(kBlockSize, threaded);
+    convolver.setKernel(kernel.data(), kernel.size());
+
+    std::vector<float> output(input.size());
+    double totalTime = 0.0, worstTime = 0.0;
+
+    // paced like an audio callback, so threaded stages get the time they would get in a host
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t pos = 0; pos < input.size(); pos += kBlockSize)
+    {
+        const std::chrono::steady_clock::time_point blockStart = std::chrono::steady_clock::now();
+        convolver.processBlock(&input[pos], &output[pos]);
+        const double blockTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - blockStart).count();
+
+        totalTime += blockTime;
+        worstTime = std::max(worstTime, blockTime);
+
+        if (threaded)
+            std::this_thread::sleep_until(start + std::chrono::microseconds(
+                static_cast<int64_t>((pos + kBlockSize) * 1e6 / kSampleRate)));
+    }
+
+    // the input is a few impulses, so the direct convolution is cheap
+    std::vector<double> expected(input.size(), 0.0);
+    for (size_t pos = 0; pos < input.size(); ++pos)
+    {
+        if (input[pos] == 0.f)
+            continue;
+        for (size_t i = 0; i < kernel.size() && pos + i < input.size(); ++i)
+            expected[pos + i] += input[pos] * kernel[i];
+    }
+
+    double maxError = 0.0;
+    for (size_t pos = 0; pos < input.size(); ++pos)
+        maxError = std::max(maxError, std::fabs(output[pos] - expected[pos]));
+
+    return { maxError, totalTime / (input.size() / kBlockSize), worstTime, convolver.lateFrames };
+}
+
+int main()
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    bool ok = true;
+
+    std::printf("block size %zu, %.0f Hz, block period %.3f ms\n", kBlockSize, kSampleRate, kBlockSize * 1e3 / kSampleRate);
+
+    for (const int seconds : { 1, 2, 5, 10 })
+    {
+        const size_t length = seconds * kSampleRate;
+
+        // exponentially decaying noise, like a reverb tail
+        std::vector<float> kernel(length);
+        for (size_t i = 0; i < length; ++i)
+            kernel[i] = dist(rng) * std::exp(-3.0 * i / length) * 0.01f;
+
+        // long enough for the whole kernel to come through
+        std::vector<float> input(length * 2 + kBlockSize - (length * 2) % kBlockSize, 0.f);
+        for (size_t i = 0; i < kNumImpulses; ++i)
+            input[rng() % length] = dist(rng);
+
+        for (const bool threaded : { false, true })
+        {
+            const Result r = run(kernel, input, threaded);
+            const bool exact = r.maxError < 1e-4;
+            ok = ok && exact;
+
+            std::printf("%2d s IR, %-8s: max error %.2e%s, block average %.3f ms, worst %.3f ms, late frames %u\n",
+                        seconds, threaded ? "threaded" : "inline",
+                        r.maxError, exact ? "" : " (FAILED)",
+                        r.averageBlockTime * 1e3, r.worstBlockTime * 1e3, r.lateFrames);
+        }
+    }
+
+    return ok ? 0 : 1;
+}
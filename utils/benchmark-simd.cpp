@@ -0,0 +1,113 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2024 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Benchmarks 16 polyphonic channels processed as 4 float_4 against 2 float_8.
+//
+// The kernel is a saturating one-pole lowpass per channel, reading and writing 16 voltages per frame like a module does
+// with its ports. Both versions are checked to give the same output and the time per frame is reported.
+// Not part of the regular build, from the repository root once with and once without AVX2:
+//
+//   FLAGS="-Iinclude -Iinclude/simd-compat -Isrc/Rack/include -Isrc/Rack/dep/include -Isrc/Rack/dep/simde"
+//   c++ -O2 -std=gnu++17 $FLAGS utils/benchmark-simd.cpp -o benchmark-simd
+//   c++ -O2 -std=gnu++17 -march=x86-64-v3 $FLAGS utils/benchmark-simd.cpp -o benchmark-simd-v3
+//
+// Without AVX2 float_8 is a pair of float_4, so both versions should take about the same time.
+
+#include <simd/Vector.hpp>
+#include <simd/functions.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static constexpr const int kChannels = 16;
+static constexpr const size_t kFrames = 48000;
+static constexpr const int kRuns = 50;
+
+template <typename T>
+struct Lowpass {
+    static constexpr const int kVectors = kChannels / T::size;
+
+    T state[kVectors] = {};
+    T coeff[kVectors];
+
+    Lowpass(const float* const coeffs)
+    {
+        for (int i = 0; i < kVectors; ++i)
+            coeff[i] = T::load(coeffs + i * T::size);
+    }
+
+    void process(const float* const in, float* const out)
+    {
+        for (int i = 0; i < kVectors; ++i)
+        {
+            T x = T::load(in + i * T::size);
+            x = rack::simd::fmin(rack::simd::fmax(x, T(-3.f)), T(3.f));
+            x = x * (T(27.f) + x * x) / (T(27.f) + T(9.f) * x * x);
+
+            state[i] += coeff[i] * (x - state[i]);
+            state[i].store(out + i * T::size);
+        }
+    }
+};
+
+template <typename T>
+static double run(const std::vector<float>& input, const float* const coeffs, std::vector<float>& output)
+{
+    double best = 1e9;
+
+    for (int r = 0; r < kRuns; ++r)
+    {
+        Lowpass<T> lowpass(coeffs);
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (size_t f = 0; f < kFrames; ++f)
+            lowpass.process(&input[f * kChannels], &output[f * kChannels]);
+
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return best / kFrames;
+}
+
+int main()
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-10.f, 10.f);
+
+    std::vector<float> input(kFrames * kChannels);
+    for (float& v : input)
+        v = dist(rng);
+
+    float coeffs[kChannels];
+    for (int c = 0; c < kChannels; ++c)
+        coeffs[c] = 0.01f + 0.05f * c;
+
+    std::vector<float> output4(input.size()), output8(input.size());
+    const double time4 = run<rack::simd::float_4>(input, coeffs, output4);
+    const double time8 = run<rack::simd::float_8>(input, coeffs, output8);
+
+    double maxError = 0.0;
+    for (size_t i = 0; i < input.size(); ++i)
+        maxError = std::max(maxError, static_cast<double>(std::fabs(output4[i] - output8[i])));
+
+    const bool same = maxError < 1e-5;
+
+   #ifdef SIMD_VECTOR_8_NATIVE
+    std::printf("float_8 is native AVX\n");
+   #else
+    std::printf("float_8 is a pair of float_4\n");
+   #endif
+    std::printf("%d channels, 4 x float_4: %.2f ns per frame\n", kChannels, time4 * 1e9);
+    std::printf("%d channels, 2 x float_8: %.2f ns per frame, %.2fx\n", kChannels, time8 * 1e9, time4 / time8);
+    std::printf("max difference %.2e%s\n", maxError, same ? "" : " (FAILED)");
+
+    return same ? 0 : 1;
+}